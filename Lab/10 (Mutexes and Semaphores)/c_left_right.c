@@ -0,0 +1,318 @@
+#include <pthread.h>  // for pthread_create(), pthread_rwlock_t
+#include <stdint.h>   // for uint64_t
+#include <stdio.h>    // for perror(), printf()
+#include <stdlib.h>   // for exit(), atoi()
+#include <string.h>   // for strcmp()
+#include <time.h>     // for clock_gettime(), nanosleep()
+#include <unistd.h>   // for getopt()
+
+#include "left_right.h"
+
+//--------------------------------------------------------------------------------
+// Read-mostly map under three schemes: rwlock, seqlock and left-right
+// Brief: a_mutex.c and b_semaphore.c guard a counter with an exclusive lock. Here many reader threads look up
+//        entries of a shared map while one writer keeps changing it, and each scheme is run for the same time:
+//        - rwlock:     pthread_rwlock_rdlock()/wrlock() around one copy
+//        - seqlock:    readers read without locking and retry if the sequence count moved (a write overlapped)
+//        - left-right: readers never wait and never retry (left_right.h); the writer pays with two copies
+//
+// Usage:
+//   ./c_left_right [-r readers] [-s seconds] [-w write_interval_us] [-m rwlock|seqlock|left-right]
+//
+// Notes:
+// - Every entry holds a value and a check derived from it, so a reader that saw half a write (a torn read)
+//   notices; all three must report 0 torn reads
+// - retries/1k: seqlock read attempts thrown away per 1000 reads; they grow with the write rate and the size of
+//   the read section, since any write during a read invalidates it
+// - write us: average time of one write. The left-right writer applies it twice and waits for readers to drain;
+//   the rwlock writer waits for every reader to unlock (and glibc prefers readers, so it may starve)
+// - With more CPUs the shared reader count of the rwlock bounces between caches, which left-right's per-thread
+//   slots avoid. On a single CPU a reader preempted inside its read section holds the left-right writer (and the
+//   rwlock writer) for a scheduler time slice, so writes there take milliseconds while reads stay unaffected
+//--------------------------------------------------------------------------------
+
+#define MAP_ENTRIES 1024
+#define LOOKUPS 8  // entries read per read section
+#define MAX_READERS 64
+
+typedef struct {
+  uint64_t value;
+  uint64_t check;  // entry_check(value): a reader that sees a mismatch read a torn entry
+} Entry;
+
+typedef struct {
+  Entry entries[MAP_ENTRIES];
+} Map;
+
+typedef struct {
+  uint32_t key;
+  uint64_t value;
+} Change;
+
+typedef struct {
+  const char* name;
+  uint64_t (*read)(uint32_t seed, uint64_t* retries, uint64_t* torn);  // returns the sum looked up
+  void (*write)(const Change* change);
+} Method;
+
+typedef struct {
+  const Method* method;
+  uint32_t seed;
+  uint64_t reads;
+  uint64_t retries;
+  uint64_t torn;
+  uint64_t sink;  // keeps the lookups from being optimised away
+} ReaderStats;
+
+typedef struct {
+  const Method* method;
+  long interval_us;
+  uint64_t writes;
+  double seconds;  // inside write()
+} WriterStats;
+
+static _Atomic int stop = 0;
+static Map initial;
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static Map rw_map;
+static _Atomic unsigned long seq = 0;  // odd while a write is in progress
+static Map seq_map;
+static LeftRight lr;
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+uint64_t entry_check(uint64_t value) {
+  return value * 0x9e3779b97f4a7c15ull ^ 0x5555555555555555ull;
+}
+
+uint32_t next_key(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x % MAP_ENTRIES;
+}
+
+void set_entry(void* instance, const void* arg) {
+  Map* map             = instance;
+  const Change* change = arg;
+
+  map->entries[change->key].value = change->value;
+  map->entries[change->key].check = entry_check(change->value);
+}
+
+uint64_t lookup(const Map* map, uint32_t seed, uint64_t* torn) {
+  uint64_t sum = 0;
+  for (int i = 0; i < LOOKUPS; i++) {
+    Entry e = map->entries[next_key(&seed)];
+    *torn += e.check != entry_check(e.value);
+    sum += e.value;
+  }
+  return sum;
+}
+
+uint64_t rwlock_read(uint32_t seed, uint64_t* retries, uint64_t* torn) {
+  (void)retries;
+  pthread_rwlock_rdlock(&rwlock);
+  uint64_t sum = lookup(&rw_map, seed, torn);
+  pthread_rwlock_unlock(&rwlock);
+  return sum;
+}
+
+void rwlock_write(const Change* change) {
+  pthread_rwlock_wrlock(&rwlock);
+  set_entry(&rw_map, change);
+  pthread_rwlock_unlock(&rwlock);
+}
+
+// The data races with the writer, so it is read with relaxed atomic loads; the sequence count says if it was torn
+uint64_t seqlock_read(uint32_t seed, uint64_t* retries, uint64_t* torn) {
+  while (1) {
+    unsigned long before = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+    if (before & 1) {  // a write is in progress
+      (*retries)++;
+      sched_yield();
+      continue;
+    }
+    uint64_t sum = 0, bad = 0;
+    uint32_t key = seed;
+    for (int i = 0; i < LOOKUPS; i++) {
+      const Entry* e = &seq_map.entries[next_key(&key)];
+      uint64_t value = __atomic_load_n(&e->value, __ATOMIC_RELAXED);
+      bad += __atomic_load_n(&e->check, __ATOMIC_RELAXED) != entry_check(value);
+      sum += value;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&seq, __ATOMIC_RELAXED) == before) {
+      *torn += bad;
+      return sum;
+    }
+    (*retries)++;
+  }
+}
+
+void seqlock_write(const Change* change) {
+  unsigned long s = __atomic_load_n(&seq, __ATOMIC_RELAXED);  // one writer, no lock needed between writers
+  __atomic_store_n(&seq, s + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  Entry* e = &seq_map.entries[change->key];
+  __atomic_store_n(&e->value, change->value, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->check, entry_check(change->value), __ATOMIC_RELAXED);
+  __atomic_store_n(&seq, s + 2, __ATOMIC_RELEASE);
+}
+
+uint64_t left_right_read(uint32_t seed, uint64_t* retries, uint64_t* torn) {
+  (void)retries;
+  LeftRightToken token;
+  const Map* map = lr_read_begin(&lr, &token);
+  uint64_t sum   = lookup(map, seed, torn);
+  lr_read_end(&lr, token);
+  return sum;
+}
+
+void left_right_write(const Change* change) {
+  lr_write(&lr, set_entry, change);
+}
+
+static const Method METHODS[] = {
+    {"rwlock", rwlock_read, rwlock_write},
+    {"seqlock", seqlock_read, seqlock_write},
+    {"left-right", left_right_read, left_right_write},
+};
+
+#define METHOD_COUNT (sizeof(METHODS) / sizeof(METHODS[0]))
+
+void* reader_thread(void* arg) {
+  ReaderStats* stats = arg;
+  uint32_t seed      = stats->seed;
+  while (!stop) {
+    stats->sink += stats->method->read(seed, &stats->retries, &stats->torn);
+    stats->reads++;
+    next_key(&seed);
+  }
+  return NULL;
+}
+
+void* writer_thread(void* arg) {
+  WriterStats* stats    = arg;
+  uint32_t seed         = 12345;
+  struct timespec pause = {0, stats->interval_us * 1000};
+  while (!stop) {
+    uint64_t value = stats->writes + 1;
+    Change change  = {next_key(&seed), value};
+    double start   = now_seconds();
+    stats->method->write(&change);
+    stats->seconds += now_seconds() - start;
+    stats->writes++;
+    if (stats->interval_us > 0) {
+      nanosleep(&pause, NULL);
+    }
+  }
+  return NULL;
+}
+
+void run_method(const Method* method, int readers, double seconds, long interval_us) {
+  ReaderStats reader_stats[MAX_READERS] = {{0}};
+  WriterStats writer_stats             = {method, interval_us, 0, 0};
+  pthread_t reader_ids[MAX_READERS], writer_id;
+
+  stop = 0;
+  for (int r = 0; r < readers; r++) {
+    reader_stats[r].method = method;
+    reader_stats[r].seed   = 2463534242u + (uint32_t)r * 7919u;
+    if (pthread_create(&reader_ids[r], NULL, reader_thread, &reader_stats[r]) != 0) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (pthread_create(&writer_id, NULL, writer_thread, &writer_stats) != 0) {
+    perror("pthread_create");
+    exit(EXIT_FAILURE);
+  }
+
+  struct timespec run = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+  nanosleep(&run, NULL);
+  stop = 1;
+  pthread_join(writer_id, NULL);
+  uint64_t reads = 0, retries = 0, torn = 0;
+  for (int r = 0; r < readers; r++) {
+    pthread_join(reader_ids[r], NULL);
+    reads += reader_stats[r].reads;
+    retries += reader_stats[r].retries;
+    torn += reader_stats[r].torn;
+  }
+
+  (void)printf("%-12s %8d %14.0f %10.0f %10.2f %12.2f %6llu\n", method->name, readers, reads / seconds,
+               writer_stats.writes / seconds, writer_stats.writes > 0 ? writer_stats.seconds / writer_stats.writes * 1e6 : 0,
+               reads > 0 ? 1000.0 * retries / reads : 0, (unsigned long long)torn);
+}
+
+// Program to compare a rwlock, a seqlock and left-right on a read-mostly map
+int main(int argc, char* argv[]) {
+  int readers      = 4;
+  double seconds   = 1;
+  long interval_us = 100;
+  const char* only = NULL;
+
+  int c;
+  while ((c = getopt(argc, argv, "r:s:w:m:")) != -1) {
+    switch (c) {
+      case 'r':
+        readers = atoi(optarg);
+        break;
+      case 's':
+        seconds = atof(optarg);
+        break;
+      case 'w':
+        interval_us = atol(optarg);
+        break;
+      case 'm':
+        only = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: ./c_left_right [-r readers] [-s seconds] [-w write_interval_us] [-m rwlock|seqlock|left-right]\n");
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (readers <= 0 || readers > MAX_READERS || seconds <= 0 || interval_us < 0 || interval_us >= 1000000) {
+    fprintf(stderr, "1 <= readers <= %d, seconds > 0 and 0 <= write_interval_us < 1000000\n", MAX_READERS);
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t k = 0; k < MAP_ENTRIES; k++) {
+    initial.entries[k].value = 0;
+    initial.entries[k].check = entry_check(0);
+  }
+  rw_map  = initial;
+  seq_map = initial;
+  if (lr_init(&lr, &initial, sizeof(Map)) == -1) {
+    perror("lr_init");
+    exit(EXIT_FAILURE);
+  }
+
+  const Method* selected = NULL;
+  for (size_t m = 0; m < METHOD_COUNT && only != NULL; m++) {
+    selected = strcmp(only, METHODS[m].name) == 0 ? &METHODS[m] : selected;
+  }
+  if (only != NULL && selected == NULL) {
+    fprintf(stderr, "Unknown method %s (rwlock, seqlock, left-right)\n", only);
+    exit(EXIT_FAILURE);
+  }
+
+  (void)printf("%d readers, %d lookups per read, one write every %ld us\n", readers, LOOKUPS, interval_us);
+  (void)printf("%-12s %8s %14s %10s %10s %12s %6s\n", "method", "readers", "reads/s", "writes/s", "write us", "retries/1k",
+               "torn");
+  for (size_t m = 0; m < METHOD_COUNT; m++) {
+    if (selected == NULL || selected == &METHODS[m]) {
+      run_method(&METHODS[m], readers, seconds, interval_us);
+    }
+  }
+
+  lr_destroy(&lr);
+  return EXIT_SUCCESS;
+}
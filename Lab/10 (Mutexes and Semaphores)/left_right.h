@@ -0,0 +1,138 @@
+#ifndef LEFT_RIGHT_H
+#define LEFT_RIGHT_H
+
+#include <errno.h>    // for errno
+#include <pthread.h>  // for pthread_mutex_t
+#include <sched.h>    // for sched_yield()
+#include <stdlib.h>   // for malloc(), free()
+#include <string.h>   // for memcpy()
+
+//--------------------------------------------------------------------------------
+// Left-right: wait-free reads of a read-mostly struct
+// Brief: Keeps two instances of the data. Readers always read the instance the writer is not touching, in a fixed
+//        number of steps (no lock, no retry); the single writer changes the other instance, points new readers at
+//        it, waits for the readers still on the old one to leave, then applies the same change to the old one.
+//
+// Usage:
+//   LeftRight lr;
+//   lr_init(&lr, &initial_map, sizeof(Map));   // both instances start as copies of initial_map
+//
+//   LeftRightToken token;                      // reader
+//   const Map* map = lr_read_begin(&lr, &token);
+//   ... read map ...
+//   lr_read_end(&lr, token);
+//
+//   lr_write(&lr, set_entry, &change);         // writer: set_entry(instance, &change) runs once per instance
+//
+//   lr_destroy(&lr);
+//
+// Returns: lr_init() returns 0 on success; -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - Readers announce themselves on one of two read indicators (picked by version), then read which instance is
+//   live. The writer flips the instance, then drains the indicators one at a time, so a reader that saw the
+//   old instance has left it before the writer touches it
+// - A read indicator is LR_READER_SLOTS counters on separate cache lines; each thread sticks to one, so readers
+//   on different CPUs do not bounce one line between them as they would with a rwlock's single count
+// - apply must be deterministic: it runs on both instances and they must stay equal. Writers are serialized by a
+//   mutex and wait for readers (yielding), so writes are slow; this suits read-mostly data only
+// - A reader must not call lr_write() inside its read section: the writer would wait for it forever
+// - Memory: two full copies of the data
+//
+// Search "Left-Right: A Concurrency Control Technique with Wait-Free Population Oblivious Reads" for the algorithm
+//--------------------------------------------------------------------------------
+
+#define LR_READER_SLOTS 64
+#define LR_CACHE_LINE 64
+
+typedef struct {
+  _Alignas(LR_CACHE_LINE) _Atomic long count;  // readers inside, on this slot
+} LeftRightSlot;
+
+typedef struct {
+  LeftRightSlot indicators[2][LR_READER_SLOTS];
+  _Alignas(LR_CACHE_LINE) _Atomic unsigned live;  // instance readers use
+  _Atomic unsigned version;                        // indicator new readers arrive on
+  pthread_mutex_t writer;
+  void* instances[2];
+  size_t size;
+} LeftRight;
+
+typedef struct {
+  unsigned version;  // the indicator to leave
+  unsigned slot;
+} LeftRightToken;
+
+static _Atomic unsigned lr_next_slot = 0;
+static _Thread_local unsigned lr_slot = LR_READER_SLOTS;  // LR_READER_SLOTS until the thread first reads
+
+static inline int lr_init(LeftRight* lr, const void* initial, size_t size) {
+  memset(lr, 0, sizeof(*lr));
+  lr->size         = size;
+  lr->instances[0] = malloc(size);
+  lr->instances[1] = malloc(size);
+  if (lr->instances[0] == NULL || lr->instances[1] == NULL) {
+    free(lr->instances[0]);
+    free(lr->instances[1]);
+    errno = ENOMEM;
+    return -1;
+  }
+  memcpy(lr->instances[0], initial, size);
+  memcpy(lr->instances[1], initial, size);
+  int err = pthread_mutex_init(&lr->writer, NULL);
+  if (err != 0) {
+    free(lr->instances[0]);
+    free(lr->instances[1]);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+static inline void lr_destroy(LeftRight* lr) {
+  pthread_mutex_destroy(&lr->writer);
+  free(lr->instances[0]);
+  free(lr->instances[1]);
+}
+
+// Wait-free: two atomic loads and one atomic add, whatever the writer is doing
+static inline const void* lr_read_begin(LeftRight* lr, LeftRightToken* token) {
+  if (lr_slot == LR_READER_SLOTS) {
+    lr_slot = lr_next_slot++ % LR_READER_SLOTS;
+  }
+  token->slot    = lr_slot;
+  token->version = lr->version;
+  lr->indicators[token->version][token->slot].count++;
+  return lr->instances[lr->live];
+}
+
+static inline void lr_read_end(LeftRight* lr, LeftRightToken token) {
+  lr->indicators[token.version][token.slot].count--;
+}
+
+static inline void lr_wait_empty(LeftRight* lr, unsigned version) {
+  for (unsigned s = 0; s < LR_READER_SLOTS; s++) {
+    while (lr->indicators[version][s].count != 0) {
+      sched_yield();  // the reader may need this CPU to finish
+    }
+  }
+}
+
+// Applies apply(instance, arg) to both instances without ever blocking a reader
+static inline void lr_write(LeftRight* lr, void (*apply)(void* instance, const void* arg), const void* arg) {
+  pthread_mutex_lock(&lr->writer);
+  unsigned live = lr->live;
+  apply(lr->instances[!live], arg);  // nobody reads this one
+  lr->live = !live;                  // new readers go to the changed instance
+
+  // Readers may still be on the old instance: drain the idle indicator, move new arrivals to it, drain the other
+  unsigned version = lr->version;
+  lr_wait_empty(lr, !version);
+  lr->version = !version;
+  lr_wait_empty(lr, version);
+
+  apply(lr->instances[live], arg);  // now nobody reads this one either
+  pthread_mutex_unlock(&lr->writer);
+}
+
+#endif  // LEFT_RIGHT_H
@@ -1,9 +1,14 @@
+#define _GNU_SOURCE
 #include <stdio.h>      // for perror()
 #include <stdlib.h>     // for exit()
 #include <sys/types.h>  // for pid_t
 #include <sys/wait.h>   // for wait()
 #include <unistd.h>     // for pipe(), read(), write(), close()
 
+#include "../common/fast_format.h"
+#include "../common/spawn.h"
+#include "ipc_utils.h"
+
 //--------------------------------------------------------------------------------
 // int pipe(int pipe_fd[2]);
 // Brief: Creates an unnamed pipe for inter-process communication.
@@ -49,50 +54,12 @@ const int BUFFER_SIZE = 1024;
 const int READ_END    = 0;
 const int WRITE_END   = 1;
 
-// Error handling utilities as functions
-void handle_error(const char* msg) {
-  perror(msg);
-  exit(EXIT_FAILURE);
-}
-
-void check_result(int result, const char* msg) {
-  if (result == -1) {
-    handle_error(msg);
-  }
-}
-
 void check_pointer(void* ptr, const char* msg) {
   if (ptr == NULL) {
     handle_error(msg);
   }
 }
 
-// Since pipes do not guarantee all the data is read in one go, we can use loops to ensure complete read/write
-ssize_t write_all(int fd, const void* buffer, size_t bytes) {
-  size_t total    = 0;
-  const char* ptr = buffer;
-  while (total < bytes) {
-    ssize_t written = write(fd, ptr + total, bytes - total);
-    if (written <= 0) {
-      return -1;
-    }
-    total += written;
-  }
-  return total;
-}
-ssize_t read_all(int fd, void* buffer, size_t bytes) {
-  size_t total = 0;
-  char* ptr    = buffer;
-  while (total < bytes) {
-    ssize_t r = read(fd, ptr + total, bytes - total);
-    if (r <= 0) {
-      return -1;
-    }
-    total += r;
-  }
-  return total;
-}
-
 // Function to handle child process logic
 void child_process(int write_fd) {
   int num;
@@ -147,26 +114,47 @@ void parent_process(int read_fd) {
   // Read all numbers to array
   check_result(read_all(read_fd, arr, num * sizeof(int)), "read_all");
 
+  // One write() for the whole line instead of one printf() per element
+  static FmtBuffer out;
   for (size_t i = 0; i < (size_t)num; i++) {
-    (void)printf("%d ", arr[i]);
+    fmt_int(&out, arr[i]);
+    fmt_char(&out, ' ');
   }
-  (void)putchar('\n');
+  fmt_char(&out, '\n');
+  check_result(fmt_flush(&out, STDOUT_FILENO), "write");
 
   free(arr);
   check_result(wait(NULL), "wait");
 }
 
 // Program to send numbers from child to parent
-int main() {
+// -s picks how the child is created: fork (default), vfork, posix_spawn or clone (see ../common/spawn.h)
+int main(int argc, char* argv[]) {
+  if (spawn_is_child(argc, argv)) {  // re-run by -s vfork|posix_spawn|clone; argv[2] is the write end
+    int write_fd = atoi(argv[2]);
+    child_process(write_fd);
+    check_result(close(write_fd), "close");
+    return EXIT_SUCCESS;
+  }
+
+  SpawnMode mode = SPAWN_FORK;
+  if (spawn_parse_args(argc, argv, &mode) == -1) {
+    fprintf(stderr, "Usage: ./a_unnamed_pipes [-s fork|vfork|posix_spawn|clone]\n");
+    exit(EXIT_FAILURE);
+  }
+
   int fd[2];
   check_result(pipe(fd), "pipe");
 
-  pid_t pid;
-  pid = fork();
-  check_result(pid, "fork");
+  char write_fd[16];
+  snprintf(write_fd, sizeof(write_fd), "%d", fd[WRITE_END]);
+  char* child_argv[] = {SPAWN_SELF, SPAWN_CHILD_ARG, write_fd, NULL};
 
-  if (pid == 0) {  // Child process
-    check_result(close(fd[READ_END]), "close");
+  // The child must not keep the read end, in every mode
+  pid_t pid = spawn_child(mode, child_argv, &fd[READ_END], 1);
+  check_result(pid, "spawn_child");
+
+  if (pid == 0) {  // Child process (fork)
     child_process(fd[WRITE_END]);
     check_result(close(fd[WRITE_END]), "close");
   } else {  // Parent process
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <errno.h>      // for errno
 #include <fcntl.h>      // for open()
 #include <stdio.h>      // for perror(), fprintf()
@@ -7,6 +8,10 @@
 #include <sys/wait.h>   // for wait()
 #include <unistd.h>     // for unlink(), read(), write(), close()
 
+#include "../common/fast_format.h"
+#include "../common/spawn.h"
+#include "ipc_utils.h"
+
 //--------------------------------------------------------------------------------
 // int mkfifo(const char* path_name, mode_t mode);
 // Brief: Creates a named pipe (FIFO) for inter-process communication.
@@ -73,18 +78,6 @@
 const char* FIFO_PATH = "/tmp/my_named_pipe";  // can be some other name too
 const int BUFFER_SIZE = 1024;
 
-// Error handling utilities as functions
-void handle_error(const char* msg) {
-  perror(msg);
-  exit(EXIT_FAILURE);
-}
-
-void check_result(int result, const char* msg) {
-  if (result == -1) {
-    handle_error(msg);
-  }
-}
-
 void check_pointer(void* ptr, const char* msg) {
   if (ptr == NULL) {
     handle_error(msg);
@@ -104,33 +97,6 @@ void close_fd(int fd) {
   }
 }
 
-// Since pipes do not guarantee all the data is read in one go, we can use loops to ensure complete read/write
-ssize_t write_all(int fd, const void* buffer, size_t bytes) {
-  size_t total    = 0;
-  const char* ptr = buffer;
-  while (total < bytes) {
-    ssize_t written = write(fd, ptr + total, bytes - total);
-    if (written <= 0) {
-      return -1;
-    }
-    total += written;
-  }
-  return total;
-}
-
-ssize_t read_all(int fd, void* buffer, size_t bytes) {
-  size_t total = 0;
-  char* ptr    = buffer;
-  while (total < bytes) {
-    ssize_t r = read(fd, ptr + total, bytes - total);
-    if (r <= 0) {
-      return -1;
-    }
-    total += r;
-  }
-  return total;
-}
-
 // Handle child process logic
 void child_process() {
   int fd = open(FIFO_PATH, O_WRONLY);
@@ -209,10 +175,16 @@ void parent_process() {
     exit(EXIT_FAILURE);
   }
 
+  // One write() for the whole line instead of one printf() per element
+  static FmtBuffer out;
   for (size_t i = 0; i < (size_t)num; i++) {
-    (void)printf("%d ", arr[i]);
+    fmt_int(&out, arr[i]);
+    fmt_char(&out, ' ');
+  }
+  fmt_char(&out, '\n');
+  if (fmt_flush(&out, STDOUT_FILENO) == -1) {
+    perror("write");
   }
-  (void)putchar('\n');
 
   free(arr);
   close_fd(fd);
@@ -224,7 +196,19 @@ void parent_process() {
 }
 
 // Program to send numbers from child to parent using a named pipe (FIFO)
-int main() {
+// -s picks how the child is created: fork (default), vfork, posix_spawn or clone (see ../common/spawn.h)
+int main(int argc, char* argv[]) {
+  if (spawn_is_child(argc, argv)) {  // re-run by -s vfork|posix_spawn|clone; the FIFO is found by its path
+    child_process();
+    return EXIT_SUCCESS;
+  }
+
+  SpawnMode mode = SPAWN_FORK;
+  if (spawn_parse_args(argc, argv, &mode) == -1) {
+    fprintf(stderr, "Usage: ./b_named_pipes [-s fork|vfork|posix_spawn|clone]\n");
+    exit(EXIT_FAILURE);
+  }
+
   // Create the named pipe with read-write permissions
   if (mkfifo(FIFO_PATH, 0666) == -1) {
     if (errno != EEXIST) {  // Ignore if the FIFO already exists
@@ -232,9 +216,10 @@ int main() {
     }
   }
 
-  pid_t pid = fork();
+  char* child_argv[] = {SPAWN_SELF, SPAWN_CHILD_ARG, NULL};
+  pid_t pid          = spawn_child(mode, child_argv, NULL, 0);
   if (pid == -1) {
-    perror("fork");
+    perror("spawn_child");
     cleanup_fifo();
     exit(EXIT_FAILURE);
   }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <fcntl.h>      // for O_CREAT, O_RDWR
 #include <stdio.h>      // for perror(), fprintf(), printf()
 #include <stdlib.h>     // for exit(), malloc()
@@ -7,6 +8,10 @@
 #include <sys/wait.h>   // for wait()
 #include <unistd.h>     // for ftruncate(), close()
 
+#include "../common/fast_format.h"
+#include "../common/spawn.h"
+#include "ipc_utils.h"
+
 //--------------------------------------------------------------------------------
 // int shm_open(const char *name, int oflag, mode_t mode);
 // Brief: Opens or creates a POSIX shared memory object.
@@ -111,17 +116,6 @@
 #define SHM_NAME "/my_shared_memory"
 #define BUFFER_SIZE 1024
 
-void handle_error(const char* msg) {
-  perror(msg);
-  exit(EXIT_FAILURE);
-}
-
-void check_result(int result, const char* msg) {
-  if (result == -1) {
-    handle_error(msg);
-  }
-}
-
 void check_pointer(void* ptr, const char* msg) {
   if (ptr == MAP_FAILED) {
     handle_error(msg);
@@ -181,7 +175,7 @@ void child_process(void* ptr, int shm_fd) {
 
 void parent_process(void* ptr, int shm_fd) {
   // Wait for child to complete
-  if (wait(NULL) != 0) {
+  if (wait(NULL) == -1) {
     perror("wait");
     cleanup_shm(ptr, shm_fd, 1);
     exit(EXIT_FAILURE);
@@ -196,16 +190,41 @@ void parent_process(void* ptr, int shm_fd) {
     exit(EXIT_FAILURE);
   }
 
+  // One write() for the whole line instead of one printf() per element
+  static FmtBuffer out;
   for (int i = 0; i < num; i++) {
-    (void)printf("%d ", shm_data[i + 1]);
+    fmt_int(&out, shm_data[i + 1]);
+    fmt_char(&out, ' ');
+  }
+  fmt_char(&out, '\n');
+  if (fmt_flush(&out, STDOUT_FILENO) == -1) {
+    perror("write");
   }
-  (void)putchar('\n');
 
   // Parent always unlinks the shared memory
   cleanup_shm(ptr, shm_fd, 1);
 }
 
-int main() {
+// -s picks how the child is created: fork (default), vfork, posix_spawn or clone (see ../common/spawn.h)
+int main(int argc, char* argv[]) {
+  if (spawn_is_child(argc, argv)) {
+    // Re-run by -s vfork|posix_spawn|clone: shm_open() fds are close-on-exec, so open the object again by name
+    int shm_fd = shm_open(SHM_NAME, O_RDWR, 0);
+    if (shm_fd == -1) {
+      handle_error("shm_open (child)");
+    }
+    void* ptr = mmap(NULL, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    check_pointer(ptr, "mmap (child)");
+    child_process(ptr, shm_fd);
+    return EXIT_SUCCESS;
+  }
+
+  SpawnMode mode = SPAWN_FORK;
+  if (spawn_parse_args(argc, argv, &mode) == -1) {
+    fprintf(stderr, "Usage: ./c_shared_memory [-s fork|vfork|posix_spawn|clone]\n");
+    exit(EXIT_FAILURE);
+  }
+
   // Create or open shared memory
   int shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
   if (shm_fd == -1) {
@@ -223,9 +242,10 @@ int main() {
   void* ptr = mmap(NULL, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
   check_pointer(ptr, "mmap");
 
-  pid_t pid = fork();
+  char* child_argv[] = {SPAWN_SELF, SPAWN_CHILD_ARG, NULL};
+  pid_t pid          = spawn_child(mode, child_argv, NULL, 0);
   if (pid == -1) {
-    perror("fork");
+    perror("spawn_child");
     cleanup_shm(ptr, shm_fd, 1);
     exit(EXIT_FAILURE);
   }
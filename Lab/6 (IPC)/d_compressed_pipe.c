@@ -0,0 +1,140 @@
+#include <fcntl.h>      // for open()
+#include <stdint.h>     // for uint64_t
+#include <stdio.h>      // for perror(), printf()
+#include <stdlib.h>     // for exit(), malloc()
+#include <string.h>     // for memcmp()
+#include <sys/stat.h>   // for fstat()
+#include <sys/types.h>  // for pid_t
+#include <sys/wait.h>   // for wait()
+#include <time.h>       // for clock_gettime()
+#include <unistd.h>     // for pipe(), read(), write(), close()
+
+#include "../common/lz.h"
+#include "ipc_utils.h"
+
+//--------------------------------------------------------------------------------
+// Compressed pipe payloads
+// Brief: The child sends the same data through a pipe twice, first raw and then as an LZ frame (../common/lz.h);
+//        the parent times both transfers and checks that it got the data back unchanged.
+//
+// Usage:
+//   ./d_compressed_pipe [-t threads] <file>
+//
+// Notes:
+// - lz_send() compresses the whole payload into one frame and writes it; lz_recv() reads block records up to
+//   the terminator and decompresses them on up to threads threads
+// - Compression only pays off when the pipe, not the CPU, is the bottleneck: text and logs shrink 3-5x,
+//   already compressed or random data is sent as stored blocks with 8 bytes of overhead per block
+//
+// Search pipe(2) for more information
+//--------------------------------------------------------------------------------
+
+const int READ_END  = 0;
+const int WRITE_END = 1;
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Reads the whole file into memory before forking, so both processes have it
+char* load_file(const char* path, size_t* size) {
+  int fd = open(path, O_RDONLY);
+  check_result(fd, "open");
+
+  struct stat st;
+  check_result(fstat(fd, &st), "fstat");
+  *size = (size_t)st.st_size;
+
+  char* data = malloc(*size + 1);
+  if (data == NULL) {
+    handle_error("malloc");
+  }
+  check_result(lz_read_all(fd, data, *size), "read");
+  check_result(close(fd), "close");
+  return data;
+}
+
+void child_process(int write_fd, const char* data, size_t size, unsigned threads) {
+  // Raw: length prefix and the bytes as they are
+  uint64_t length = size;
+  check_result(lz_write_all(write_fd, &length, sizeof(length)), "write");
+  check_result(lz_write_all(write_fd, data, size), "write");
+
+  // Compressed: one LZ frame
+  check_result(lz_send(write_fd, data, size, threads), "lz_send");
+}
+
+void parent_process(int read_fd, const char* expected, size_t size, unsigned threads) {
+  double start = now_seconds();
+
+  uint64_t length;
+  check_result(lz_read_all(read_fd, &length, sizeof(length)), "read");
+  char* raw = malloc(length + 1);
+  if (raw == NULL) {
+    handle_error("malloc");
+  }
+  check_result(lz_read_all(read_fd, raw, length), "read");
+  double raw_seconds = now_seconds() - start;
+
+  start = now_seconds();
+  void* data;
+  size_t received;
+  ssize_t wire = lz_recv(read_fd, &data, &received, threads);
+  check_result(wire, "lz_recv");
+  double lz_seconds = now_seconds() - start;
+
+  if (length != size || memcmp(raw, expected, size) != 0 || received != size || memcmp(data, expected, size) != 0) {
+    fprintf(stderr, "Data was corrupted in transit\n");
+    exit(EXIT_FAILURE);
+  }
+
+  (void)printf("raw:  %zu bytes in %.6f s (%.2f GB/s)\n", size, raw_seconds, raw_seconds > 0 ? (double)size / raw_seconds / 1e9 : 0);
+  (void)printf("lz:   %zd bytes on the wire, ratio %.3f, %.6f s (%.2f GB/s of original data)\n", wire,
+               wire > 0 ? (double)size / (double)wire : 0, lz_seconds, lz_seconds > 0 ? (double)size / lz_seconds / 1e9 : 0);
+
+  free(raw);
+  free(data);
+  check_result(wait(NULL), "wait");
+}
+
+// Program to send a file from child to parent, raw and compressed
+int main(int argc, char* argv[]) {
+  unsigned threads = 1;
+
+  int c;
+  while ((c = getopt(argc, argv, "t:")) != -1) {
+    if (c != 't') {
+      fprintf(stderr, "Usage: ./d_compressed_pipe [-t threads] <file>\n");
+      exit(EXIT_FAILURE);
+    }
+    threads = (unsigned)atoi(optarg);
+  }
+  if (argc - optind != 1) {
+    fprintf(stderr, "Usage: ./d_compressed_pipe [-t threads] <file>\n");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t size;
+  char* data = load_file(argv[optind], &size);
+
+  int fd[2];
+  check_result(pipe(fd), "pipe");
+
+  pid_t pid = fork();
+  check_result(pid, "fork");
+
+  if (pid == 0) {  // Child process
+    check_result(close(fd[READ_END]), "close");
+    child_process(fd[WRITE_END], data, size, threads);
+    check_result(close(fd[WRITE_END]), "close");
+  } else {  // Parent process
+    check_result(close(fd[WRITE_END]), "close");
+    parent_process(fd[READ_END], data, size, threads);
+    check_result(close(fd[READ_END]), "close");
+  }
+
+  free(data);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include <stdio.h>      // for perror(), printf()
+#include <stdlib.h>     // for exit(), malloc()
+#include <string.h>     // for memset()
+#include <sys/types.h>  // for pid_t
+#include <sys/wait.h>   // for wait()
+#include <time.h>       // for clock_gettime()
+#include <unistd.h>     // for fork(), getopt()
+
+#include "../common/fast_format.h"
+#include "ipc_utils.h"
+#include "transport.h"
+
+//--------------------------------------------------------------------------------
+// The number-passing program of a_unnamed_pipes.c, b_named_pipes.c and c_shared_memory.c, written once
+// against transport.h so the IPC mechanism is picked with a flag.
+//
+// Usage:
+//   ./e_transport -T shm                          (enter numbers in the child, the parent prints them)
+//   ./e_transport -T unix -b -n 100000 -s 65536   (benchmark: 100000 frames of 64 KiB)
+//   ./e_transport -T shm -b -z                    (benchmark, receiving with borrow()/release())
+//   ./e_transport -T memfd -b -z -s 4194304        (benchmark: sealed memfds, mapped by the receiver)
+//
+// Notes:
+// - Every transport is benchmarked by the same code, so the differences are the mechanisms themselves
+// - shm frames are limited to half its ring (TRANSPORT_SHM_MAX_FRAME); -s above that is refused up front
+//--------------------------------------------------------------------------------
+
+const int BUFFER_SIZE = 1024;
+
+typedef struct {
+  size_t frames;
+  size_t frame_size;
+  int borrow;  // receive in place instead of copying out
+} BenchOptions;
+
+void usage() {
+  fprintf(stderr, "Usage: ./e_transport [-T transport] [-b [-n frames] [-s frame_size] [-z]]\nTransports:");
+  for (size_t i = 0; i < TRANSPORT_COUNT; i++) {
+    fprintf(stderr, " %s", TRANSPORTS[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void child_process(Transport* t) {
+  int num;
+  (void)printf("Enter number of elements: ");
+  if (scanf("%d", &num) != 1) {
+    fprintf(stderr, "Invalid input.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (num <= 0 || num > (int)(BUFFER_SIZE / sizeof(int))) {
+    fprintf(stderr, "0 < num < %d\n", (int)(BUFFER_SIZE / sizeof(int) + 1));
+    exit(EXIT_FAILURE);
+  }
+
+  int arr[BUFFER_SIZE / sizeof(int)];
+  (void)printf("Enter %d numbers: ", num);
+  for (int i = 0; i < num; i++) {
+    if (scanf("%d", &arr[i]) != 1) {
+      fprintf(stderr, "Invalid input.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // One frame carries the whole array; its length says how many numbers there are
+  check_result(transport_send_frame(t, arr, num * sizeof(int)), "transport_send_frame");
+}
+
+void parent_process(Transport* t) {
+  int arr[BUFFER_SIZE / sizeof(int)];
+  ssize_t len = transport_recv_frame(t, arr, sizeof(arr));
+  check_result(len, "transport_recv_frame");
+  if (len <= 0) {
+    fprintf(stderr, "No numbers received\n");
+    exit(EXIT_FAILURE);
+  }
+
+  static FmtBuffer out;
+  for (size_t i = 0; i < (size_t)len / sizeof(int); i++) {
+    fmt_int(&out, arr[i]);
+    fmt_char(&out, ' ');
+  }
+  fmt_char(&out, '\n');
+  check_result(fmt_flush(&out, STDOUT_FILENO), "write");
+}
+
+void bench_sender(Transport* t, const BenchOptions* bench) {
+  char* frame = malloc(bench->frame_size + 1);
+  if (frame == NULL) {
+    handle_error("malloc");
+  }
+  memset(frame, 'x', bench->frame_size);
+  for (size_t i = 0; i < bench->frames; i++) {
+    check_result(transport_send_frame(t, frame, bench->frame_size), "transport_send_frame");
+  }
+  free(frame);
+}
+
+void bench_receiver(Transport* t, const BenchOptions* bench) {
+  char* frame = malloc(bench->frame_size + 1);
+  if (frame == NULL) {
+    handle_error("malloc");
+  }
+
+  size_t frames = 0, bytes = 0;
+  double start  = now_seconds();
+  while (1) {
+    size_t len;
+    if (bench->borrow) {
+      const char* data = transport_borrow(t, &len);
+      if (data == NULL) {
+        check_result(errno == 0 ? 0 : -1, "transport_borrow");
+        break;
+      }
+      frame[0] ^= data[len / 2];  // touch the payload, as a real consumer would
+      check_result(transport_release(t), "transport_release");
+    } else {
+      ssize_t got = transport_recv_frame(t, frame, bench->frame_size);
+      check_result(got, "transport_recv_frame");
+      if (got == 0) {
+        break;
+      }
+      len = got == TRANSPORT_EMPTY_FRAME ? 0 : (size_t)got;
+    }
+    frames++;
+    bytes += len;
+  }
+  double seconds = now_seconds() - start;
+
+  if (frames != bench->frames) {
+    fprintf(stderr, "Received %zu of %zu frames\n", frames, bench->frames);
+    exit(EXIT_FAILURE);
+  }
+  (void)printf("%s%s: %zu frames of %zu bytes in %.6f s: %.0f frames/s, %.1f MiB/s\n", t->ops->name, bench->borrow ? " (borrow)" : "",
+               frames, bench->frame_size, seconds, (double)frames / seconds, (double)bytes / (1024.0 * 1024.0) / seconds);
+  free(frame);
+}
+
+// Program to send numbers (or benchmark frames) from child to parent over a chosen transport
+int main(int argc, char* argv[]) {
+  const TransportOps* ops = transport_find("pipe");
+  BenchOptions bench      = {100000, 4096, 0};
+  int benchmark           = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "T:bn:s:z")) != -1) {
+    switch (c) {
+      case 'T':
+        if ((ops = transport_find(optarg)) == NULL) {
+          usage();
+        }
+        break;
+      case 'b':
+        benchmark = 1;
+        break;
+      case 'n':
+        bench.frames = strtoull(optarg, NULL, 10);
+        break;
+      case 's':
+        bench.frame_size = strtoull(optarg, NULL, 10);
+        break;
+      case 'z':
+        bench.borrow = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  Transport t;
+  check_result(transport_open(&t, ops, NULL), "transport_open");
+  if (benchmark && bench.frame_size > transport_max_frame(&t)) {
+    fprintf(stderr, "%s carries frames of at most %zu bytes\n", ops->name, transport_max_frame(&t));
+    exit(EXIT_FAILURE);
+  }
+
+  pid_t pid = fork();
+  check_result(pid, "fork");
+
+  if (pid == 0) {  // Child process
+    check_result(transport_attach(&t, TRANSPORT_SENDER), "transport_attach");
+    if (benchmark) {
+      bench_sender(&t, &bench);
+    } else {
+      child_process(&t);
+    }
+    check_result(transport_close(&t), "transport_close");
+  } else {  // Parent process
+    check_result(transport_attach(&t, TRANSPORT_RECEIVER), "transport_attach");
+    if (benchmark) {
+      bench_receiver(&t, &bench);
+    } else {
+      parent_process(&t);
+    }
+    check_result(transport_close(&t), "transport_close");
+    check_result(wait(NULL), "wait");
+  }
+
+  return EXIT_SUCCESS;
+}
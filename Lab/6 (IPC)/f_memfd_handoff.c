@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include <stdint.h>     // for uint64_t
+#include <stdio.h>      // for perror(), printf()
+#include <stdlib.h>     // for exit(), malloc()
+#include <string.h>     // for memset()
+#include <sys/types.h>  // for pid_t
+#include <sys/wait.h>   // for wait()
+#include <time.h>       // for clock_gettime()
+#include <unistd.h>     // for pipe(), read(), write(), close(), getopt()
+
+#include "ipc_utils.h"
+#include "transport.h"
+
+//--------------------------------------------------------------------------------
+// Moving large payloads: pipe copy versus memfd handoff
+// Brief: The child sends count payloads of size bytes twice, first through a pipe as a_unnamed_pipes.c does
+//        (a length, then write_all() of the bytes) and then as sealed memfds over the "memfd" transport.
+//        The parent reads or maps each payload, sums it as a consumer would, and reports seconds per GiB.
+//
+// Usage:
+//   ./f_memfd_handoff [-s size] [-n count]   (default: 16 payloads of 64 MiB)
+//
+// Notes:
+// - A pipe copies every byte twice, into the pipe buffer with write() and out of it with read(), in chunks
+//   of the pipe capacity, waking the other side for each chunk
+// - The memfd handoff copies nothing: the sender writes into pages it then seals, the receiver maps the
+//   same pages. What remains is per payload (memfd_create, sealing, one sendmsg/recvmsg, mmap/munmap) plus
+//   the page faults on first touch, so the cost per GiB falls as payloads get bigger
+// - Both timings include filling the payload in the sender and summing it in the receiver
+// - A sealed memfd cannot be written again, so every payload needs fresh pages which the kernel has to
+//   allocate and zero; the pipe path reuses one buffer. With shmem huge pages off and one CPU (the lab VM)
+//   that makes the handoff about 1.3 s/GiB against 0.5-1.0 s/GiB for the pipe; it wins when the copy is
+//   the bottleneck, i.e. when the payload is produced in place anyway and the two processes run in parallel
+//
+// Search memfd_create(2), unix(7) and pipe(7) for more information
+//--------------------------------------------------------------------------------
+
+const int READ_END  = 0;
+const int WRITE_END = 1;
+
+const double GIB = 1024.0 * 1024.0 * 1024.0;
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Payload i is filled with the byte (i % 255) + 1
+unsigned char payload_byte(size_t i) {
+  return (unsigned char)(i % 255 + 1);
+}
+
+// Sums the payload 8 bytes at a time; reading every byte is what a real consumer pays as well
+uint64_t checksum(const void* data, size_t size) {
+  const unsigned char* p = data;
+  uint64_t sum           = 0;
+  size_t i               = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, p + i, sizeof(word));
+    sum += word;
+  }
+  for (; i < size; i++) {
+    sum += p[i];
+  }
+  return sum;
+}
+
+uint64_t expected_checksum(size_t i, size_t size) {
+  uint64_t b = payload_byte(i);
+  return (uint64_t)(size / sizeof(uint64_t)) * (b * 0x0101010101010101ull) + (uint64_t)(size % sizeof(uint64_t)) * b;
+}
+
+void child_process(int write_fd, Transport* t, size_t size, size_t count) {
+  // Pipe: the payload is built in private memory and copied through the pipe
+  char* buffer = malloc(size + 1);
+  if (buffer == NULL) {
+    handle_error("malloc");
+  }
+  for (size_t i = 0; i < count; i++) {
+    memset(buffer, payload_byte(i), size);
+    uint64_t length = size;
+    check_result(write_all(write_fd, &length, sizeof(length)), "write_all");
+    check_result(write_all(write_fd, buffer, size), "write_all");
+  }
+  free(buffer);
+
+  // memfd: the payload is built in the memfd and the descriptor is handed over
+  for (size_t i = 0; i < count; i++) {
+    MemfdBuffer b;
+    check_result(memfd_buffer_create(&b, size), "memfd_buffer_create");
+    memset(b.data, payload_byte(i), size);
+    check_result(memfd_buffer_send(t, &b, 0, size), "memfd_buffer_send");
+  }
+}
+
+void parent_process(int read_fd, Transport* t, size_t size, size_t count) {
+  char* buffer = malloc(size + 1);
+  if (buffer == NULL) {
+    handle_error("malloc");
+  }
+
+  double start = now_seconds();
+  for (size_t i = 0; i < count; i++) {
+    uint64_t length;
+    check_result(read_all(read_fd, &length, sizeof(length)), "read_all");
+    if (length != size) {
+      fprintf(stderr, "Unexpected payload length %llu\n", (unsigned long long)length);
+      exit(EXIT_FAILURE);
+    }
+    check_result(read_all(read_fd, buffer, size), "read_all");
+    if (checksum(buffer, size) != expected_checksum(i, size)) {
+      fprintf(stderr, "Pipe payload %zu was corrupted\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+  double pipe_seconds = now_seconds() - start;
+  free(buffer);
+
+  start = now_seconds();
+  for (size_t i = 0; i < count; i++) {
+    size_t len;
+    const void* data = transport_borrow(t, &len);
+    if (data == NULL) {
+      if (errno == 0) {
+        fprintf(stderr, "memfd transport closed after %zu payloads\n", i);
+        exit(EXIT_FAILURE);
+      }
+      handle_error("transport_borrow");
+    }
+    if (len != size || checksum(data, len) != expected_checksum(i, size)) {
+      fprintf(stderr, "memfd payload %zu was corrupted\n", i);
+      exit(EXIT_FAILURE);
+    }
+    check_result(transport_release(t), "transport_release");
+  }
+  double memfd_seconds = now_seconds() - start;
+
+  double gib = (double)size * (double)count / GIB;
+  (void)printf("%zu payloads of %zu bytes (%.3f GiB)\n", count, size, gib);
+  (void)printf("pipe:  %.6f s, %.4f s/GiB (%.2f GiB/s)\n", pipe_seconds, pipe_seconds / gib, gib / pipe_seconds);
+  (void)printf("memfd: %.6f s, %.4f s/GiB (%.2f GiB/s)\n", memfd_seconds, memfd_seconds / gib, gib / memfd_seconds);
+  (void)printf("memfd handoff is %.2fx the speed of the pipe copy\n", pipe_seconds / memfd_seconds);
+}
+
+// Program to time a pipe copy against a memfd handoff for the same payloads
+int main(int argc, char* argv[]) {
+  size_t size  = 64 * 1024 * 1024;
+  size_t count = 16;
+
+  int c;
+  while ((c = getopt(argc, argv, "s:n:")) != -1) {
+    switch (c) {
+      case 's':
+        size = strtoull(optarg, NULL, 10);
+        break;
+      case 'n':
+        count = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: ./f_memfd_handoff [-s size] [-n count]\n");
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (size == 0 || count == 0) {
+    fprintf(stderr, "size and count must be positive\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int fd[2];
+  check_result(pipe(fd), "pipe");
+  Transport t;
+  check_result(transport_open(&t, transport_find("memfd"), NULL), "transport_open");
+
+  pid_t pid = fork();
+  check_result(pid, "fork");
+
+  if (pid == 0) {  // Child process
+    check_result(close(fd[READ_END]), "close");
+    check_result(transport_attach(&t, TRANSPORT_SENDER), "transport_attach");
+    child_process(fd[WRITE_END], &t, size, count);
+    check_result(close(fd[WRITE_END]), "close");
+    check_result(transport_close(&t), "transport_close");
+  } else {  // Parent process
+    check_result(close(fd[WRITE_END]), "close");
+    check_result(transport_attach(&t, TRANSPORT_RECEIVER), "transport_attach");
+    parent_process(fd[READ_END], &t, size, count);
+    check_result(close(fd[READ_END]), "close");
+    check_result(transport_close(&t), "transport_close");
+    check_result(wait(NULL), "wait");
+  }
+
+  return EXIT_SUCCESS;
+}
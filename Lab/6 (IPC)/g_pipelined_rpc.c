@@ -0,0 +1,272 @@
+#include <stdint.h>     // for uint32_t, uint64_t
+#include <stdio.h>      // for perror(), printf()
+#include <stdlib.h>     // for exit(), malloc(), qsort()
+#include <string.h>     // for memcpy()
+#include <sys/types.h>  // for pid_t
+#include <sys/wait.h>   // for wait()
+#include <unistd.h>     // for pipe(), fork(), close(), getopt()
+
+#include "../common/histogram.h"
+#include "ipc_utils.h"
+#include "rpc.h"
+
+//--------------------------------------------------------------------------------
+// Pipelined RPC between parent and child
+// Brief: The parent is a client that keeps up to window requests in flight on one pipe; the child is a server
+//        that answers on a second pipe. Each window size from 1 up to the maximum is run for the same number of
+//        calls and reported as calls/s and latency percentiles.
+//
+// Usage:
+//   ./g_pipelined_rpc [-n calls] [-w max_window] [-W max_work] [-j]
+//
+// Notes:
+// - A request asks for the sum of RPC_VALUES integers plus up to max_work rounds of busy work, so service times
+//   differ; the server takes every request already in the pipe as one batch and runs the cheapest first
+//   (shortest job first), so replies come back out of order, and the client matches them by id
+// - Window 1 is the one-shot pattern of a_unnamed_pipes.c repeated: every call pays two wakeups and four syscalls.
+//   Wider windows let both sides move a batch per read()/write() and keep the other process busy meanwhile
+// - Latency is per call from queueing the request to reading the reply, so it grows with the window while the
+//   throughput levels off: past that point requests only wait longer in the pipe
+// - -j adds one JSON line per window with p50/p90/p99/p99.9/max in nanoseconds (../common/histogram.h)
+//--------------------------------------------------------------------------------
+
+#define RPC_OP_SUM 1
+#define RPC_VALUES 8
+#define RPC_MAX_WINDOW 256
+#define RPC_MAX_BATCH 1024
+
+const int READ_END  = 0;
+const int WRITE_END = 1;
+
+typedef struct {
+  uint32_t work;  // rounds of busy work before replying
+  int32_t values[RPC_VALUES];
+} SumRequest;
+
+typedef struct {
+  int64_t sum;
+} SumReply;
+
+typedef struct {
+  uint32_t id;
+  SumRequest request;
+} PendingRequest;
+
+uint32_t mix(uint32_t x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+void fill_request(SumRequest* request, uint32_t id, uint32_t max_work) {
+  request->work = max_work == 0 ? 0 : mix(id + 1) % (max_work + 1);
+  for (int i = 0; i < RPC_VALUES; i++) {
+    request->values[i] = (int32_t)(id * RPC_VALUES + i) - 1000;
+  }
+}
+
+int64_t expected_sum(uint32_t id) {
+  int64_t sum = 0;
+  for (int i = 0; i < RPC_VALUES; i++) {
+    sum += (int32_t)(id * RPC_VALUES + i) - 1000;
+  }
+  return sum;
+}
+
+int compare_work(const void* a, const void* b) {
+  uint32_t x = ((const PendingRequest*)a)->request.work, y = ((const PendingRequest*)b)->request.work;
+  return (x > y) - (x < y);
+}
+
+int64_t serve(const SumRequest* request) {
+  uint32_t x = request->work + 1;
+  for (uint32_t i = 0; i < request->work; i++) {
+    x = mix(x);
+    __asm__ volatile("" : "+r"(x));  // keep the busy work from being optimised away
+  }
+  int64_t sum = 0;
+  for (int i = 0; i < RPC_VALUES; i++) {
+    sum += request->values[i];
+  }
+  return sum;
+}
+
+// Server: answers every batch of waiting requests, cheapest first, with one write()
+void child_process(int request_fd, int reply_fd) {
+  static RpcReader in;
+  static RpcWriter out;
+  static PendingRequest batch[RPC_MAX_BATCH];
+  in.fd  = request_fd;
+  out.fd = reply_fd;
+
+  while (1) {
+    size_t count = 0;
+    do {
+      RpcHeader h;
+      const void* payload;
+      int ret = rpc_reader_next(&in, &h, &payload);
+      check_result(ret, "rpc_reader_next");
+      if (ret == 0) {
+        return;
+      }
+      if (h.op != RPC_OP_SUM || h.len != sizeof(SumRequest)) {
+        fprintf(stderr, "Bad request %u\n", h.id);
+        exit(EXIT_FAILURE);
+      }
+      batch[count].id = h.id;
+      memcpy(&batch[count].request, payload, sizeof(SumRequest));
+      count++;
+    } while (count < RPC_MAX_BATCH && rpc_reader_buffered(&in));
+
+    qsort(batch, count, sizeof(PendingRequest), compare_work);
+    for (size_t i = 0; i < count; i++) {
+      SumReply reply = {serve(&batch[i].request)};
+      check_result(rpc_writer_add(&out, batch[i].id, RPC_OP_SUM, &reply, sizeof(reply)), "rpc_writer_add");
+    }
+    check_result(rpc_writer_flush(&out), "rpc_writer_flush");
+  }
+}
+
+// Client: one run of calls requests with at most window in flight
+void run_window(RpcReader* in, RpcWriter* out, uint32_t* next_id, uint32_t calls, unsigned window, uint32_t max_work,
+                uint64_t* sent_ns, unsigned char* done, Histogram* latency, int json) {
+  uint32_t first     = *next_id, end = first + calls;
+  uint32_t sent      = first, lowest = first;  // lowest id without a reply
+  uint32_t completed = 0;
+  uint64_t reordered = 0;
+  hist_reset(latency);
+
+  uint64_t start = hist_now_ns();
+  while (lowest < end) {
+    while (sent < end && sent - first - completed < window) {
+      SumRequest request;
+      fill_request(&request, sent, max_work);
+      sent_ns[sent - first] = hist_now_ns();
+      check_result(rpc_writer_add(out, sent, RPC_OP_SUM, &request, sizeof(request)), "rpc_writer_add");
+      sent++;
+    }
+    check_result(rpc_writer_flush(out), "rpc_writer_flush");
+
+    // Take one reply, blocking, then whatever else has already arrived, before refilling the window
+    do {
+      RpcHeader h;
+      const void* payload;
+      int ret = rpc_reader_next(in, &h, &payload);
+      check_result(ret, "rpc_reader_next");
+      if (ret == 0 || h.id < first || h.id >= sent || done[h.id - first] || h.len != sizeof(SumReply)) {
+        fprintf(stderr, "Unexpected reply\n");
+        exit(EXIT_FAILURE);
+      }
+      SumReply reply;
+      memcpy(&reply, payload, sizeof(reply));
+      if (reply.sum != expected_sum(h.id)) {
+        fprintf(stderr, "Wrong result for request %u\n", h.id);
+        exit(EXIT_FAILURE);
+      }
+      hist_record(latency, hist_now_ns() - sent_ns[h.id - first]);
+      done[h.id - first] = 1;
+      completed++;
+      if (h.id != lowest) {
+        reordered++;
+      }
+      while (lowest < end && done[lowest - first]) {
+        lowest++;
+      }
+    } while (rpc_reader_buffered(in));
+  }
+  double seconds = (double)(hist_now_ns() - start) / 1e9;
+  *next_id       = end;
+
+  (void)printf("%6u %12.0f %10.1f %10.1f %10.1f %10.1f %9.1f%%\n", window, calls / seconds, hist_percentile(latency, 50) / 1e3,
+               hist_percentile(latency, 99) / 1e3, hist_percentile(latency, 99.9) / 1e3, hist_max(latency) / 1e3,
+               100.0 * (double)reordered / calls);
+  if (json) {
+    char name[32];
+    snprintf(name, sizeof(name), "rpc_window_%u_ns", window);
+    hist_print_json(stdout, name, latency);
+  }
+}
+
+void parent_process(int request_fd, int reply_fd, uint32_t calls, unsigned max_window, uint32_t max_work, int json) {
+  static RpcReader in;
+  static RpcWriter out;
+  in.fd  = reply_fd;
+  out.fd = request_fd;
+
+  uint64_t* sent_ns   = malloc(calls * sizeof(uint64_t) + 1);
+  unsigned char* done = malloc(calls + 1);
+  Histogram* latency  = hist_create();
+  if (sent_ns == NULL || done == NULL || latency == NULL) {
+    handle_error("malloc");
+  }
+
+  (void)printf("%u calls per window, up to %u rounds of work per call\n", calls, max_work);
+  (void)printf("%6s %12s %10s %10s %10s %10s %10s\n", "window", "calls/s", "p50 us", "p99 us", "p99.9 us", "max us", "reordered");
+  uint32_t next_id = 0;
+  for (unsigned window = 1; window <= max_window; window *= 2) {
+    memset(done, 0, calls);
+    run_window(&in, &out, &next_id, calls, window, max_work, sent_ns, done, latency, json);
+  }
+
+  free(sent_ns);
+  free(done);
+  free(latency);
+}
+
+// Program to time pipelined request/response calls from parent to child over two pipes
+int main(int argc, char* argv[]) {
+  uint32_t calls      = 100000;
+  unsigned max_window = RPC_MAX_WINDOW;
+  uint32_t max_work   = 200;
+  int json            = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "n:w:W:j")) != -1) {
+    switch (c) {
+      case 'n':
+        calls = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        max_window = (unsigned)atoi(optarg);
+        break;
+      case 'W':
+        max_work = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'j':
+        json = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: ./g_pipelined_rpc [-n calls] [-w max_window] [-W max_work] [-j]\n");
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (calls == 0 || max_window == 0 || max_window > RPC_MAX_WINDOW) {
+    fprintf(stderr, "calls must be positive and 1 <= max_window <= %d\n", RPC_MAX_WINDOW);
+    exit(EXIT_FAILURE);
+  }
+
+  int requests[2], replies[2];
+  check_result(pipe(requests), "pipe");
+  check_result(pipe(replies), "pipe");
+
+  pid_t pid = fork();
+  check_result(pid, "fork");
+
+  if (pid == 0) {  // Child process: server
+    check_result(close(requests[WRITE_END]), "close");
+    check_result(close(replies[READ_END]), "close");
+    child_process(requests[READ_END], replies[WRITE_END]);
+    check_result(close(requests[READ_END]), "close");
+    check_result(close(replies[WRITE_END]), "close");
+  } else {  // Parent process: client
+    check_result(close(requests[READ_END]), "close");
+    check_result(close(replies[WRITE_END]), "close");
+    parent_process(requests[WRITE_END], replies[READ_END], calls, max_window, max_work, json);
+    check_result(close(requests[WRITE_END]), "close");  // the server sees EOF and exits
+    check_result(close(replies[READ_END]), "close");
+    check_result(wait(NULL), "wait");
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+#include <stdint.h>     // for uint32_t, uint64_t
+#include <stdio.h>      // for perror(), printf()
+#include <stdlib.h>     // for exit(), malloc()
+#include <string.h>     // for memcmp()
+#include <sys/types.h>  // for pid_t
+#include <sys/wait.h>   // for wait()
+#include <unistd.h>     // for pipe(), fork(), close(), read(), write(), getopt()
+
+#include "ipc_utils.h"
+#include "pipe_consumer.h"
+
+//--------------------------------------------------------------------------------
+// Double-buffered pipe consumer
+// Brief: The child sends the same array of count integers twice, in the a_unnamed_pipes.c protocol (the count,
+//        then the values). The parent receives the first copy the way parent_process() does, all of it and then
+//        the reducer, and the second copy with consume_pipelined(), which reduces each buffer while the next one
+//        is still arriving. Both results must match; the timings show what the overlap bought.
+//
+// Usage:
+//   ./h_double_buffer [-n count] [-b buffers] [-k buffer_KiB] [-r sum|histogram|sort-run]
+//
+// Notes:
+// - The child generates the values as it goes (xorshift), so the pipe delivers at the producer's pace rather
+//   than all at once, as it would from a real upstream process
+// - tail is what a caller waits for after the last byte: the whole reduction serially, one buffer pipelined
+// - Overlap can save at most the shorter of receive and compute. With sum or histogram that is the whole
+//   reduction, and the serial run also pays for faulting in one array the size of the payload, while the
+//   pipelined buffers stay in cache. sort-run costs far more than the transfer, so its wall time barely moves,
+//   but the result is still ready one buffer after the last byte
+// - More than two buffers only help when the producer or the reducer is bursty
+//--------------------------------------------------------------------------------
+
+#define PRODUCER_CHUNK 16384
+
+const int READ_END  = 0;
+const int WRITE_END = 1;
+
+void send_all(int fd, const void* buffer, size_t bytes) {
+  if (write_all(fd, buffer, bytes) == -1) {
+    handle_error("write");
+  }
+}
+
+void read_count(int fd, uint64_t* count) {
+  if (read_all(fd, count, sizeof(*count)) == -1) {
+    handle_error("read");
+  }
+}
+
+// Sends the count, then count pseudo-random integers generated a chunk at a time
+void send_array(int fd, uint64_t count) {
+  static int chunk[PRODUCER_CHUNK];
+  send_all(fd, &count, sizeof(count));
+
+  uint32_t x = 2463534242u;
+  for (uint64_t sent = 0; sent < count;) {
+    size_t n = count - sent < PRODUCER_CHUNK ? count - sent : PRODUCER_CHUNK;
+    for (size_t i = 0; i < n; i++) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      chunk[i] = (int)x;
+    }
+    send_all(fd, chunk, n * sizeof(int));
+    sent += n;
+  }
+}
+
+void child_process(int write_fd, uint64_t count) {
+  send_array(write_fd, count);  // for consume_serial()
+  send_array(write_fd, count);  // for consume_pipelined()
+}
+
+void print_stats(const char* label, const ConsumeStats* stats) {
+  (void)printf("%-10s %10.1f %10.1f %10.1f %10.1f %9.1f%%\n", label, stats->wall * 1e3, stats->receive * 1e3,
+               stats->compute * 1e3, stats->tail * 1e3, consume_overlap(stats) * 100);
+}
+
+void parent_process(int read_fd, unsigned buffers, size_t buffer_bytes, const Reducer* reducer) {
+  uint64_t count;
+  ReduceResult serial_result, pipelined_result;
+  ConsumeStats serial, pipelined;
+
+  read_count(read_fd, &count);
+  check_result(consume_serial(read_fd, count * sizeof(int), buffer_bytes, reducer, &serial_result, &serial), "consume_serial");
+  read_count(read_fd, &count);
+  check_result(consume_pipelined(read_fd, count * sizeof(int), buffers, buffer_bytes, reducer, &pipelined_result, &pipelined),
+               "consume_pipelined");
+
+  (void)printf("%llu integers, reducer %s, %u buffers of %zu KiB\n", (unsigned long long)count, reducer->name, buffers,
+               buffer_bytes / 1024);
+  (void)printf("%-10s %10s %10s %10s %10s %10s\n", "mode", "wall ms", "receive ms", "compute ms", "tail ms", "overlap");
+  print_stats("serial", &serial);
+  print_stats("pipelined", &pipelined);
+  (void)printf("speedup %.2fx, tail %.1fx shorter, results %s\n", serial.wall / pipelined.wall,
+               pipelined.tail > 0 ? serial.tail / pipelined.tail : 0,
+               memcmp(&serial_result, &pipelined_result, sizeof(ReduceResult)) == 0 ? "match" : "DIFFER");
+}
+
+// Program to compare receive-then-compute with a double-buffered consumer on an unnamed pipe
+int main(int argc, char* argv[]) {
+  uint64_t count      = 16 * 1024 * 1024;
+  unsigned buffers    = 2;
+  size_t buffer_kib   = 256;
+  const char* reducer = "sort-run";
+
+  int c;
+  while ((c = getopt(argc, argv, "n:b:k:r:")) != -1) {
+    switch (c) {
+      case 'n':
+        count = strtoull(optarg, NULL, 10);
+        break;
+      case 'b':
+        buffers = (unsigned)atoi(optarg);
+        break;
+      case 'k':
+        buffer_kib = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        reducer = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: ./h_double_buffer [-n count] [-b buffers] [-k buffer_KiB] [-r sum|histogram|sort-run]\n");
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (find_reducer(reducer) == NULL) {
+    fprintf(stderr, "Unknown reducer %s (sum, histogram, sort-run)\n", reducer);
+    exit(EXIT_FAILURE);
+  }
+  if (count == 0 || buffer_kib == 0 || buffers < 2 || buffers > CONSUME_MAX_BUFFERS) {
+    fprintf(stderr, "count and buffer_KiB must be positive and 2 <= buffers <= %d\n", CONSUME_MAX_BUFFERS);
+    exit(EXIT_FAILURE);
+  }
+
+  int pipe_fd[2];
+  check_result(pipe(pipe_fd), "pipe");
+
+  pid_t pid = fork();
+  check_result(pid, "fork");
+
+  if (pid == 0) {  // Child process: producer
+    check_result(close(pipe_fd[READ_END]), "close");
+    child_process(pipe_fd[WRITE_END], count);
+    check_result(close(pipe_fd[WRITE_END]), "close");
+  } else {  // Parent process: consumer
+    check_result(close(pipe_fd[WRITE_END]), "close");
+    parent_process(pipe_fd[READ_END], buffers, buffer_kib * 1024, find_reducer(reducer));
+    check_result(close(pipe_fd[READ_END]), "close");
+    check_result(wait(NULL), "wait");
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,537 @@
+#define _GNU_SOURCE
+#include <errno.h>      // for errno
+#include <fcntl.h>      // for open()
+#include <limits.h>     // for PIPE_BUF
+#include <poll.h>       // for ppoll()
+#include <signal.h>     // for sigaction(), sigprocmask()
+#include <stdint.h>     // for uint64_t
+#include <stdio.h>      // for perror(), printf(), getline()
+#include <stdlib.h>     // for exit(), malloc()
+#include <string.h>     // for memchr(), memrchr(), memcpy()
+#include <sys/stat.h>   // for mkfifo(), fstat()
+#include <sys/types.h>  // for pid_t
+#include <sys/uio.h>    // for writev()
+#include <sys/wait.h>   // for waitpid()
+#include <time.h>       // for clock_gettime()
+#include <unistd.h>     // for read(), write(), fdatasync(), close(), getopt()
+
+#include "ipc_utils.h"
+
+//--------------------------------------------------------------------------------
+// ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+// Brief: Writes iovcnt buffers, in order, with one system call (a gather write)
+//
+// Parameters:
+//   iov    - Array of { iov_base, iov_len } describing the buffers
+//   iovcnt - Number of entries, at most IOV_MAX (1024 on Linux)
+//
+// Returns:
+//   Bytes written on success (may be fewer than the total, like write()); -1 on failure, setting errno
+//
+// Search writev(2) for more information
+//--------------------------------------------------------------------------------
+// int fdatasync(int fd);
+// Brief: Waits until the file's data (and the metadata needed to read it back, such as its size) is on the device
+//
+// Returns:
+//   0 on success; -1 on failure, setting errno (EIO: the data may be lost)
+//
+// Notes:
+// - Costs a device flush: milliseconds on a disk, so it is worth doing once per batch, never once per line
+//
+// Search fdatasync(2) for more information
+//--------------------------------------------------------------------------------
+// Log aggregation daemon on a named pipe
+// Brief: Many processes write lines to one FIFO (as the child does in b_named_pipes.c); the daemon reads them in
+//        large chunks, holds up to LOG_MAX_CHUNKS * LOG_CHUNK bytes, and appends them to the log file with one
+//        writev() per batch, an fdatasync() every sync_ms and a rotation whenever the file would pass rotate_MB.
+//
+// Usage:
+//   ./i_log_daemon [-f fifo] [-o log] [-r rotate_MB] [-k keep] [-S sync_ms]          daemon, until SIGINT/SIGTERM
+//   echo "hello" > /tmp/log_daemon.fifo                                              any writer
+//   ./i_log_daemon -b [-w writers] [-n lines] [-d dir]                                benchmark
+//
+// Notes:
+// - A write() of at most PIPE_BUF (4096) bytes to a pipe is atomic, so lines from different writers never
+//   interleave as long as each line is one write(); a read() may still end in the middle of one, so only
+//   complete lines are written out and the rest is carried to the next batch
+// - Rotation renames log -> log.1 -> ... -> log.keep (the oldest is dropped) and starts a new file. Writers
+//   never notice, unlike with O_APPEND, where every writer would have to reopen the file
+// - A batch is also written after flush_ms without new data, so a quiet log is at most that far behind
+// - The daemon opens the FIFO O_RDWR so it never sees EOF between writers (Linux behaviour, POSIX leaves it
+//   undefined); in the benchmark it opens it read-only and stops when the last writer closes
+// - -b runs the same writers twice: through the daemon, and each opening the log with O_APPEND and writing
+//   every line itself, then checks that every line arrived once and in each writer's order (lines in files
+//   dropped by rotation are counted instead: raise -k to keep them all)
+//--------------------------------------------------------------------------------
+
+#define LOG_CHUNK (64 * 1024)
+#define LOG_MAX_CHUNKS 16  // 1 MiB per writev()
+#define LOG_LINE_MAX 256   // benchmark lines, well under PIPE_BUF
+#define LOG_MAX_WRITERS 1024
+#define LOG_PATH_MAX 4096
+
+_Static_assert(LOG_LINE_MAX <= PIPE_BUF, "benchmark lines must be atomic pipe writes");
+
+typedef struct {
+  const char* path;
+  int fd;
+  off_t size;  // bytes in the current file
+  off_t rotate_bytes;
+  int keep;  // rotated files kept next to the live one
+  char* chunks[LOG_MAX_CHUNKS];
+  size_t lengths[LOG_MAX_CHUNKS];
+  int current;  // chunk being filled
+  size_t pending;
+  int dirty;  // written since the last fdatasync()
+  double last_sync;
+  uint64_t lines;
+  uint64_t bytes;
+  uint64_t writes;  // writev() calls
+  uint64_t syncs;
+  uint64_t rotations;
+} LogSink;
+
+static volatile sig_atomic_t stop = 0;
+
+void on_stop(int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void open_log(LogSink* sink) {
+  sink->fd = open(sink->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  check_result(sink->fd, "open (log)");
+  struct stat st;
+  check_result(fstat(sink->fd, &st), "fstat");
+  sink->size = st.st_size;
+}
+
+void sync_log(LogSink* sink) {
+  if (sink->dirty) {
+    check_result(fdatasync(sink->fd), "fdatasync");
+    sink->dirty = 0;
+    sink->syncs++;
+  }
+  sink->last_sync = now_seconds();
+}
+
+// log.(keep-1) -> log.keep, ..., log -> log.1, then a new empty log
+void rotate_log(LogSink* sink) {
+  sync_log(sink);
+  check_result(close(sink->fd), "close");
+  char from[LOG_PATH_MAX + 16], to[LOG_PATH_MAX + 16];
+  for (int i = sink->keep - 1; i >= 1; i--) {
+    snprintf(from, sizeof(from), "%s.%d", sink->path, i);
+    snprintf(to, sizeof(to), "%s.%d", sink->path, i + 1);
+    if (rename(from, to) == -1 && errno != ENOENT) {
+      handle_error("rename");
+    }
+  }
+  snprintf(to, sizeof(to), "%s.1", sink->path);
+  check_result(rename(sink->path, to), "rename");
+  open_log(sink);
+  sink->rotations++;
+}
+
+void writev_all(int fd, struct iovec* iov, int count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    check_result(written, "writev");
+    while (count > 0 && (size_t)written >= iov->iov_len) {  // skip what is done, resume inside a partial buffer
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+}
+
+// Writes every complete line held (everything if all is set) with one writev(); the partial last line stays
+void flush_log(LogSink* sink, int all) {
+  if (sink->pending == 0) {
+    return;
+  }
+  int last    = sink->current < LOG_MAX_CHUNKS && sink->lengths[sink->current] > 0 ? sink->current : sink->current - 1;
+  size_t keep = 0;  // bytes after the last newline
+  size_t cut  = sink->lengths[last];
+  if (!all) {
+    int c = last;
+    const char* newline = NULL;
+    for (; c >= 0 && (newline = memrchr(sink->chunks[c], '\n', sink->lengths[c])) == NULL; c--) {
+      keep += sink->lengths[c];
+    }
+    if (newline == NULL) {
+      if (sink->current < LOG_MAX_CHUNKS) {
+        return;  // not one complete line yet, wait for the rest
+      }
+      keep = 0;  // a full buffer without a newline: write it as is, the line gets split
+    } else {
+      keep += sink->lengths[c] - (size_t)(newline + 1 - sink->chunks[c]);
+      last = c;
+      cut  = (size_t)(newline + 1 - sink->chunks[c]);
+    }
+    if (keep >= LOG_CHUNK) {  // not a line, just junk without newlines: write it all
+      last = sink->current < LOG_MAX_CHUNKS && sink->lengths[sink->current] > 0 ? sink->current : sink->current - 1;
+      cut  = sink->lengths[last];
+      keep = 0;
+    }
+  }
+
+  struct iovec iov[LOG_MAX_CHUNKS];
+  size_t bytes = 0;
+  for (int c = 0; c <= last; c++) {
+    iov[c].iov_base = sink->chunks[c];
+    iov[c].iov_len  = c == last ? cut : sink->lengths[c];
+    bytes += iov[c].iov_len;
+  }
+  if (sink->size > 0 && sink->size + (off_t)bytes > sink->rotate_bytes) {
+    rotate_log(sink);
+  }
+  writev_all(sink->fd, iov, last + 1);
+  sink->size += bytes;
+  sink->bytes += bytes;
+  sink->writes++;
+  sink->dirty = 1;
+
+  // The partial line moves to the front of chunk 0 (it is under LOG_CHUNK, so it fits)
+  static char carry[LOG_CHUNK];
+  size_t carried = 0;
+  for (int c = last; c < LOG_MAX_CHUNKS && c <= sink->current && carried < keep; c++) {
+    size_t from = c == last ? cut : 0;
+    memcpy(carry + carried, sink->chunks[c] + from, sink->lengths[c] - from);
+    carried += sink->lengths[c] - from;
+  }
+  for (int c = 0; c < LOG_MAX_CHUNKS; c++) {
+    sink->lengths[c] = 0;
+  }
+  memcpy(sink->chunks[0], carry, carried);
+  sink->lengths[0] = carried;
+  sink->current    = 0;
+  sink->pending    = carried;
+}
+
+void run_daemon(int fifo_fd, LogSink* sink, int sync_ms, int flush_ms) {
+  for (int c = 0; c < LOG_MAX_CHUNKS; c++) {
+    sink->chunks[c] = malloc(LOG_CHUNK);
+    if (sink->chunks[c] == NULL) {
+      handle_error("malloc");
+    }
+  }
+  open_log(sink);
+  sink->last_sync = now_seconds();
+
+  // SIGINT/SIGTERM are only let through inside ppoll(): one arriving just after the stop check stays pending
+  // until ppoll() unblocks it and returns EINTR, instead of being handled before a wait that never ends
+  sigset_t stop_signals, waiting;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  check_result(sigprocmask(SIG_BLOCK, &stop_signals, &waiting), "sigprocmask");
+
+  struct pollfd pfd = {.fd = fifo_fd, .events = POLLIN};
+  while (!stop) {
+    int timeout_ms          = sink->pending > 0 ? flush_ms : sink->dirty ? sync_ms : -1;
+    struct timespec timeout = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000};
+    int ready               = ppoll(&pfd, 1, timeout_ms < 0 ? NULL : &timeout, &waiting);
+    if (ready == -1 && errno == EINTR) {
+      continue;
+    }
+    check_result(ready, "poll");
+    if (ready == 0) {  // quiet: write what is held and sync
+      flush_log(sink, 0);
+      sync_log(sink);
+      continue;
+    }
+
+    // A read of 0 bytes would look like end-of-file, so make room first
+    if (sink->lengths[sink->current] == LOG_CHUNK && ++sink->current == LOG_MAX_CHUNKS) {
+      flush_log(sink, 0);
+    }
+    char* tail  = sink->chunks[sink->current] + sink->lengths[sink->current];
+    ssize_t got = read(fifo_fd, tail, LOG_CHUNK - sink->lengths[sink->current]);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    check_result(got, "read");
+    if (got == 0) {  // every writer closed (benchmark mode)
+      break;
+    }
+    for (const char* p = tail; (p = memchr(p, '\n', tail + got - p)) != NULL; p++) {
+      sink->lines++;
+    }
+    sink->lengths[sink->current] += got;
+    sink->pending += got;
+
+    if (sink->lengths[sink->current] == LOG_CHUNK && ++sink->current == LOG_MAX_CHUNKS) {
+      flush_log(sink, 0);
+    }
+    if (sink->dirty && now_seconds() - sink->last_sync >= sync_ms / 1000.0) {
+      sync_log(sink);
+    }
+  }
+
+  check_result(sigprocmask(SIG_SETMASK, &waiting, NULL), "sigprocmask");
+
+  flush_log(sink, 1);
+  sync_log(sink);
+  check_result(close(sink->fd), "close");
+  for (int c = 0; c < LOG_MAX_CHUNKS; c++) {
+    free(sink->chunks[c]);
+  }
+}
+
+void print_sink(const LogSink* sink) {
+  (void)printf("daemon: %llu lines, %.1f MB in %llu writev() (%.0f KiB each), %llu fdatasync(), %llu rotations\n",
+               (unsigned long long)sink->lines, (double)sink->bytes / 1e6, (unsigned long long)sink->writes,
+               sink->writes > 0 ? (double)sink->bytes / (double)sink->writes / 1024 : 0, (unsigned long long)sink->syncs,
+               (unsigned long long)sink->rotations);
+}
+
+// One write() per line, as a logger does
+void write_lines(int fd, int writer, unsigned lines) {
+  char line[LOG_LINE_MAX];
+  pid_t pid = getpid();
+  for (unsigned seq = 0; seq < lines; seq++) {
+    int len = snprintf(line, sizeof(line), "writer %04d seq %010u pid %d: request served in 42 us, status 200\n", writer,
+                       seq, (int)pid);
+    if (write(fd, line, (size_t)len) != len) {  // at most PIPE_BUF, so never partial on a pipe
+      handle_error("write");
+    }
+  }
+}
+
+// Starts writers processes that each write lines; fd < 0 means each opens path with O_APPEND itself
+void run_writers(int writers, unsigned lines, int fd, const char* path) {
+  pid_t pids[LOG_MAX_WRITERS];
+  for (int w = 0; w < writers; w++) {
+    pid_t pid = pids[w] = fork();
+    check_result(pid, "fork");
+    if (pid == 0) {
+      if (fd < 0) {
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        check_result(fd, "open (append)");
+      }
+      write_lines(fd, w, lines);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  for (int w = 0; w < writers; w++) {
+    int status;
+    check_result(waitpid(pids[w], &status, 0), "waitpid");  // not wait(): the daemon is a child too
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "A writer failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// Reads path.keep .. path.1, path (oldest first): every writer's kept lines must appear once and in order.
+// Rotation may have dropped the oldest files, so a writer's first kept line sets where its sequence starts, and
+// *dropped counts the lines before it. Every writer must end on its last line, unless all its lines were dropped
+// while other writers lost lines to rotation as well
+int verify_logs(const char* path, int keep, int writers, unsigned lines, uint64_t* dropped) {
+  unsigned* next = calloc((size_t)writers, sizeof(unsigned));
+  char* seen     = calloc((size_t)writers, 1);
+  if (next == NULL || seen == NULL) {
+    handle_error("calloc");
+  }
+  char name[LOG_PATH_MAX + 16];
+  char* line = NULL;
+  size_t cap = 0;
+  int ok     = 1;
+  *dropped   = 0;
+  for (int i = keep; i >= 0 && ok; i--) {
+    if (i > 0) {
+      snprintf(name, sizeof(name), "%s.%d", path, i);
+    } else {
+      snprintf(name, sizeof(name), "%s", path);
+    }
+    FILE* file = fopen(name, "r");
+    if (file == NULL) {
+      continue;
+    }
+    while (ok && getline(&line, &cap, file) != -1) {
+      int writer;
+      unsigned seq;
+      ok = sscanf(line, "writer %d seq %u", &writer, &seq) == 2 && writer >= 0 && writer < writers;
+      if (ok && !seen[writer]) {
+        seen[writer] = 1;
+        next[writer] = seq;
+        *dropped += seq;
+      }
+      ok = ok && seq == next[writer]++;
+    }
+    fclose(file);
+  }
+  uint64_t partly_dropped = *dropped;
+  for (int w = 0; w < writers && ok; w++) {
+    ok = seen[w] ? next[w] == lines : partly_dropped > 0;
+    *dropped += seen[w] ? 0 : lines;
+  }
+  free(line);
+  free(seen);
+  free(next);
+  return ok;
+}
+
+void remove_logs(const char* path, int keep) {
+  char name[LOG_PATH_MAX + 16];
+  (void)unlink(path);
+  for (int i = 1; i <= keep; i++) {
+    snprintf(name, sizeof(name), "%s.%d", path, i);
+    (void)unlink(name);
+  }
+}
+
+void print_result(const char* mode, int writers, unsigned lines, double seconds, int ok, uint64_t dropped) {
+  double total = (double)writers * lines;
+  (void)printf("%-12s %8d %10u %10.3f %12.0f %s", mode, writers, lines, seconds, total / seconds, ok ? "ok" : "LINES LOST OR REORDERED");
+  if (ok && dropped > 0) {
+    (void)printf(" (oldest %llu lines rotated out)", (unsigned long long)dropped);
+  }
+  (void)printf("\n");
+}
+
+void benchmark(const char* dir, int writers, unsigned lines, off_t rotate_bytes, int keep, int sync_ms, int flush_ms) {
+  char fifo[LOG_PATH_MAX], daemon_log[LOG_PATH_MAX], append_log[LOG_PATH_MAX];
+  snprintf(fifo, sizeof(fifo), "%s/log_daemon.fifo", dir);
+  snprintf(daemon_log, sizeof(daemon_log), "%s/log_daemon.log", dir);
+  snprintf(append_log, sizeof(append_log), "%s/log_append.log", dir);
+  remove_logs(daemon_log, keep);
+  remove_logs(append_log, 0);
+  (void)unlink(fifo);
+  check_result(mkfifo(fifo, 0666), "mkfifo");
+
+  // Through the daemon: the writers share one write end, so the FIFO reports EOF once the last one exits
+  double start = now_seconds();
+  pid_t daemon = fork();
+  check_result(daemon, "fork");
+  if (daemon == 0) {
+    int fifo_fd = open(fifo, O_RDONLY);
+    check_result(fifo_fd, "open (fifo)");
+    LogSink sink = {.path = daemon_log, .rotate_bytes = rotate_bytes, .keep = keep};
+    run_daemon(fifo_fd, &sink, sync_ms, flush_ms);
+    print_sink(&sink);
+    exit(EXIT_SUCCESS);
+  }
+  int fifo_fd = open(fifo, O_WRONLY);
+  check_result(fifo_fd, "open (fifo)");
+  run_writers(writers, lines, fifo_fd, NULL);
+  check_result(close(fifo_fd), "close");
+  int status;
+  check_result(waitpid(daemon, &status, 0), "waitpid");
+  double daemon_seconds = now_seconds() - start;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "The daemon failed\n");
+    exit(EXIT_FAILURE);
+  }
+  check_result(unlink(fifo), "unlink");
+
+  // Every writer appends to the file itself
+  start = now_seconds();
+  run_writers(writers, lines, -1, append_log);
+  double append_seconds = now_seconds() - start;
+
+  uint64_t daemon_dropped, append_dropped;
+  int daemon_ok = verify_logs(daemon_log, keep, writers, lines, &daemon_dropped);
+  int append_ok = verify_logs(append_log, 0, writers, lines, &append_dropped);
+  (void)printf("%-12s %8s %10s %10s %12s %s\n", "mode", "writers", "lines", "seconds", "lines/s", "check");
+  print_result("fifo daemon", writers, lines, daemon_seconds, daemon_ok, daemon_dropped);
+  print_result("O_APPEND", writers, lines, append_seconds, append_ok, append_dropped);
+}
+
+// Program to collect log lines from many processes through a named pipe into one rotated log file
+int main(int argc, char* argv[]) {
+  const char* fifo = "/tmp/log_daemon.fifo";
+  const char* log  = "/tmp/log_daemon.log";
+  const char* dir  = "/tmp";
+  off_t rotate_mb  = 64;
+  int keep         = 8;
+  int sync_ms      = 1000;
+  int flush_ms     = 10;
+  int bench        = 0;
+  int writers      = 32;
+  unsigned lines   = 20000;
+
+  int c;
+  while ((c = getopt(argc, argv, "f:o:r:k:S:bw:n:d:")) != -1) {
+    switch (c) {
+      case 'f':
+        fifo = optarg;
+        break;
+      case 'o':
+        log = optarg;
+        break;
+      case 'r':
+        rotate_mb = atoll(optarg);
+        break;
+      case 'k':
+        keep = atoi(optarg);
+        break;
+      case 'S':
+        sync_ms = atoi(optarg);
+        break;
+      case 'b':
+        bench = 1;
+        break;
+      case 'w':
+        writers = atoi(optarg);
+        break;
+      case 'n':
+        lines = (unsigned)strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: ./i_log_daemon [-f fifo] [-o log] [-r rotate_MB] [-k keep] [-S sync_ms]\n"
+                "       ./i_log_daemon -b [-w writers] [-n lines] [-d dir] [-r rotate_MB] [-k keep] [-S sync_ms]\n");
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (rotate_mb <= 0 || keep < 1 || sync_ms <= 0 || writers <= 0 || writers > LOG_MAX_WRITERS || lines == 0) {
+    fprintf(stderr, "rotate_MB, sync_ms and lines must be positive, keep >= 1 and 1 <= writers <= %d\n", LOG_MAX_WRITERS);
+    exit(EXIT_FAILURE);
+  }
+  off_t rotate_bytes = rotate_mb * 1000 * 1000;
+
+  if (bench) {
+    benchmark(dir, writers, lines, rotate_bytes, keep, sync_ms, flush_ms);
+    return EXIT_SUCCESS;
+  }
+
+  struct sigaction sa = {0};
+  sa.sa_handler       = on_stop;  // ppoll() returns EINTR and the loop ends
+  sigemptyset(&sa.sa_mask);
+  check_result(sigaction(SIGINT, &sa, NULL), "sigaction");
+  check_result(sigaction(SIGTERM, &sa, NULL), "sigaction");
+
+  if (mkfifo(fifo, 0666) == -1 && errno != EEXIST) {
+    handle_error("mkfifo");
+  }
+  int fifo_fd = open(fifo, O_RDWR);  // also a writer, so the last real writer closing is not EOF
+  check_result(fifo_fd, "open (fifo)");
+
+  LogSink sink = {.path = log, .rotate_bytes = rotate_bytes, .keep = keep};
+  run_daemon(fifo_fd, &sink, sync_ms, flush_ms);
+  print_sink(&sink);
+  check_result(close(fifo_fd), "close");
+  if (unlink(fifo) != 0) {
+    perror("unlink");
+  }
+  return EXIT_SUCCESS;
+}
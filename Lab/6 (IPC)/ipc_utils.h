@@ -0,0 +1,75 @@
+#ifndef IPC_UTILS_H
+#define IPC_UTILS_H
+
+#include <errno.h>      // for errno
+#include <stdio.h>      // for perror()
+#include <stdlib.h>     // for exit()
+#include <sys/types.h>  // for ssize_t
+#include <unistd.h>     // for read(), write()
+
+//--------------------------------------------------------------------------------
+// Error handling and full reads/writes shared by the programs of this lab
+//
+// Usage:
+//   check_result(pipe(fd), "pipe");                        // perror() and exit on -1
+//   check_result(write_all(fd, arr, size), "write_all");   // all size bytes, or -1
+//   check_result(read_all(fd, arr, size), "read_all");     // all size bytes, or -1 (EPIPE if the writer left early)
+//
+// Notes:
+// - Pipes, FIFOs and sockets do not guarantee that one read()/write() moves everything asked for: a read
+//   returns what is there, a write to a full pipe may stop early. write_all()/read_all() loop until done
+// - Both retry on EINTR, so a signal handler installed without SA_RESTART does not break a transfer
+//--------------------------------------------------------------------------------
+
+// Error handling utilities as functions
+static inline void handle_error(const char* msg) {
+  perror(msg);
+  exit(EXIT_FAILURE);
+}
+
+// Takes ssize_t so byte counts above INT_MAX are passed whole, not truncated (and possibly turned into -1)
+static inline void check_result(ssize_t result, const char* msg) {
+  if (result == -1) {
+    handle_error(msg);
+  }
+}
+
+// Returns bytes on success; -1 on failure, setting errno to indicate the error
+static inline ssize_t write_all(int fd, const void* buffer, size_t bytes) {
+  size_t total    = 0;
+  const char* ptr = buffer;
+  while (total < bytes) {
+    ssize_t written = write(fd, ptr + total, bytes - total);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return -1;
+    }
+    total += written;
+  }
+  return total;
+}
+
+// Returns bytes on success; -1 on failure or end-of-stream before bytes arrived, setting errno
+static inline ssize_t read_all(int fd, void* buffer, size_t bytes) {
+  size_t total = 0;
+  char* ptr    = buffer;
+  while (total < bytes) {
+    ssize_t got = read(fd, ptr + total, bytes - total);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got == -1) {
+      return -1;
+    }
+    if (got == 0) {
+      errno = EPIPE;  // the writer closed its end in the middle
+      return -1;
+    }
+    total += got;
+  }
+  return total;
+}
+
+#endif  // IPC_UTILS_H
@@ -0,0 +1,283 @@
+#include <errno.h>      // for errno
+#include <fcntl.h>      // for O_CREAT, O_RDWR
+#include <limits.h>     // for INT32_MIN, INT32_MAX
+#include <stdint.h>     // for int32_t, uint64_t
+#include <stdio.h>      // for perror(), printf(), snprintf()
+#include <stdlib.h>     // for exit(), strtoull()
+#include <string.h>     // for memcmp()
+#include <sys/mman.h>   // for shm_open(), mmap(), munmap(), shm_unlink()
+#include <sys/stat.h>   // for fstat()
+#include <sys/types.h>  // for pid_t
+#include <sys/wait.h>   // for waitpid()
+#include <time.h>       // for clock_gettime()
+#include <unistd.h>     // for ftruncate(), close(), fork(), write(), getopt()
+
+#include "columnar.h"
+#include "ipc_utils.h"
+
+//--------------------------------------------------------------------------------
+// Filter + aggregate scans over a table in shared memory: columns against rows
+// Brief: The parent loads the same rows twice, as a columnar table (columnar.h) and as an array of row structs,
+//        each in its own shared memory object, then forks query processes that attach both by name, as
+//        c_shared_memory.c's child does, and time the same queries on each.
+//
+// Usage:
+//   ./j_columnar_scan [-n rows] [-p query_processes] [-r repeats]
+//
+// Notes:
+// - Methods: rows (scalar loop over the row structs), columns (scalar kernel), columns avx2, and columns avx2 +
+//   zone maps. rows/s is table rows divided by the best of repeats, so skipped blocks count as scanned
+// - The rows have 8 int columns (32 bytes); every query reads 2 or 3 of them, which is all a column scan touches
+// - "time" grows with the row number, so a time range is where zone maps prune; "amount" is random, so they
+//   prune nothing there, and "all rows" matches every block whole and only sums
+// - Every method must return the same count and sum; a mismatch is reported and fails the run
+//--------------------------------------------------------------------------------
+
+#define TABLE_NAME "/columnar_table"
+#define ROWS_NAME "/columnar_rows"
+#define COLUMNS 8
+#define QUERY_COUNT 4
+#define METHOD_COUNT 4
+#define REPORT_SIZE 8192
+
+static const char* const COLUMN_NAMES[COLUMNS] = {"time", "user", "amount", "status", "region", "latency", "bytes", "flags"};
+
+typedef struct {
+  const char* name;
+  ColumnarQuery query;
+} NamedQuery;
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+uint64_t next_random(uint64_t* state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+// Loads both layouts with the same values
+void load_tables(uint64_t rows) {
+  ColumnarTable* table = columnar_create(TABLE_NAME, COLUMNS, COLUMN_NAMES, rows);
+  if (table == NULL) {
+    handle_error("columnar_create");
+  }
+
+  int fd = shm_open(ROWS_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+  check_result(fd, "shm_open (rows)");
+  size_t row_bytes = rows * COLUMNS * sizeof(int32_t);
+  check_result(ftruncate(fd, (off_t)row_bytes), "ftruncate");
+  int32_t* row_data = mmap(NULL, row_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (row_data == MAP_FAILED) {
+    handle_error("mmap (rows)");
+  }
+  check_result(close(fd), "close");
+
+  int32_t* columns[COLUMNS];
+  for (uint32_t c = 0; c < COLUMNS; c++) {
+    columns[c] = columnar_column_data(table, c);
+  }
+  uint64_t state = 88172645463325252ull;
+  for (uint64_t i = 0; i < rows; i++) {
+    uint64_t r = next_random(&state);
+
+    int32_t values[COLUMNS] = {
+        (int32_t)(i / 4 + r % 64),                   // time: increasing, a little out of order
+        (int32_t)(r % 1000000),                      // user
+        (int32_t)((r >> 20) % 10000),                // amount
+        (int32_t)((r >> 34) % 8),                    // status
+        (int32_t)((r >> 37) % 16),                   // region
+        (int32_t)((r >> 41) % 5000),                 // latency
+        (int32_t)(next_random(&state) % 100000000),  // bytes
+        (int32_t)((r >> 54) & 0xff),                 // flags
+    };
+    for (uint32_t c = 0; c < COLUMNS; c++) {
+      columns[c][i]             = values[c];
+      row_data[i * COLUMNS + c] = values[c];
+    }
+  }
+
+  check_result(columnar_seal(table), "columnar_seal");
+  check_result(munmap(table, table->size), "munmap");
+  check_result(munmap(row_data, row_bytes), "munmap");
+}
+
+void cleanup_tables() {
+  if (shm_unlink(TABLE_NAME) != 0 && errno != ENOENT) {
+    perror("shm_unlink");
+  }
+  if (shm_unlink(ROWS_NAME) != 0 && errno != ENOENT) {
+    perror("shm_unlink");
+  }
+}
+
+// The same query over the row layout: every row's whole 32 bytes pass through the cache
+void row_scan(const int32_t* rows, uint64_t count, const ColumnarQuery* q, ColumnarResult* result) {
+  uint64_t matched = 0;
+  int64_t sum      = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    const int32_t* row = rows + i * COLUMNS;
+    int keep           = 1;
+    for (unsigned j = 0; j < q->predicate_count; j++) {
+      int32_t v = row[q->predicates[j].column];
+      keep &= (v >= q->predicates[j].low) & (v <= q->predicates[j].high);
+    }
+    matched += keep;
+    sum += keep ? row[q->sum_column] : 0;
+  }
+  memset(result, 0, sizeof(*result));
+  result->count = matched;
+  result->sum   = sum;
+}
+
+// Best time of repeats for one method; method 0 is the row layout
+double time_method(int method, const ColumnarTable* table, const int32_t* rows, const ColumnarQuery* q,
+                   ColumnarKernel simd, int repeats, ColumnarResult* result) {
+  double best = 0;
+  for (int r = 0; r < repeats; r++) {
+    double start = now_seconds();
+    switch (method) {
+      case 0:
+        row_scan(rows, table->rows, q, result);
+        break;
+      case 1:
+        columnar_scan(table, q, columnar_kernel_scalar, 0, result);
+        break;
+      case 2:
+        columnar_scan(table, q, simd, 0, result);
+        break;
+      default:
+        columnar_scan(table, q, simd, 1, result);
+        break;
+    }
+    double seconds = now_seconds() - start;
+    best           = r == 0 || seconds < best ? seconds : best;
+  }
+  return best;
+}
+
+// A query process: attaches both objects read-only by name and reports in one write(), so reports do not interleave
+void query_process(int id, int repeats) {
+  const ColumnarTable* table = columnar_attach(TABLE_NAME);
+  if (table == NULL) {
+    handle_error("columnar_attach");
+  }
+  int fd = shm_open(ROWS_NAME, O_RDONLY, 0);
+  check_result(fd, "shm_open (rows)");
+  size_t row_bytes    = table->rows * COLUMNS * sizeof(int32_t);
+  const int32_t* rows = mmap(NULL, row_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  if (rows == MAP_FAILED) {
+    handle_error("mmap (rows)");
+  }
+  check_result(close(fd), "close");
+
+  uint32_t time     = (uint32_t)columnar_find(table, "time");
+  uint32_t amount   = (uint32_t)columnar_find(table, "amount");
+  uint32_t status   = (uint32_t)columnar_find(table, "status");
+  uint32_t region   = (uint32_t)columnar_find(table, "region");
+  uint32_t latency  = (uint32_t)columnar_find(table, "latency");
+  uint32_t bytes    = (uint32_t)columnar_find(table, "bytes");
+  int32_t last_time = (int32_t)(table->rows / 4);
+
+  NamedQuery queries[QUERY_COUNT] = {
+      {"time in 1% range", {1, {{time, last_time / 2, last_time / 2 + last_time / 100}}, amount}},
+      {"amount < 100", {1, {{amount, 0, 99}}, latency}},
+      {"status=3 region<4", {2, {{status, 3, 3}, {region, 0, 3}}, bytes}},
+      {"all rows", {1, {{amount, INT32_MIN, INT32_MAX}}, amount}},
+  };
+
+  const char* simd_name;
+  ColumnarKernel simd = columnar_kernel_init(&simd_name);
+  char method_names[METHOD_COUNT][32];
+  snprintf(method_names[0], sizeof(method_names[0]), "rows");
+  snprintf(method_names[1], sizeof(method_names[1]), "columns");
+  snprintf(method_names[2], sizeof(method_names[2]), "columns %s", simd_name);
+  snprintf(method_names[3], sizeof(method_names[3]), "%s + zones", simd_name);
+
+  static char report[REPORT_SIZE];
+  int len = snprintf(report, sizeof(report), "query process %d: %llu rows, M rows/s (best of %d)\n%-18s", id,
+                     (unsigned long long)table->rows, repeats, "query");
+  for (int m = 0; m < METHOD_COUNT; m++) {
+    len += snprintf(report + len, sizeof(report) - len, " %14s", method_names[m]);
+  }
+  len += snprintf(report + len, sizeof(report) - len, " %10s %8s\n", "matched", "skipped");
+
+  int ok = 1;
+  for (int qi = 0; qi < QUERY_COUNT; qi++) {
+    ColumnarResult results[METHOD_COUNT];
+    len += snprintf(report + len, sizeof(report) - len, "%-18s", queries[qi].name);
+    for (int m = 0; m < METHOD_COUNT; m++) {
+      double seconds = time_method(m, table, rows, &queries[qi].query, simd, repeats, &results[m]);
+      len += snprintf(report + len, sizeof(report) - len, " %14.0f", (double)table->rows / seconds / 1e6);
+      ok &= results[m].count == results[0].count && results[m].sum == results[0].sum;
+    }
+    len += snprintf(report + len, sizeof(report) - len, " %9.2f%% %7.1f%%\n",
+                    100.0 * (double)results[0].count / (double)table->rows,
+                    100.0 * (double)results[METHOD_COUNT - 1].blocks_skipped / (double)table->blocks);
+  }
+  len += snprintf(report + len, sizeof(report) - len, "results %s\n", ok ? "match" : "DIFFER");
+  if (write(STDOUT_FILENO, report, (size_t)len) != len) {
+    perror("write");
+  }
+
+  check_result(munmap((void*)rows, row_bytes), "munmap");
+  check_result(columnar_detach(table), "munmap");
+  exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// Program to load a table into shared memory once and scan it from other processes, by column and by row
+int main(int argc, char* argv[]) {
+  uint64_t rows = 8 * 1024 * 1024;
+  int processes = 1;
+  int repeats   = 5;
+
+  int c;
+  while ((c = getopt(argc, argv, "n:p:r:")) != -1) {
+    switch (c) {
+      case 'n':
+        rows = strtoull(optarg, NULL, 10);
+        break;
+      case 'p':
+        processes = atoi(optarg);
+        break;
+      case 'r':
+        repeats = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: ./j_columnar_scan [-n rows] [-p query_processes] [-r repeats]\n");
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (rows == 0 || rows > INT32_MAX || processes <= 0 || repeats <= 0) {
+    fprintf(stderr, "0 < rows <= %d, query_processes and repeats must be positive\n", INT32_MAX);
+    exit(EXIT_FAILURE);
+  }
+
+  cleanup_tables();  // left over from an interrupted run
+  double start = now_seconds();
+  load_tables(rows);
+  (void)printf("loaded %llu rows in %.2f s\n", (unsigned long long)rows, now_seconds() - start);
+  (void)fflush(stdout);
+
+  int failed = 0;
+  for (int p = 0; p < processes; p++) {
+    pid_t pid = fork();
+    check_result(pid, "fork");
+    if (pid == 0) {
+      query_process(p, repeats);
+    }
+  }
+  for (int p = 0; p < processes; p++) {
+    int status;
+    check_result(wait(&status), "wait");
+    failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  cleanup_tables();
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
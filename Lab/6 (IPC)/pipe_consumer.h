@@ -0,0 +1,320 @@
+#ifndef PIPE_CONSUMER_H
+#define PIPE_CONSUMER_H
+
+#include <errno.h>      // for errno
+#include <pthread.h>    // for pthread_create(), mutexes and condition variables
+#include <stdint.h>     // for int64_t, uint64_t
+#include <stdlib.h>     // for malloc(), free(), qsort()
+#include <string.h>     // for memset(), strcmp()
+#include <sys/types.h>  // for ssize_t
+#include <time.h>       // for clock_gettime()
+#include <unistd.h>     // for read()
+
+//--------------------------------------------------------------------------------
+// Receiving and computing at the same time
+// Brief: parent_process() in a_unnamed_pipes.c reads the whole array and only then works on it, so the
+//        computation starts after the last byte. consume_pipelined() has a reader thread fill a ring of
+//        buffers from the pipe while the calling thread runs a reducer over the buffers already filled,
+//        so by the time the last byte arrives only the last buffer is left to reduce.
+//
+// Usage:
+//   ReduceResult result;
+//   ConsumeStats stats;
+//   consume_pipelined(read_fd, bytes, 2, 256 * 1024, find_reducer("sum"), &result, &stats);
+//   consume_serial(read_fd, bytes, 256 * 1024, find_reducer("sum"), &result, &stats);   // read all, then reduce
+//
+// Returns: 0 on success; -1 on failure, setting errno to indicate the error (EPIPE if the writer closed early)
+//
+// Notes:
+// - Reducers: sum (int64 total), histogram (256 buckets on the top byte), sort-run (sorts every buffer in
+//   place, the run-generation phase of an external merge sort)
+// - consume_serial() reduces the same buffer_bytes chunks, so both give identical results and only the timing differs
+// - overlap = (receive + compute - wall) / min(receive, compute): the share of the shorter activity that was
+//   hidden under the longer one. 0 is strictly one after the other, 1 is fully overlapped
+// - tail = time from the last byte read to the result; serially it is the whole compute time, pipelined it is
+//   about one buffer's worth
+// - Even on one CPU this helps: the reader spends much of receive blocked in read() waiting for the producer,
+//   and that is when the compute thread runs
+//--------------------------------------------------------------------------------
+
+#define CONSUME_MAX_BUFFERS 64
+#define REDUCE_HISTOGRAM_BUCKETS 256
+
+typedef struct {
+  int64_t sum;
+  uint64_t histogram[REDUCE_HISTOGRAM_BUCKETS];
+  uint64_t runs;       // sort-run: sorted runs produced
+  int64_t run_medians;  // sort-run: sum of every run's middle element, to compare results
+} ReduceResult;
+
+typedef struct {
+  const char* name;
+  void (*reduce)(ReduceResult* result, int* values, size_t count);  // may reorder values
+} Reducer;
+
+typedef struct {
+  double wall;     // first read() to result ready
+  double receive;  // time spent in read()
+  double compute;  // time spent in the reducer
+  double tail;     // last byte received to result ready
+  uint64_t bytes;
+} ConsumeStats;
+
+static inline double consume_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static inline void reduce_sum(ReduceResult* result, int* values, size_t count) {
+  int64_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += values[i];
+  }
+  result->sum += sum;
+}
+
+static inline void reduce_histogram(ReduceResult* result, int* values, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    result->histogram[(uint32_t)values[i] >> 24]++;
+  }
+}
+
+static inline int reduce_compare_int(const void* a, const void* b) {
+  int x = *(const int*)a, y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+static inline void reduce_sort_run(ReduceResult* result, int* values, size_t count) {
+  qsort(values, count, sizeof(int), reduce_compare_int);
+  result->runs++;
+  result->run_medians += count > 0 ? values[count / 2] : 0;
+}
+
+static const Reducer REDUCERS[] = {
+    {"sum", reduce_sum},
+    {"histogram", reduce_histogram},
+    {"sort-run", reduce_sort_run},
+};
+
+#define REDUCER_COUNT (sizeof(REDUCERS) / sizeof(REDUCERS[0]))
+
+static inline const Reducer* find_reducer(const char* name) {
+  for (size_t i = 0; i < REDUCER_COUNT; i++) {
+    if (strcmp(REDUCERS[i].name, name) == 0) {
+      return &REDUCERS[i];
+    }
+  }
+  return NULL;
+}
+
+// Reads exactly bytes unless the writer closes first (EPIPE)
+static inline int consume_read_all(int fd, void* buffer, size_t bytes, double* seconds) {
+  char* ptr    = buffer;
+  double start = consume_now();
+  while (bytes > 0) {
+    ssize_t got = read(fd, ptr, bytes);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      if (got == 0) {
+        errno = EPIPE;
+      }
+      return -1;
+    }
+    ptr += got;
+    bytes -= got;
+  }
+  *seconds += consume_now() - start;
+  return 0;
+}
+
+static inline void consume_finish_stats(ConsumeStats* stats, uint64_t bytes, double start, double last_byte) {
+  double done  = consume_now();
+  stats->bytes = bytes;
+  stats->wall  = done - start;
+  stats->tail  = done - last_byte;
+}
+
+// Baseline: the whole payload into one buffer, then the reducer over it in buffer_bytes chunks
+static inline int consume_serial(int fd, uint64_t bytes, size_t buffer_bytes, const Reducer* reducer, ReduceResult* result,
+                                 ConsumeStats* stats) {
+  memset(result, 0, sizeof(*result));
+  memset(stats, 0, sizeof(*stats));
+  if (bytes % sizeof(int) != 0 || buffer_bytes < sizeof(int)) {
+    errno = EINVAL;
+    return -1;
+  }
+  buffer_bytes -= buffer_bytes % sizeof(int);
+
+  char* data = malloc(bytes + 1);
+  if (data == NULL) {
+    return -1;
+  }
+  double start = consume_now();
+  if (consume_read_all(fd, data, bytes, &stats->receive) == -1) {
+    int err = errno;
+    free(data);
+    errno = err;
+    return -1;
+  }
+  double last_byte = consume_now();
+
+  for (uint64_t done = 0; done < bytes; done += buffer_bytes) {
+    size_t len = bytes - done < buffer_bytes ? bytes - done : buffer_bytes;
+    reducer->reduce(result, (int*)(data + done), len / sizeof(int));
+  }
+  stats->compute = consume_now() - last_byte;
+  consume_finish_stats(stats, bytes, start, last_byte);
+  free(data);
+  return 0;
+}
+
+typedef struct {
+  int fd;
+  uint64_t bytes;
+  size_t buffer_bytes;
+  unsigned buffer_count;
+  char* data;
+  size_t* lengths;
+  uint64_t produced;  // buffers filled by the reader
+  uint64_t consumed;  // buffers reduced by the compute thread
+  int eof;
+  int error;  // errno of the first failure; stops both threads
+  double receive;
+  double last_byte;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;  // reader -> compute
+  pthread_cond_t freed;   // compute -> reader
+} PipeConsumer;
+
+static void* consume_reader(void* arg) {
+  PipeConsumer* c = (PipeConsumer*)arg;
+
+  uint64_t offset = 0;
+  for (uint64_t seq = 0; offset < c->bytes; seq++) {
+    pthread_mutex_lock(&c->lock);
+    while (c->produced - c->consumed == c->buffer_count && c->error == 0) {
+      pthread_cond_wait(&c->freed, &c->lock);
+    }
+    int stop = c->error != 0;
+    pthread_mutex_unlock(&c->lock);
+    if (stop) {
+      break;
+    }
+
+    unsigned slot = (unsigned)(seq % c->buffer_count);
+    size_t len    = c->bytes - offset < c->buffer_bytes ? c->bytes - offset : c->buffer_bytes;
+    int ok        = consume_read_all(c->fd, c->data + (size_t)slot * c->buffer_bytes, len, &c->receive) != -1;
+    offset += len;
+
+    pthread_mutex_lock(&c->lock);
+    if (!ok) {
+      c->error = errno;
+    } else {
+      c->lengths[slot] = len;
+      c->produced++;
+    }
+    pthread_cond_signal(&c->filled);
+    pthread_mutex_unlock(&c->lock);
+    if (!ok) {
+      break;
+    }
+  }
+
+  pthread_mutex_lock(&c->lock);
+  c->last_byte = consume_now();
+  c->eof       = 1;
+  pthread_cond_signal(&c->filled);
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+// Double (or N-) buffered: a reader thread fills buffer_count buffers, the calling thread reduces them
+static inline int consume_pipelined(int fd, uint64_t bytes, unsigned buffer_count, size_t buffer_bytes, const Reducer* reducer,
+                                    ReduceResult* result, ConsumeStats* stats) {
+  memset(result, 0, sizeof(*result));
+  memset(stats, 0, sizeof(*stats));
+  if (bytes % sizeof(int) != 0 || buffer_bytes < sizeof(int) || buffer_count < 2 || buffer_count > CONSUME_MAX_BUFFERS) {
+    errno = EINVAL;
+    return -1;
+  }
+  buffer_bytes -= buffer_bytes % sizeof(int);
+
+  PipeConsumer c = {0};
+  c.fd           = fd;
+  c.bytes        = bytes;
+  c.buffer_bytes = buffer_bytes;
+  c.buffer_count = buffer_count;
+  c.data         = malloc(buffer_bytes * buffer_count);
+  c.lengths      = calloc(buffer_count, sizeof(size_t));
+  if (c.data == NULL || c.lengths == NULL) {
+    free(c.data);
+    free(c.lengths);
+    errno = ENOMEM;
+    return -1;
+  }
+  pthread_mutex_init(&c.lock, NULL);
+  pthread_cond_init(&c.filled, NULL);
+  pthread_cond_init(&c.freed, NULL);
+
+  double start = consume_now();
+  pthread_t reader;
+  int err = pthread_create(&reader, NULL, consume_reader, &c);
+  if (err != 0) {
+    free(c.data);
+    free(c.lengths);
+    errno = err;
+    return -1;
+  }
+
+  for (uint64_t seq = 0;; seq++) {
+    pthread_mutex_lock(&c.lock);
+    while (c.produced <= seq && !c.eof && c.error == 0) {
+      pthread_cond_wait(&c.filled, &c.lock);
+    }
+    int stop = c.produced <= seq || c.error != 0;
+    pthread_mutex_unlock(&c.lock);
+    if (stop) {
+      break;
+    }
+
+    unsigned slot    = (unsigned)(seq % buffer_count);
+    double reduce_at = consume_now();
+    reducer->reduce(result, (int*)(c.data + (size_t)slot * buffer_bytes), c.lengths[slot] / sizeof(int));
+    stats->compute += consume_now() - reduce_at;
+
+    pthread_mutex_lock(&c.lock);
+    c.consumed++;
+    pthread_cond_signal(&c.freed);
+    pthread_mutex_unlock(&c.lock);
+  }
+
+  pthread_join(reader, NULL);
+  stats->receive = c.receive;
+  consume_finish_stats(stats, bytes, start, c.last_byte);
+
+  pthread_mutex_destroy(&c.lock);
+  pthread_cond_destroy(&c.filled);
+  pthread_cond_destroy(&c.freed);
+  free(c.data);
+  free(c.lengths);
+  if (c.error != 0) {
+    errno = c.error;
+    return -1;
+  }
+  return 0;
+}
+
+// Share of the shorter of receive and compute that ran under the longer one, 0..1
+static inline double consume_overlap(const ConsumeStats* stats) {
+  double shorter = stats->receive < stats->compute ? stats->receive : stats->compute;
+  if (shorter <= 0) {
+    return 0;
+  }
+  double overlap = (stats->receive + stats->compute - stats->wall) / shorter;
+  return overlap < 0 ? 0 : overlap > 1 ? 1 : overlap;
+}
+
+#endif  // PIPE_CONSUMER_H
@@ -0,0 +1,147 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <errno.h>      // for errno
+#include <stdint.h>     // for uint32_t
+#include <string.h>     // for memcpy(), memmove()
+#include <sys/types.h>  // for ssize_t
+#include <unistd.h>     // for read(), write()
+
+//--------------------------------------------------------------------------------
+// Request/response messages over a pair of pipes
+// Brief: Every message is a header { id, op, len } followed by len payload bytes. The client numbers its requests;
+//        the server echoes the id in the reply, so replies may come back in any order and requests can be
+//        pipelined: many are sent before the first reply is read.
+//
+// Layout:
+//   parent (client) --- requests pipe ---> child (server)
+//   parent (client) <--- replies pipe ---- child (server)
+//
+// Usage:
+//   RpcWriter out = {.fd = request_fd};
+//   rpc_writer_add(&out, id, op, &args, sizeof(args));   // queue as many as the window allows
+//   rpc_writer_flush(&out);                               // one write() for all of them
+//
+//   RpcReader in = {.fd = reply_fd};
+//   RpcHeader h;
+//   const void* payload;
+//   while (rpc_reader_next(&in, &h, &payload) == 1) { ... match h.id ... }
+//
+// Notes:
+// - Both sides buffer: a reader gets as many messages per read() as are in the pipe, and a writer sends
+//   everything queued with one write(), so at a deep window the cost per call is far below two syscalls
+// - rpc_reader_buffered() says whether another complete message is waiting, so a server can take a whole batch
+//   and reply in whatever order suits it (g_pipelined_rpc.c runs the cheapest requests first)
+// - A single-threaded client must not have more unread replies in flight than the reply pipe can hold while it
+//   is still writing requests, or both sides block in write(); with small messages a window of 256 is far from it
+//--------------------------------------------------------------------------------
+
+#define RPC_MAX_PAYLOAD 4096
+#define RPC_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+  uint32_t id;
+  uint32_t op;
+  uint32_t len;  // payload bytes that follow
+} RpcHeader;
+
+typedef struct {
+  int fd;
+  size_t start;  // first unparsed byte in data
+  size_t end;
+  char data[RPC_BUFFER_SIZE];
+} RpcReader;
+
+typedef struct {
+  int fd;
+  size_t len;
+  char data[RPC_BUFFER_SIZE];
+} RpcWriter;
+
+// Whether a whole message is already in the buffer, so rpc_reader_next() will not block
+static inline int rpc_reader_buffered(const RpcReader* r) {
+  size_t avail = r->end - r->start;
+  if (avail < sizeof(RpcHeader)) {
+    return 0;
+  }
+  RpcHeader h;
+  memcpy(&h, r->data + r->start, sizeof(h));
+  return avail - sizeof(RpcHeader) >= h.len;
+}
+
+// Returns 1 with the next message (payload points into the reader until the next call), 0 at EOF between
+// messages, -1 on error or a malformed/truncated message (errno EPROTO)
+static inline int rpc_reader_next(RpcReader* r, RpcHeader* h, const void** payload) {
+  while (!rpc_reader_buffered(r)) {
+    if (r->end - r->start >= sizeof(RpcHeader)) {
+      RpcHeader next;
+      memcpy(&next, r->data + r->start, sizeof(next));
+      if (next.len > RPC_MAX_PAYLOAD) {
+        errno = EPROTO;
+        return -1;
+      }
+    }
+    if (r->start > 0) {  // keep the partial message at the front, so there is room for the rest
+      memmove(r->data, r->data + r->start, r->end - r->start);
+      r->end -= r->start;
+      r->start = 0;
+    }
+
+    ssize_t got = read(r->fd, r->data + r->end, RPC_BUFFER_SIZE - r->end);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got == -1) {
+      return -1;
+    }
+    if (got == 0) {
+      if (r->end == r->start) {
+        return 0;
+      }
+      errno = EPROTO;  // the writer closed in the middle of a message
+      return -1;
+    }
+    r->end += got;
+  }
+
+  memcpy(h, r->data + r->start, sizeof(*h));
+  *payload = r->data + r->start + sizeof(RpcHeader);
+  r->start += sizeof(RpcHeader) + h->len;
+  return 1;
+}
+
+static inline int rpc_writer_flush(RpcWriter* w) {
+  size_t done = 0;
+  while (done < w->len) {
+    ssize_t written = write(w->fd, w->data + done, w->len - done);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return -1;
+    }
+    done += written;
+  }
+  w->len = 0;
+  return 0;
+}
+
+// Queues a message, flushing first if it does not fit
+static inline int rpc_writer_add(RpcWriter* w, uint32_t id, uint32_t op, const void* payload, uint32_t len) {
+  if (len > RPC_MAX_PAYLOAD) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (RPC_BUFFER_SIZE - w->len < sizeof(RpcHeader) + len && rpc_writer_flush(w) == -1) {
+    return -1;
+  }
+  RpcHeader h = {id, op, len};
+  memcpy(w->data + w->len, &h, sizeof(h));
+  if (len > 0) {
+    memcpy(w->data + w->len + sizeof(h), payload, len);
+  }
+  w->len += sizeof(h) + len;
+  return 0;
+}
+
+#endif  // RPC_H
@@ -0,0 +1,785 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // for memfd_create() and F_ADD_SEALS; include this header first or define it yourself
+#endif
+
+#include <errno.h>       // for errno
+#include <fcntl.h>       // for open(), O_* constants
+#include <poll.h>        // for poll()
+#include <semaphore.h>   // for sem_init(), sem_timedwait(), sem_post()
+#include <signal.h>      // for sigaction(), SIGPIPE
+#include <stdatomic.h>   // for atomic_load_explicit(), atomic_store_explicit()
+#include <stdint.h>      // for uint32_t, uint64_t
+#include <stdio.h>       // for snprintf()
+#include <stdlib.h>      // for malloc(), free()
+#include <string.h>      // for memcpy(), strcmp()
+#include <sys/mman.h>    // for mmap(), munmap(), memfd_create()
+#include <sys/socket.h>  // for socketpair(), sendmsg(), recvmsg()
+#include <sys/stat.h>    // for mkfifo()
+#include <sys/types.h>   // for ssize_t
+#include <sys/uio.h>     // for writev()
+#include <time.h>        // for clock_gettime()
+#include <unistd.h>      // for pipe(), read(), write(), close(), unlink()
+
+//--------------------------------------------------------------------------------
+// One message-passing interface over the IPC mechanisms of this lab
+// Brief: A transport carries frames (a length and that many bytes) from a sender process to a receiver process.
+//        The same program can switch between pipe, FIFO, shared-memory ring, AF_UNIX socket and memfd handoff by name.
+//
+// Lifecycle:
+//   Transport t;
+//   transport_open(&t, transport_find("shm"), NULL);   // before fork(): create the channel
+//   pid = fork();
+//   transport_attach(&t, pid == 0 ? TRANSPORT_SENDER : TRANSPORT_RECEIVER);  // in both processes
+//   sender:   transport_send_frame(&t, data, len);
+//   receiver: len = transport_recv_frame(&t, buffer, sizeof(buffer));    // copies the frame out
+//             data = transport_borrow(&t, &len); ...; transport_release(&t);  // or looks at it in place
+//   transport_close(&t);  // in both processes; the receiver sees end-of-stream once the sender closes
+//
+// Returns: 0 (or a length) on success; -1 on failure, setting errno to indicate the error
+// - transport_recv_frame() returns 0 and transport_borrow() returns NULL with errno 0 at end-of-stream
+//   (a zero-length frame is reported as TRANSPORT_EMPTY_FRAME by recv_frame)
+// - End-of-stream is also reported when the sender exits without transport_close(); a sender whose receiver
+//   is gone fails with EPIPE. For pipe, fifo and unix that needs SIGPIPE ignored, so attaching as their sender
+//   sets SIGPIPE to SIG_IGN for the whole process
+//
+// Errors:
+// - EMSGSIZE - The frame is longer than transport_max_frame(): UINT32_MAX - 1 bytes for pipe, fifo and unix,
+//              TRANSPORT_SHM_MAX_FRAME (half the ring) for shm, no limit but memory for memfd
+//
+// Notes:
+// - pipe, fifo and unix send a 4-byte length prefix plus the payload with one writev()
+//   -> borrow() on them reads into a buffer owned by the transport, so it still costs one copy
+// - shm is a single-producer/single-consumer ring in a shared mapping; borrow() returns a pointer into the ring
+//   -> The mapping is anonymous and reaches the receiver through fork(), so no other process can open it
+//   -> Frames never wrap around the end of the ring, so a borrowed frame is always contiguous
+//   -> Two process-shared semaphores put the receiver to sleep when the ring is empty and the sender when it is full
+//   -> A semaphore cannot tell that the other process died, so shm also keeps a pipe that carries no data: a
+//      blocked side wakes up every TRANSPORT_PEER_CHECK_MS and polls it for the hang-up of the other end
+// - memfd hands over a sealed memfd per frame on an AF_UNIX socket; see the memfd section below
+// - Exactly one sender and one receiver per transport
+//--------------------------------------------------------------------------------
+
+#define TRANSPORT_SENDER 1
+#define TRANSPORT_RECEIVER 2
+#define TRANSPORT_EMPTY_FRAME (-2)
+
+#define TRANSPORT_FIFO_PATH "/tmp/transport_fifo"  // default FIFO path, followed by the creating process's pid
+#define TRANSPORT_RING_SIZE (1024 * 1024)             // power of two
+#define TRANSPORT_SHM_MAX_FRAME (TRANSPORT_RING_SIZE / 2 - 8)  // longest shm frame: half the ring minus a header
+#define TRANSPORT_WRAP UINT32_MAX                      // ring entry length meaning "continue at the start"
+#define TRANSPORT_PEER_CHECK_MS 100                    // shm: how often a blocked side checks on the other one
+
+typedef struct {
+  _Atomic uint64_t head;  // next byte the sender writes; only the sender stores it
+  _Atomic uint64_t tail;  // next byte the receiver reads; only the receiver stores it
+  _Atomic int closed;     // the sender has closed
+  _Atomic int sender_waiting;
+  sem_t frames;  // one post per frame (and one at close)
+  sem_t space;   // posted by the receiver when the sender is waiting for room
+  uint64_t size;
+  char data[] __attribute__((aligned(64)));
+} TransportRing;
+
+typedef struct Transport Transport;
+
+typedef struct {
+  const char* name;
+  size_t max_frame;  // longest frame send_frame() accepts
+  int (*open)(Transport* t, const char* name);
+  int (*attach)(Transport* t, int role);
+  int (*send_frame)(Transport* t, const void* data, size_t len);
+  const void* (*borrow)(Transport* t, size_t* len);
+  int (*release)(Transport* t);
+  int (*close)(Transport* t);
+} TransportOps;
+
+struct Transport {
+  const TransportOps* ops;
+  int role;
+  int fds[2];      // pipe/socketpair ends before attach(); fds[0] is the one in use afterwards (shm: liveness pipe)
+  char path[108];  // FIFO path
+  TransportRing* ring;
+  size_t ring_bytes;
+  uint64_t release_to;  // shm: tail after the borrowed frame
+  char* buffer;         // fd transports: storage behind borrow()
+  size_t buffer_size;
+  void* mapped;         // memfd: mapping behind the borrowed frame
+  size_t mapped_len;
+};
+
+//--------------------------------------------------------------------------------
+// File-descriptor transports: pipe, fifo, unix
+//--------------------------------------------------------------------------------
+
+static inline int transport_write_all(int fd, const void* buffer, size_t bytes) {
+  const char* ptr = buffer;
+  while (bytes > 0) {
+    ssize_t written = write(fd, ptr, bytes);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return -1;
+    }
+    ptr += written;
+    bytes -= written;
+  }
+  return 0;
+}
+
+// Returns 1 once bytes were read, 0 at end-of-stream before the first byte, -1 on failure or a truncated read
+static inline int transport_read_all(int fd, void* buffer, size_t bytes) {
+  char* ptr    = buffer;
+  size_t total = 0;
+  while (total < bytes) {
+    ssize_t got = read(fd, ptr + total, bytes - total);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got == -1) {
+      return -1;
+    }
+    if (got == 0) {
+      if (total == 0) {
+        return 0;
+      }
+      errno = EPIPE;
+      return -1;
+    }
+    total += got;
+  }
+  return 1;
+}
+
+static inline int fd_send_frame(Transport* t, const void* data, size_t len) {
+  if (len >= UINT32_MAX) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  uint32_t header     = (uint32_t)len;
+  struct iovec iov[2] = {{&header, sizeof(header)}, {(void*)data, len}};
+  size_t total        = sizeof(header) + len;
+
+  // One writev() in the common case; finish with plain writes if it comes back short
+  ssize_t written;
+  while ((written = writev(t->fds[0], iov, 2)) == -1 && errno == EINTR) {
+  }
+  if (written == -1) {
+    return -1;
+  }
+  if ((size_t)written == total) {
+    return 0;
+  }
+  if ((size_t)written < sizeof(header)) {
+    if (transport_write_all(t->fds[0], (char*)&header + written, sizeof(header) - written) == -1) {
+      return -1;
+    }
+    written = sizeof(header);
+  }
+  return transport_write_all(t->fds[0], (const char*)data + (written - sizeof(header)), total - written);
+}
+
+static inline const void* fd_borrow(Transport* t, size_t* len) {
+  uint32_t header;
+  int ret = transport_read_all(t->fds[0], &header, sizeof(header));
+  if (ret <= 0) {
+    if (ret == 0) {
+      errno = 0;
+    }
+    return NULL;
+  }
+
+  if ((size_t)header + 1 > t->buffer_size) {
+    char* bigger = realloc(t->buffer, (size_t)header + 1);
+    if (bigger == NULL) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    t->buffer      = bigger;
+    t->buffer_size = (size_t)header + 1;
+  }
+  if (header > 0 && (ret = transport_read_all(t->fds[0], t->buffer, header)) != 1) {
+    if (ret == 0) {
+      errno = EPIPE;  // the sender went away in the middle of a frame
+    }
+    return NULL;
+  }
+  *len = header;
+  return t->buffer;
+}
+
+static inline int fd_release(Transport* t) {
+  (void)t;
+  return 0;
+}
+
+static inline int fd_close(Transport* t) {
+  free(t->buffer);
+  t->buffer = NULL;
+  return close(t->fds[0]);
+}
+
+// Keeps the end this role uses in fds[0] and closes the other
+static inline int fd_pair_attach(Transport* t, int role, int keep_for_sender, int keep_for_receiver) {
+  int keep  = role == TRANSPORT_SENDER ? keep_for_sender : keep_for_receiver;
+  int other = 1 - keep;
+  if (close(t->fds[other]) == -1) {
+    return -1;
+  }
+  t->fds[0] = t->fds[keep];
+  t->fds[1] = -1;
+  return 0;
+}
+
+// A write to a pipe or socket without a reader raises SIGPIPE, which kills the process before write() can
+// return EPIPE; ignored, the write just fails
+static inline int fd_ignore_sigpipe(int role) {
+  if (role != TRANSPORT_SENDER) {
+    return 0;
+  }
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = SIG_IGN;
+  return sigaction(SIGPIPE, &sa, NULL);
+}
+
+static inline int pipe_open(Transport* t, const char* name) {
+  (void)name;
+  return pipe(t->fds);
+}
+
+static inline int pipe_attach(Transport* t, int role) {
+  if (fd_ignore_sigpipe(role) == -1) {
+    return -1;
+  }
+  return fd_pair_attach(t, role, 1, 0);  // the sender writes to [1], the receiver reads from [0]
+}
+
+static inline int unix_open(Transport* t, const char* name) {
+  (void)name;
+  return socketpair(AF_UNIX, SOCK_STREAM, 0, t->fds);
+}
+
+static inline int unix_attach(Transport* t, int role) {
+  if (fd_ignore_sigpipe(role) == -1) {
+    return -1;
+  }
+  return fd_pair_attach(t, role, 0, 1);
+}
+
+// Fails with EEXIST rather than share a FIFO with another run; the default path is per process
+static inline int fifo_open(Transport* t, const char* name) {
+  if (name != NULL) {
+    snprintf(t->path, sizeof(t->path), "%s", name);
+  } else {
+    snprintf(t->path, sizeof(t->path), "%s.%ld", TRANSPORT_FIFO_PATH, (long)getpid());
+  }
+  return mkfifo(t->path, 0600);
+}
+
+// open() of a FIFO blocks until the other side opens it too, so both ends exist once it returns
+static inline int fifo_attach(Transport* t, int role) {
+  if (fd_ignore_sigpipe(role) == -1) {
+    return -1;
+  }
+  t->fds[0] = open(t->path, role == TRANSPORT_SENDER ? O_WRONLY : O_RDONLY);
+  if (t->fds[0] == -1) {
+    return -1;
+  }
+  if (role == TRANSPORT_RECEIVER && unlink(t->path) == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------------------
+// Shared-memory ring: shm
+//--------------------------------------------------------------------------------
+
+#define RING_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+#define RING_ENTRY_HEADER 8  // uint32_t length, padded so payloads stay 8-byte aligned
+
+// The ring is shared with the child through fork() alone, so it needs no name another run could open too
+static inline int ring_open(Transport* t, const char* name) {
+  (void)name;
+  t->ring_bytes = sizeof(TransportRing) + TRANSPORT_RING_SIZE;
+  t->ring       = mmap(NULL, t->ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (t->ring == MAP_FAILED) {
+    return -1;
+  }
+
+  TransportRing* ring = t->ring;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->closed, 0);
+  atomic_init(&ring->sender_waiting, 0);
+  ring->size = TRANSPORT_RING_SIZE;
+  // O_CLOEXEC: a program exec()ed by either side must not keep the other's end of the liveness pipe open
+  if (sem_init(&ring->frames, 1, 0) == -1 || sem_init(&ring->space, 1, 0) == -1 || pipe2(t->fds, O_CLOEXEC) == -1) {
+    int err = errno;
+    munmap(t->ring, t->ring_bytes);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+static inline int ring_attach(Transport* t, int role) {
+  return fd_pair_attach(t, role, 1, 0);  // nothing is ever written: only the hang-up of the other end matters
+}
+
+// The other process exited (or closed) without transport_close(): its end of the liveness pipe is gone
+static inline int ring_peer_gone(Transport* t) {
+  struct pollfd pfd = {t->fds[0], 0, 0};  // POLLHUP (read end) and POLLERR (write end) need no request
+  return poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLHUP | POLLERR)) != 0;
+}
+
+// Waits for a post on sem; fails with EPIPE once the other side is gone without posting
+static inline int ring_wait(Transport* t, sem_t* sem) {
+  while (1) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);  // sem_timedwait() takes a CLOCK_REALTIME deadline
+    deadline.tv_nsec += TRANSPORT_PEER_CHECK_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    if (sem_timedwait(sem, &deadline) == 0) {
+      return 0;
+    }
+    if (errno != EINTR && errno != ETIMEDOUT) {
+      return -1;
+    }
+    if (ring_peer_gone(t)) {
+      if (sem_trywait(sem) == 0) {
+        return 0;  // posted just before it went away
+      }
+      errno = EPIPE;
+      return -1;
+    }
+  }
+}
+
+// Blocks until free space reaches need bytes
+static inline int ring_wait_space(Transport* t, uint64_t head, uint64_t need) {
+  TransportRing* ring = t->ring;
+  while (1) {
+    if (ring->size - (head - atomic_load_explicit(&ring->tail, memory_order_acquire)) >= need) {
+      return 0;
+    }
+    // Announce the wait, then check again so that a release in between is not missed
+    atomic_store_explicit(&ring->sender_waiting, 1, memory_order_seq_cst);
+    if (ring->size - (head - atomic_load_explicit(&ring->tail, memory_order_seq_cst)) >= need) {
+      atomic_store_explicit(&ring->sender_waiting, 0, memory_order_relaxed);
+      return 0;
+    }
+    if (ring_wait(t, &ring->space) == -1) {
+      return -1;
+    }
+  }
+}
+
+static inline int ring_send_frame(Transport* t, const void* data, size_t len) {
+  TransportRing* ring = t->ring;
+  uint64_t need       = RING_ENTRY_HEADER + RING_ALIGN(len);
+  if (need > ring->size / 2) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  uint64_t head   = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint64_t to_end = ring->size - (head & (ring->size - 1));
+  if (to_end < need) {
+    // Not enough contiguous room before the end: mark the rest as skipped and start over at offset 0
+    if (ring_wait_space(t, head, to_end + need) == -1) {
+      return -1;
+    }
+    uint32_t wrap = TRANSPORT_WRAP;
+    memcpy(ring->data + (head & (ring->size - 1)), &wrap, sizeof(wrap));
+    head += to_end;
+  } else if (ring_wait_space(t, head, need) == -1) {
+    return -1;
+  }
+
+  char* entry     = ring->data + (head & (ring->size - 1));
+  uint32_t header = (uint32_t)len;
+  memcpy(entry, &header, sizeof(header));
+  memcpy(entry + RING_ENTRY_HEADER, data, len);
+  atomic_store_explicit(&ring->head, head + need, memory_order_release);
+  return sem_post(&ring->frames);
+}
+
+static inline const void* ring_borrow(Transport* t, size_t* len) {
+  TransportRing* ring = t->ring;
+  if (ring_wait(t, &ring->frames) == -1) {
+    if (errno == EPIPE) {
+      errno = 0;  // the sender exited without closing: end-of-stream, as a pipe would report it
+    }
+    return NULL;
+  }
+
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail == head) {
+    errno = 0;  // the post came from close(): end-of-stream
+    sem_post(&ring->frames);
+    return NULL;
+  }
+
+  uint32_t header;
+  memcpy(&header, ring->data + (tail & (ring->size - 1)), sizeof(header));
+  if (header == TRANSPORT_WRAP) {
+    tail += ring->size - (tail & (ring->size - 1));
+    memcpy(&header, ring->data, sizeof(header));
+  }
+  t->release_to = tail + RING_ENTRY_HEADER + RING_ALIGN(header);
+  *len          = header;
+  return ring->data + (tail & (ring->size - 1)) + RING_ENTRY_HEADER;
+}
+
+static inline int ring_release(Transport* t) {
+  TransportRing* ring = t->ring;
+  atomic_store_explicit(&ring->tail, t->release_to, memory_order_seq_cst);
+  if (atomic_exchange_explicit(&ring->sender_waiting, 0, memory_order_seq_cst)) {
+    return sem_post(&ring->space);
+  }
+  return 0;
+}
+
+static inline int ring_close(Transport* t) {
+  if (t->role == TRANSPORT_SENDER) {
+    atomic_store_explicit(&t->ring->closed, 1, memory_order_release);
+    sem_post(&t->ring->frames);
+  }
+  if (close(t->fds[0]) == -1) {
+    int err = errno;
+    munmap(t->ring, t->ring_bytes);
+    errno = err;
+    return -1;
+  }
+  return munmap(t->ring, t->ring_bytes);
+}
+
+//--------------------------------------------------------------------------------
+// Descriptor passing: memfd
+//--------------------------------------------------------------------------------
+// int memfd_create(const char* name, unsigned flags);
+// Brief: Creates an anonymous file that lives in memory and returns a descriptor for it
+//
+// Parameters: name  - Shows up in /proc/<pid>/fd, need not be unique
+//             flags - MFD_ALLOW_SEALING so that fcntl(F_ADD_SEALS) may be used; MFD_CLOEXEC
+//
+// Returns: file descriptor on success; -1 on failure, setting errno to indicate the error
+//
+// Search memfd_create(2) for more information
+//--------------------------------------------------------------------------------
+// int fcntl(int fd, F_ADD_SEALS, int seals);
+// Brief: Adds seals that restrict what anyone holding the file may do with it from now on
+//
+// Parameters: seals - F_SEAL_WRITE:  no more writes, and no writable shared mappings (EBUSY while one exists)
+//                     F_SEAL_SHRINK: the file cannot get smaller, so a mapping of it can never SIGBUS
+//                     F_SEAL_GROW:   the file cannot get bigger
+//                     F_SEAL_SEAL:   no more seals can be added or removed
+//
+// Notes:
+// - With all four the contents are immutable, so the receiver can map the file and use it without a copy
+//   and without trusting the sender not to change it underneath
+//
+// Search memfd_create(2) ("File sealing") for more information
+//--------------------------------------------------------------------------------
+// ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags);
+// Brief: Sends a message on a socket, optionally with ancillary (control) data
+//
+// Notes:
+// - A control message of level SOL_SOCKET and type SCM_RIGHTS carries file descriptors: the receiver gets
+//   new descriptors to the same open files, as if they had been dup()ed across processes
+// - On a SOCK_SEQPACKET socket every sendmsg() arrives as one recvmsg(), so each frame is one message:
+//   { offset, length } as data and the memfd as SCM_RIGHTS
+//
+// Search unix(7) and cmsg(3) for more information
+//--------------------------------------------------------------------------------
+// Zero-copy use: the sender writes straight into a memfd mapping and hands it over
+//   MemfdBuffer b;
+//   memfd_buffer_create(&b, size);    // b.data is a writable mapping of a fresh memfd
+//   fill(b.data, size);
+//   memfd_buffer_send(&t, &b, 0, size);  // unmaps, seals, sends and closes it
+// transport_send_frame() on memfd copies the frame into a new memfd first, for use through the generic interface
+//--------------------------------------------------------------------------------
+
+#define MEMFD_SEALS (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+typedef struct {
+  uint64_t offset;  // where the frame starts in the memfd
+  uint64_t length;
+} MemfdFrame;
+
+typedef struct {
+  int fd;
+  char* data;  // writable shared mapping until memfd_buffer_send()
+  size_t size;
+} MemfdBuffer;
+
+static inline int memfd_open(Transport* t, const char* name) {
+  (void)name;
+  return socketpair(AF_UNIX, SOCK_SEQPACKET, 0, t->fds);
+}
+
+static inline int memfd_attach(Transport* t, int role) {
+  return fd_pair_attach(t, role, 0, 1);
+}
+
+static inline int memfd_buffer_create(MemfdBuffer* b, size_t size) {
+  b->size = size;
+  b->data = NULL;
+  b->fd   = memfd_create("transport", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (b->fd == -1) {
+    return -1;
+  }
+  if (ftruncate(b->fd, size) == -1) {
+    int err = errno;
+    close(b->fd);
+    errno = err;
+    return -1;
+  }
+  if (size > 0) {
+    // MAP_POPULATE allocates all pages in one go instead of one fault per page while filling
+    b->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, b->fd, 0);
+    if (b->data == MAP_FAILED) {
+      int err = errno;
+      close(b->fd);
+      errno = err;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Sends an already sealed memfd with the frame it holds
+static inline int memfd_send_fd(Transport* t, int fd, size_t offset, size_t len) {
+  MemfdFrame frame   = {offset, len};
+  struct iovec iov   = {&frame, sizeof(frame)};
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg  = {0};
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level     = SOL_SOCKET;
+  cmsg->cmsg_type      = SCM_RIGHTS;
+  cmsg->cmsg_len       = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  ssize_t sent;
+  while ((sent = sendmsg(t->fds[0], &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR) {
+  }
+  return sent == -1 ? -1 : 0;
+}
+
+// Hands the buffer over: the mapping is dropped (F_SEAL_WRITE needs that), the file sealed and sent, the fd closed
+static inline int memfd_buffer_send(Transport* t, MemfdBuffer* b, size_t offset, size_t len) {
+  if (offset > b->size || len > b->size - offset) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (b->data != NULL && munmap(b->data, b->size) == -1) {
+    return -1;
+  }
+  b->data = NULL;
+
+  int ret = fcntl(b->fd, F_ADD_SEALS, MEMFD_SEALS) == -1 ? -1 : memfd_send_fd(t, b->fd, offset, len);
+  int err = errno;
+  close(b->fd);
+  b->fd = -1;
+  errno = err;
+  return ret;
+}
+
+static inline int memfd_send_frame(Transport* t, const void* data, size_t len) {
+  MemfdBuffer b;
+  if (memfd_buffer_create(&b, len) == -1) {
+    return -1;
+  }
+  if (len > 0) {
+    memcpy(b.data, data, len);
+  }
+  return memfd_buffer_send(t, &b, 0, len);
+}
+
+static inline int memfd_release(Transport* t) {
+  if (t->mapped == NULL) {
+    return 0;
+  }
+  int ret       = munmap(t->mapped, t->mapped_len);
+  t->mapped     = NULL;
+  t->mapped_len = 0;
+  return ret;
+}
+
+// Receives the next memfd and maps the frame read-only; the mapping is the borrowed frame
+static inline const void* memfd_borrow(Transport* t, size_t* len) {
+  MemfdFrame frame;
+  struct iovec iov = {&frame, sizeof(frame)};
+  union {
+    char buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg  = {0};
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  ssize_t got;
+  while ((got = recvmsg(t->fds[0], &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR) {
+  }
+  if (got <= 0) {
+    if (got == 0) {
+      errno = 0;
+    }
+    return NULL;
+  }
+
+  int fd               = -1;
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  if (fd == -1 || got != sizeof(frame) || (msg.msg_flags & MSG_CTRUNC)) {
+    if (fd != -1) {
+      close(fd);
+    }
+    errno = EPROTO;
+    return NULL;
+  }
+
+  // Only trust files the sender can no longer change, and frames that lie inside them
+  struct stat st;
+  int seals = fcntl(fd, F_GET_SEALS);
+  int error = 0;
+  if (seals == -1 || fstat(fd, &st) == -1) {
+    error = errno;
+  } else if ((seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK)) {
+    error = EPERM;
+  } else if (frame.offset > (uint64_t)st.st_size || frame.length > (uint64_t)st.st_size - frame.offset) {
+    error = EINVAL;
+  }
+
+  static const char empty[1];
+  const char* data = empty;
+  if (error == 0 && frame.length > 0) {
+    // mmap() offsets must be page aligned, so map from the page the frame starts in
+    size_t page   = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start  = (size_t)frame.offset & ~(page - 1);
+    t->mapped_len = (size_t)frame.offset + (size_t)frame.length - start;
+    t->mapped     = mmap(NULL, t->mapped_len, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, start);
+    if (t->mapped == MAP_FAILED) {
+      error     = errno;
+      t->mapped = NULL;
+    } else {
+      data = (const char*)t->mapped + (frame.offset - start);
+    }
+  }
+  close(fd);  // the mapping keeps the file alive
+  if (error != 0) {
+    errno = error;
+    return NULL;
+  }
+  *len = (size_t)frame.length;
+  return data;
+}
+
+static inline int memfd_close(Transport* t) {
+  memfd_release(t);
+  return close(t->fds[0]);
+}
+
+//--------------------------------------------------------------------------------
+// Registry and the public interface
+//--------------------------------------------------------------------------------
+
+static const TransportOps TRANSPORTS[] = {
+    {"pipe", UINT32_MAX - 1, pipe_open, pipe_attach, fd_send_frame, fd_borrow, fd_release, fd_close},
+    {"fifo", UINT32_MAX - 1, fifo_open, fifo_attach, fd_send_frame, fd_borrow, fd_release, fd_close},
+    {"shm", TRANSPORT_SHM_MAX_FRAME, ring_open, ring_attach, ring_send_frame, ring_borrow, ring_release, ring_close},
+    {"unix", UINT32_MAX - 1, unix_open, unix_attach, fd_send_frame, fd_borrow, fd_release, fd_close},
+    {"memfd", SIZE_MAX, memfd_open, memfd_attach, memfd_send_frame, memfd_borrow, memfd_release, memfd_close},
+};
+
+#define TRANSPORT_COUNT (sizeof(TRANSPORTS) / sizeof(TRANSPORTS[0]))
+
+static inline const TransportOps* transport_find(const char* name) {
+  for (size_t i = 0; i < TRANSPORT_COUNT; i++) {
+    if (strcmp(TRANSPORTS[i].name, name) == 0) {
+      return &TRANSPORTS[i];
+    }
+  }
+  return NULL;
+}
+
+// Creates the channel; call before fork(). name is the FIFO path, NULL for a per-process default; others ignore it
+static inline int transport_open(Transport* t, const TransportOps* ops, const char* name) {
+  memset(t, 0, sizeof(*t));
+  t->ops    = ops;
+  t->fds[0] = -1;
+  t->fds[1] = -1;
+  if (ops == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return ops->open(t, name);
+}
+
+// Picks this process's side of the channel; call after fork() in both processes
+static inline int transport_attach(Transport* t, int role) {
+  t->role = role;
+  return t->ops->attach(t, role);
+}
+
+// Longest frame this transport can carry; send_frame() fails with EMSGSIZE above it
+static inline size_t transport_max_frame(const Transport* t) {
+  return t->ops->max_frame;
+}
+
+static inline int transport_send_frame(Transport* t, const void* data, size_t len) {
+  return t->ops->send_frame(t, data, len);
+}
+
+// Receives the next frame without copying it out; valid until transport_release()
+static inline const void* transport_borrow(Transport* t, size_t* len) {
+  return t->ops->borrow(t, len);
+}
+
+static inline int transport_release(Transport* t) {
+  return t->ops->release(t);
+}
+
+// Copies the next frame into buffer; returns its length, 0 at end-of-stream, TRANSPORT_EMPTY_FRAME for an empty frame
+static inline ssize_t transport_recv_frame(Transport* t, void* buffer, size_t size) {
+  size_t len;
+  const void* data = transport_borrow(t, &len);
+  if (data == NULL) {
+    return errno == 0 ? 0 : -1;
+  }
+  ssize_t ret = len == 0 ? TRANSPORT_EMPTY_FRAME : (ssize_t)len;
+  if (len > size) {
+    errno = EMSGSIZE;
+    ret   = -1;
+  } else {
+    memcpy(buffer, data, len);
+  }
+  if (transport_release(t) == -1) {
+    return -1;
+  }
+  return ret;
+}
+
+static inline int transport_close(Transport* t) {
+  return t->ops->close(t);
+}
+
+#endif  // TRANSPORT_H
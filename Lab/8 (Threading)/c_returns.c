@@ -1,7 +1,11 @@
+#define _GNU_SOURCE
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../common/perf_region.h"
+#include "../common/thread_stats.h"
+
 // This demonstrates how to safely return values from threads using heap-allocated memory.
 // The thread function performs computations and returns a malloc-ed result.
 // The calling function is responsible for freeing the returned result, while the thread function must free any "consumed" argument data
@@ -20,6 +24,7 @@ typedef struct {
 
 // function to sum a passed array and return it
 void* array_sum(void* arg) {
+  thread_stats_begin("array_sum");
   if (arg == NULL) {
     return NULL;  // passed arg is NULL
   }
@@ -38,9 +43,12 @@ void* array_sum(void* arg) {
   }
   ret_val->sum = 0;
 
+  PerfRegion region;
+  perf_region_begin(&region, "array_sum");
   for (size_t i = 0; i < argument->n; i++) {
     ret_val->sum += argument->arr[i];
   }
+  perf_region_end(&region);
 
   free(arg);  // since the function "consumes" the argument, remember to free it in here
 
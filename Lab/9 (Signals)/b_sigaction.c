@@ -1,9 +1,12 @@
+#define _GNU_SOURCE
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/wait.h>
 #include <unistd.h>  // for pause()
 
+#include "../common/spawn.h"
+
 //--------------------------------------------------------------------------------
 // int sigaction (int sig, const struct sigaction* new_act, struct sigaction* old_act);
 // Brief: Sets a callable function when a signal is detected by a thread (preferred over signal())
@@ -58,7 +61,26 @@ void handle_sigint(int sig) {
   exit(0);
 }
 
-int main() {
+void child_process() {
+  printf("Child: Sleeping for 3 seconds\n");
+  sleep(3);
+  printf("Child: Exiting\n");
+  exit(0);
+}
+
+// -s picks how the child is created: fork (default), vfork, posix_spawn or clone (see ../common/spawn.h)
+// -> all four deliver SIGCHLD to the parent when the child exits
+int main(int argc, char* argv[]) {
+  if (spawn_is_child(argc, argv)) {  // re-run by -s vfork|posix_spawn|clone
+    child_process();
+  }
+
+  SpawnMode mode = SPAWN_FORK;
+  if (spawn_parse_args(argc, argv, &mode) == -1) {
+    fprintf(stderr, "Usage: ./b_sigaction [-s fork|vfork|posix_spawn|clone]\n");
+    exit(1);
+  }
+
   // Set SIGCHLD handler
   struct sigaction sa_chld;
   sa_chld.sa_handler = handle_sigchld;
@@ -72,13 +94,16 @@ int main() {
   // Set SIGINT handler
   signal(SIGINT, handle_sigint);  // using signal() for simplicity
 
-  pid_t pid = fork();
+  // The exec modes start the child with default dispositions, as exec always resets handled signals
+  char* child_argv[] = {SPAWN_SELF, SPAWN_CHILD_ARG, NULL};
+  pid_t pid          = spawn_child(mode, child_argv, NULL, 0);
+  if (pid == -1) {
+    perror("spawn_child");
+    exit(1);
+  }
   if (pid == 0) {
     // Child process
-    printf("Child: Sleeping for 3 seconds\n");
-    sleep(3);
-    printf("Child: Exiting\n");
-    exit(0);
+    child_process();
   }
 
   // Parent process
@@ -1,15 +1,23 @@
+#define _GNU_SOURCE
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../common/fast_format.h"
+#include "../common/perf_region.h"
+#include "../common/thread_stats.h"
+
 typedef struct {
   size_t n;
   int* arr;
 } Array;
 
 void* Sort(void* arg) {
+  thread_stats_begin("Sort");
   Array* a = (Array*)arg;
 
+  PerfRegion region;
+  perf_region_begin(&region, "Sort");
   for (size_t i = 0; i < a->n; i++) {
     for (size_t j = i + 1; j < a->n; j++) {
       if (a->arr[i] > a->arr[j]) {
@@ -19,6 +27,7 @@ void* Sort(void* arg) {
       }
     }
   }
+  perf_region_end(&region);
 
   return NULL;
 }
@@ -78,11 +87,16 @@ int main() {
 
   Array* result = Merge(&left, &right);
 
-  printf("Sorted array: ");
+  static FmtBuffer out;
+  fmt_str(&out, "Sorted array: ");
   for (size_t i = 0; i < result->n; i++) {
-    printf("%d ", result->arr[i]);
+    fmt_int(&out, result->arr[i]);
+    fmt_char(&out, ' ');
+  }
+  fmt_char(&out, '\n');
+  if (fmt_flush(&out, STDOUT_FILENO) == -1) {
+    perror("write");
   }
-  printf("\n");
 
   free(a.arr);
   free(result->arr);
@@ -1,7 +1,12 @@
+#define _GNU_SOURCE
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../common/fast_format.h"
+#include "../common/perf_region.h"
+#include "../common/thread_stats.h"
+
 #define MATRIX_SIZE 3
 
 typedef struct {
@@ -18,6 +23,7 @@ typedef struct {
 } InnerProductParamter;
 
 void* InnerProduct(void* arg) {
+  thread_stats_begin("InnerProduct");
   if (arg == NULL) {
     fprintf(stderr, "NULL arg passed\n");
     return NULL;
@@ -25,10 +31,13 @@ void* InnerProduct(void* arg) {
 
   InnerProductParamter* param = (InnerProductParamter*)arg;
 
+  PerfRegion region;
+  perf_region_begin(&region, "InnerProduct");
   int sum = 0;
   for (size_t i = 0; i < MATRIX_SIZE; i++) {
     sum += a.data[param->a_idx][i] * b.data[i][param->b_idx];
   }
+  perf_region_end(&region);
   r.data[param->a_idx][param->b_idx] = sum;
 
   free(arg);
@@ -86,11 +95,16 @@ int main() {
     }
   }
 
-  printf("Result:\n");
+  static FmtBuffer out;
+  fmt_str(&out, "Result:\n");
   for (size_t i = 0; i < MATRIX_SIZE; i++) {
     for (size_t j = 0; j < MATRIX_SIZE; j++) {
-      printf("%d ", r.data[i][j]);
+      fmt_int(&out, r.data[i][j]);
+      fmt_char(&out, ' ');
     }
-    putchar('\n');
+    fmt_char(&out, '\n');
+  }
+  if (fmt_flush(&out, STDOUT_FILENO) == -1) {
+    perror("write");
   }
 }
\ No newline at end of file
@@ -1,20 +1,204 @@
+#define _GNU_SOURCE
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define BUFFER_SIZE 1024
+#include "../common/perf_region.h"
+#include "q3_methods.h"
+#include "q3_tree.h"
 
-int main(int argc, char* argv[]) {
-  if (argc != 3) {
-    fprintf(stderr, "Usage: ./q3 <source> <destination>\n");
+void usage() {
+  fprintf(stderr, "Usage: ./q3 [-m method] [-b block_size] [-q queue_depth] [-t threads] [-F] [-D] [-c] [-r] [-V] [-H sidecar] [-v] <source> <destination>...\n");
+  fprintf(stderr, "Methods:");
+  for (size_t i = 0; i < METHOD_COUNT; i++) {
+    fprintf(stderr, " %s", METHODS[i].name);
+  }
+  fprintf(stderr, " cmp");
+  fprintf(stderr, "\nFan-out methods (more than one destination):");
+  for (size_t i = 0; i < FANOUT_METHOD_COUNT; i++) {
+    fprintf(stderr, " %s", FANOUT_METHODS[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+// Copies the source to every destination, reading it only once
+int fan_out(const char* method_name, const char* src_name, char* dst_names[], unsigned n, const CopyOptions* opt) {
+  const FanoutMethodEntry* method = find_fanout_method(strcmp(method_name, "rw") == 0 ? "fanout" : method_name);
+  if (method == NULL) {
+    fprintf(stderr, "Unknown fan-out method: %s\n", method_name);
+    usage();
+  }
+  if (n > FANOUT_MAX_DESTINATIONS) {
+    fprintf(stderr, "At most %d destinations\n", FANOUT_MAX_DESTINATIONS);
+    usage();
+  }
+
+  int src_fd = open(src_name, O_RDONLY);
+  if (src_fd == -1) {
+    perror("open source");
     exit(EXIT_FAILURE);
   }
+  if (opt->cold) {
+    (void)posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+
+  int dst_fds[FANOUT_MAX_DESTINATIONS];
+  for (unsigned i = 0; i < n; i++) {
+    if ((dst_fds[i] = open(dst_names[i], DST_TRUNCATE, 0666)) == -1) {
+      perror(dst_names[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  CopyStats stats = {0};
+  double start    = now_seconds();
+  int ret         = method->copy(src_fd, dst_fds, n, opt, &stats);
+  stats.seconds   = now_seconds() - start;
+  if (ret == -1) {
+    perror(method->name);
+  } else if (opt->verbose) {
+    // bytes counts every destination, so the throughput compares directly with n sequential copies
+    print_stats(method->name, &stats);
+  }
+
+  close(src_fd);
+  for (unsigned i = 0; i < n; i++) {
+    close(dst_fds[i]);
+  }
+  return ret;
+}
+
+// -m cmp: compares the two files instead of copying, with the exit status of cmp(1)
+int compare_files(const char* a_name, const char* b_name, const CopyOptions* opt) {
+  int a_fd = open(a_name, O_RDONLY);
+  if (a_fd == -1) {
+    perror(a_name);
+    return 2;
+  }
+  int b_fd = open(b_name, O_RDONLY);
+  if (b_fd == -1) {
+    perror(b_name);
+    close(a_fd);
+    return 2;
+  }
 
-  const char* src_name = argv[1];
-  const char* dst_name = argv[2];
+  CopyStats stats = {0};
+  uint64_t diff;
+  double start  = now_seconds();
+  int ret       = compare_mapped(a_fd, b_fd, &diff, &stats);
+  stats.seconds = now_seconds() - start;
+  close(a_fd);
+  close(b_fd);
+
+  if (ret == -1) {
+    perror("cmp");
+    return 2;
+  }
+  if (opt->verbose) {
+    print_stats("cmp", &stats);
+  }
+  if (ret == 1) {
+    struct stat a_st, b_st;
+    if (stat(a_name, &a_st) == 0 && stat(b_name, &b_st) == 0 && (uint64_t)a_st.st_size != (uint64_t)b_st.st_size &&
+        diff == (uint64_t)(a_st.st_size < b_st.st_size ? a_st.st_size : b_st.st_size)) {
+      printf("cmp: EOF on %s after byte %llu\n", a_st.st_size < b_st.st_size ? a_name : b_name, (unsigned long long)diff);
+    } else {
+      printf("%s %s differ: byte %llu\n", a_name, b_name, (unsigned long long)diff + 1);
+    }
+  }
+  return ret;
+}
+
+int main(int argc, char* argv[]) {
+  CopyOptions opt         = {0};
+  const char* method_name = "rw";
+
+  int c;
+  while ((c = getopt(argc, argv, "m:b:q:t:FDcrVH:v")) != -1) {
+    switch (c) {
+      case 'm':
+        method_name = optarg;
+        break;
+      case 'b':
+        if ((opt.block_size = parse_size(optarg)) == 0) {
+          usage();
+        }
+        break;
+      case 'q':
+        opt.queue_depth = (unsigned)atoi(optarg);
+        break;
+      case 't':
+        opt.threads = (unsigned)atoi(optarg);
+        break;
+      case 'F':
+        opt.fadvise = 1;
+        break;
+      case 'D':
+        opt.direct = 1;
+        break;
+      case 'c':
+        opt.cold = 1;
+        break;
+      case 'r':
+        opt.recursive = 1;
+        break;
+      case 'V':
+        opt.verify = 1;
+        break;
+      case 'H':
+        opt.sidecar = optarg;
+        break;
+      case 'v':
+        opt.verbose = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (argc - optind < 2 || (opt.recursive && argc - optind != 2)) {
+    usage();
+  }
+
+  if (strcmp(method_name, "cmp") == 0) {
+    if (argc - optind != 2) {
+      usage();
+    }
+    return compare_files(argv[optind], argv[optind + 1], &opt);
+  }
+
+  if (argc - optind > 2 || find_fanout_method(method_name) != NULL) {
+    return fan_out(method_name, argv[optind], &argv[optind + 1], argc - optind - 1, &opt) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  const CopyMethodEntry* method = find_method(method_name);
+  if (method == NULL) {
+    fprintf(stderr, "Unknown method: %s\n", method_name);
+    usage();
+  }
+
+  const char* src_name = argv[optind];
+  const char* dst_name = argv[optind + 1];
+
+  if (opt.recursive) {
+    CopyStats stats = {0};
+    double start    = now_seconds();
+    if (copy_tree(src_name, dst_name, &opt, &stats) == -1) {
+      perror("copy_tree");
+      exit(EXIT_FAILURE);
+    }
+    stats.seconds = now_seconds() - start;
+
+    if (opt.verbose) {
+      print_stats("tree", &stats);
+    }
+    return EXIT_SUCCESS;
+  }
 
   int src_fd = open(src_name, O_RDONLY);
   if (src_fd == -1) {
@@ -22,29 +206,35 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
 
-  int dst_fd = open(dst_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  int dst_fd = open_destination(dst_name, method, &opt);
   if (dst_fd == -1) {
     perror("open destination");
     close(src_fd);
     exit(EXIT_FAILURE);
   }
 
-  char buffer[BUFFER_SIZE];
-  ssize_t bytes_read;
-  while ((bytes_read = read(src_fd, buffer, BUFFER_SIZE)) > 0) {
-    ssize_t bytes_written = write(dst_fd, buffer, bytes_read);
-    if (bytes_written != bytes_read) {
-      perror("write");
-      close(src_fd);
-      close(dst_fd);
-      exit(EXIT_FAILURE);
-    }
+  if (opt.cold) {
+    // Cold-cache run: evict the source so the copy has to go to the device
+    (void)posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+
+  CopyStats stats = {0};
+  PerfRegion region;
+  perf_region_begin(&region, method->name);
+  double start = now_seconds();
+  if (method->copy(src_fd, dst_fd, &opt, &stats) == -1) {
+    perror(method->name);
+    close(src_fd);
+    close(dst_fd);
+    exit(EXIT_FAILURE);
   }
+  stats.seconds = now_seconds() - start;
+  perf_region_end(&region);
 
-  if (bytes_read == -1) {
-    perror("read");
+  if (opt.verbose) {
+    print_stats(method->name, &stats);
   }
 
   close(src_fd);
   close(dst_fd);
-}
\ No newline at end of file
+}
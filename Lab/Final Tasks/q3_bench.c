@@ -0,0 +1,425 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>  // for getrusage()
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "q3_methods.h"
+
+//--------------------------------------------------------------------------------
+// int getrusage(int who, struct rusage* usage);
+// Brief: Reports resource usage of the calling process (RUSAGE_SELF, all threads) or thread (RUSAGE_THREAD)
+//
+// Returns: 0 on success; -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - ru_utime is CPU time spent in user space, ru_stime CPU time spent in the kernel on our behalf
+//   -> In-kernel copies (sendfile, splice, copy_file_range) show up almost entirely as ru_stime
+// - Taking the difference of two calls gives the CPU time of the code in between
+//
+// Search getrusage(2) for more information
+//--------------------------------------------------------------------------------
+// Benchmark harness for the q3 copy methods
+// - Generates a source file of the requested size, leaving the requested share of 1 MiB chunks as holes
+// - Runs every method cold (source dropped with POSIX_FADV_DONTNEED) and warm (source read once beforehand)
+// - Prints one CSV row per run: wall time, throughput, user/system CPU time and syscalls
+//
+// Usage:
+//   ./q3_bench -s 1G -p 0 -n 3 -d /mnt/nvme > results.csv
+//   ./q3_bench -s 4G -p 50 -m rw,sparse,clone
+//   ./q3_bench -s 1G -m tuned -f 4     (also: fan-out to 4 destinations versus 4 sequential tuned copies)
+//   ./q3_bench -s 4G -m rw,mmap,mmapw -C   (also: cmp through mappings versus through read())
+//--------------------------------------------------------------------------------
+
+#define BENCH_CHUNK (1024 * 1024)
+#define DEFAULT_METHODS "rw,tuned,mmap,mmapw,sendfile,cfr,splice,parallel,uring"
+#define FANOUT_BASELINE "tuned"  // method used for the n sequential copies
+
+typedef struct {
+  size_t size;
+  unsigned sparse_percent;
+  unsigned runs;
+  int sync;         // include fdatasync() of the destination in the timing
+  unsigned fanout;  // destinations for the fan-out comparison, 0 to skip it
+  int compare;      // also time comparing the source with a copy
+  int quiet;        // print no CSV row (a copy that only sets up the next runs)
+  const char* dir;
+  char* methods;
+} BenchOptions;
+
+void usage() {
+  fprintf(stderr, "Usage: ./q3_bench [-s size] [-p sparse_percent] [-n runs] [-d dir] [-m method,...] [-t threads] [-f destinations] [-C] [-S]\n");
+  exit(EXIT_FAILURE);
+}
+
+double timeval_seconds(struct timeval tv) {
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+// Writes size bytes of pseudo-random data, skipping sparse_percent of the chunks so they stay holes
+int generate_source(const char* path, size_t size, unsigned sparse_percent) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return -1;
+  }
+
+  uint64_t* chunk = malloc(BENCH_CHUNK);
+  if (chunk == NULL) {
+    close(fd);
+    return -1;
+  }
+
+  uint64_t state    = 0x9e3779b97f4a7c15ULL;
+  uint64_t syscalls = 0;
+  for (size_t offset = 0; offset < size; offset += BENCH_CHUNK) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    if (state % 100 < sparse_percent) {
+      continue;  // leave a hole
+    }
+
+    for (size_t i = 0; i < BENCH_CHUNK / sizeof(uint64_t); i++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      chunk[i] = state;
+    }
+    size_t len = size - offset < BENCH_CHUNK ? size - offset : BENCH_CHUNK;
+    if (pwrite_all(fd, chunk, len, offset, &syscalls) == -1) {
+      free(chunk);
+      close(fd);
+      return -1;
+    }
+  }
+  free(chunk);
+
+  // Flush now so that later DONTNEED calls can actually evict the source
+  if (ftruncate(fd, size) == -1 || fsync(fd) == -1) {
+    close(fd);
+    return -1;
+  }
+  return close(fd);
+}
+
+// Warm run: pull the whole source into the page cache
+int warm_source(int fd) {
+  char* buffer = malloc(BENCH_CHUNK);
+  if (buffer == NULL) {
+    return -1;
+  }
+  ssize_t got;
+  while ((got = read(fd, buffer, BENCH_CHUNK)) > 0) {
+  }
+  free(buffer);
+  return got == -1 || lseek(fd, 0, SEEK_SET) == -1 ? -1 : 0;
+}
+
+int run_one(const BenchOptions* bench, const CopyMethodEntry* method, const CopyOptions* opt, const char* src_path, const char* dst_path,
+            int cold, unsigned run) {
+  unlink(dst_path);
+
+  int src_fd = open(src_path, O_RDONLY);
+  if (src_fd == -1) {
+    perror("open source");
+    return -1;
+  }
+
+  if (cold) {
+    (void)posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED);
+  } else if (warm_source(src_fd) == -1) {
+    perror("warm source");
+    close(src_fd);
+    return -1;
+  }
+
+  int dst_fd = open_destination(dst_path, method, opt);
+  if (dst_fd == -1) {
+    perror("open destination");
+    close(src_fd);
+    return -1;
+  }
+
+  struct rusage before, after;
+  CopyStats stats = {0};
+  getrusage(RUSAGE_SELF, &before);
+  double start = now_seconds();
+  int ret      = method->copy(src_fd, dst_fd, opt, &stats);
+  if (ret == 0 && bench->sync && fdatasync(dst_fd) == -1) {
+    ret = -1;
+  }
+  stats.seconds = now_seconds() - start;
+  getrusage(RUSAGE_SELF, &after);
+
+  if (ret == -1) {
+    perror(method->name);
+  }
+
+  struct stat st;
+  if (ret == 0 && (fstat(dst_fd, &st) == -1 || (size_t)st.st_size != bench->size)) {
+    fprintf(stderr, "%s: destination has the wrong size\n", method->name);
+    ret = -1;
+  }
+  close(src_fd);
+  close(dst_fd);
+  if (ret == -1) {
+    return -1;
+  }
+
+  if (bench->quiet) {
+    return 0;
+  }
+
+  double user = timeval_seconds(after.ru_utime) - timeval_seconds(before.ru_utime);
+  double sys  = timeval_seconds(after.ru_stime) - timeval_seconds(before.ru_stime);
+  double mibs = stats.seconds > 0 ? (double)bench->size / (1024.0 * 1024.0) / stats.seconds : 0;
+  printf("%s,%s,%u,%zu,%.6f,%.1f,%.6f,%.6f,%llu,%s\n", method->name, cold ? "cold" : "warm", run, bench->size, stats.seconds, mibs, user,
+         sys, (unsigned long long)stats.syscalls, stats.path != NULL ? stats.path : method->name);
+  fflush(stdout);
+  return 0;
+}
+
+// Closes and removes the first count fan-out destinations
+void close_destinations(const BenchOptions* bench, const int* dst_fds, unsigned count) {
+  char dst_path[4096];
+  for (unsigned i = 0; i < count; i++) {
+    close(dst_fds[i]);
+    snprintf(dst_path, sizeof(dst_path), "%s/q3_bench.dst%u", bench->dir, i);
+    unlink(dst_path);
+  }
+}
+
+// One fan-out run to bench->fanout destinations; a NULL fanout runs the baseline method once per destination
+int run_fanout(const BenchOptions* bench, const FanoutMethodEntry* fanout, const CopyOptions* opt, const char* src_path, int cold,
+               unsigned run) {
+  const CopyMethodEntry* baseline = find_method(FANOUT_BASELINE);
+  const char* name                = fanout != NULL ? fanout->name : "seq-" FANOUT_BASELINE;
+
+  int dst_fds[FANOUT_MAX_DESTINATIONS];
+  char dst_path[4096];
+  for (unsigned i = 0; i < bench->fanout; i++) {
+    snprintf(dst_path, sizeof(dst_path), "%s/q3_bench.dst%u", bench->dir, i);
+    if ((dst_fds[i] = open(dst_path, DST_TRUNCATE, 0644)) == -1) {
+      perror("open destination");
+      close_destinations(bench, dst_fds, i);
+      return -1;
+    }
+  }
+
+  int src_fd = open(src_path, O_RDONLY);
+  if (src_fd == -1 || (cold ? posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED) : warm_source(src_fd)) != 0) {
+    perror("open source");
+    if (src_fd != -1) {
+      close(src_fd);
+    }
+    close_destinations(bench, dst_fds, bench->fanout);
+    return -1;
+  }
+
+  struct rusage before, after;
+  CopyStats stats = {0};
+  getrusage(RUSAGE_SELF, &before);
+  double start = now_seconds();
+  int ret      = 0;
+  if (fanout != NULL) {
+    ret = fanout->copy(src_fd, dst_fds, bench->fanout, opt, &stats);
+  } else {
+    for (unsigned i = 0; i < bench->fanout && ret == 0; i++) {
+      // Every sequential copy after the first finds the source cached, as it would in practice
+      ret = lseek(src_fd, 0, SEEK_SET) == -1 ? -1 : baseline->copy(src_fd, dst_fds[i], opt, &stats);
+    }
+    stats.path = "sequential copies";
+  }
+  for (unsigned i = 0; i < bench->fanout && ret == 0 && bench->sync; i++) {
+    ret = fdatasync(dst_fds[i]);
+  }
+  stats.seconds = now_seconds() - start;
+  getrusage(RUSAGE_SELF, &after);
+
+  if (ret == -1) {
+    perror(name);
+  }
+  close(src_fd);
+  for (unsigned i = 0; i < bench->fanout; i++) {
+    struct stat st;
+    if (ret == 0 && (fstat(dst_fds[i], &st) == -1 || (size_t)st.st_size != bench->size)) {
+      fprintf(stderr, "%s: destination %u has the wrong size\n", name, i);
+      ret = -1;
+    }
+  }
+  close_destinations(bench, dst_fds, bench->fanout);
+  if (ret == -1) {
+    return -1;
+  }
+
+  // bytes and throughput count every destination
+  double user = timeval_seconds(after.ru_utime) - timeval_seconds(before.ru_utime);
+  double sys  = timeval_seconds(after.ru_stime) - timeval_seconds(before.ru_stime);
+  double mibs = stats.seconds > 0 ? (double)stats.bytes / (1024.0 * 1024.0) / stats.seconds : 0;
+  printf("%s,%s,%u,%llu,%.6f,%.1f,%.6f,%.6f,%llu,%s\n", name, cold ? "cold" : "warm", run, (unsigned long long)stats.bytes, stats.seconds,
+         mibs, user, sys, (unsigned long long)stats.syscalls, stats.path);
+  fflush(stdout);
+  return 0;
+}
+
+typedef int (*CompareFn)(int a_fd, int b_fd, uint64_t* diff, CopyStats* stats);
+
+// Compares the source with an identical copy at dst_path, so the whole file is always scanned
+int run_compare(const char* name, CompareFn compare, const char* src_path, const char* dst_path, int cold, unsigned run) {
+  int a_fd = open(src_path, O_RDONLY);
+  int b_fd = a_fd == -1 ? -1 : open(dst_path, O_RDONLY);
+  if (b_fd == -1) {
+    perror("open");
+    if (a_fd != -1) {
+      close(a_fd);
+    }
+    return -1;
+  }
+  if (cold) {
+    (void)posix_fadvise(a_fd, 0, 0, POSIX_FADV_DONTNEED);
+    (void)posix_fadvise(b_fd, 0, 0, POSIX_FADV_DONTNEED);
+  } else if (warm_source(a_fd) == -1 || warm_source(b_fd) == -1) {
+    perror("warm source");
+    close(a_fd);
+    close(b_fd);
+    return -1;
+  }
+
+  struct rusage before, after;
+  CopyStats stats = {0};
+  uint64_t diff;
+  getrusage(RUSAGE_SELF, &before);
+  double start  = now_seconds();
+  int ret       = compare(a_fd, b_fd, &diff, &stats);
+  stats.seconds = now_seconds() - start;
+  getrusage(RUSAGE_SELF, &after);
+  close(a_fd);
+  close(b_fd);
+  if (ret != 0) {
+    fprintf(stderr, "%s: %s\n", name, ret == -1 ? strerror(errno) : "files differ");
+    return -1;
+  }
+
+  double user = timeval_seconds(after.ru_utime) - timeval_seconds(before.ru_utime);
+  double sys  = timeval_seconds(after.ru_stime) - timeval_seconds(before.ru_stime);
+  double mibs = stats.seconds > 0 ? (double)stats.bytes / (1024.0 * 1024.0) / stats.seconds : 0;
+  printf("%s,%s,%u,%llu,%.6f,%.1f,%.6f,%.6f,%llu,%s\n", name, cold ? "cold" : "warm", run, (unsigned long long)stats.bytes, stats.seconds, mibs,
+         user, sys, (unsigned long long)stats.syscalls, stats.path);
+  fflush(stdout);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  BenchOptions bench = {256 * 1024 * 1024, 0, 3, 0, 0, 0, 0, ".", NULL};
+  CopyOptions opt    = {0};
+  char methods[]     = DEFAULT_METHODS;
+  bench.methods      = methods;
+
+  int c;
+  while ((c = getopt(argc, argv, "s:p:n:d:m:t:f:CS")) != -1) {
+    switch (c) {
+      case 's':
+        if ((bench.size = parse_size(optarg)) == 0) {
+          usage();
+        }
+        break;
+      case 'p':
+        bench.sparse_percent = (unsigned)atoi(optarg);
+        break;
+      case 'n':
+        bench.runs = (unsigned)atoi(optarg);
+        break;
+      case 'd':
+        bench.dir = optarg;
+        break;
+      case 'm':
+        bench.methods = optarg;
+        break;
+      case 't':
+        opt.threads = (unsigned)atoi(optarg);
+        break;
+      case 'f':
+        bench.fanout = (unsigned)atoi(optarg);
+        if (bench.fanout > FANOUT_MAX_DESTINATIONS) {
+          usage();
+        }
+        break;
+      case 'C':
+        bench.compare = 1;
+        break;
+      case 'S':
+        bench.sync = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  char src_path[4096], dst_path[4096];
+  snprintf(src_path, sizeof(src_path), "%s/q3_bench.src", bench.dir);
+  snprintf(dst_path, sizeof(dst_path), "%s/q3_bench.dst", bench.dir);
+
+  fprintf(stderr, "Generating %zu bytes (%u%% holes) in %s\n", bench.size, bench.sparse_percent, src_path);
+  if (generate_source(src_path, bench.size, bench.sparse_percent) == -1) {
+    perror("generate source");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("method,cache,run,bytes,seconds,mib_per_s,user_s,sys_s,syscalls,path\n");
+
+  int failed = 0;
+  for (char* name = strtok(bench.methods, ","); name != NULL; name = strtok(NULL, ",")) {
+    const CopyMethodEntry* method = find_method(name);
+    if (method == NULL) {
+      fprintf(stderr, "Unknown method: %s\n", name);
+      failed = 1;
+      continue;
+    }
+
+    for (int cold = 1; cold >= 0; cold--) {
+      for (unsigned run = 0; run < bench.runs; run++) {
+        if (run_one(&bench, method, &opt, src_path, dst_path, cold, run) == -1) {
+          failed = 1;
+        }
+      }
+    }
+  }
+
+  // Fan-out versus the same number of sequential copies
+  for (size_t i = 0; bench.fanout > 0 && i <= FANOUT_METHOD_COUNT; i++) {
+    const FanoutMethodEntry* fanout = i < FANOUT_METHOD_COUNT ? &FANOUT_METHODS[i] : NULL;
+    for (int cold = 1; cold >= 0; cold--) {
+      for (unsigned run = 0; run < bench.runs; run++) {
+        if (run_fanout(&bench, fanout, &opt, src_path, cold, run) == -1) {
+          failed = 1;
+        }
+      }
+    }
+  }
+
+  // Comparison through mappings versus through read(), against a fresh copy of the source
+  if (bench.compare) {
+    BenchOptions quiet = bench;
+    quiet.quiet        = 1;
+    int copied         = run_one(&quiet, find_method("tuned"), &opt, src_path, dst_path, 0, 0) == 0;
+    if (!copied) {
+      failed = 1;
+    }
+    for (int cold = 1; cold >= 0 && copied; cold--) {
+      for (unsigned run = 0; run < bench.runs; run++) {
+        if (run_compare("cmp-mmap", compare_mapped, src_path, dst_path, cold, run) == -1 ||
+            run_compare("cmp-read", compare_read, src_path, dst_path, cold, run) == -1) {
+          failed = 1;
+        }
+      }
+    }
+  }
+
+  unlink(src_path);
+  unlink(dst_path);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
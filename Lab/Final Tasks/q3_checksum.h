@@ -0,0 +1,192 @@
+#ifndef Q3_CHECKSUM_H
+#define Q3_CHECKSUM_H
+
+#include "q3_common.h"
+
+#include <fcntl.h>  // for posix_fadvise()
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>  // for _mm_crc32_u8(), _mm_crc32_u64()
+#define Q3_HAVE_SSE42_CRC 1
+#endif
+
+//--------------------------------------------------------------------------------
+// CRC32C (Castagnoli polynomial 0x1EDC6F41, reflected 0x82F63B78)
+// Brief: 32-bit checksum used by iSCSI, ext4/btrfs metadata and many storage formats
+//
+// Notes:
+// - SSE4.2 has a crc32 instruction for exactly this polynomial, 8 bytes per instruction
+//   -> The instruction is picked at runtime with __builtin_cpu_supports("sse4.2"), so the
+//      binary still runs (with the table version) on CPUs without it
+// - Without hardware support a slicing-by-8 table version handles 8 bytes per step
+// - crc32c(crc32c(0, a), b) == crc32c(0, a followed by b), so a file is checksummed block by block
+//   while each block is still in the copy buffer, without a second read pass
+//
+// Usage:
+//   uint32_t crc = 0;
+//   while ((n = read(fd, buffer, size)) > 0) {
+//     crc = crc32c(crc, buffer, n);
+//   }
+//--------------------------------------------------------------------------------
+
+#define CRC32C_POLY 0x82F63B78U
+#define CHECKSUM_BLOCK_SIZE (1024 * 1024)
+
+typedef uint32_t (*Crc32cFn)(uint32_t crc, const void* data, size_t bytes);
+
+static uint32_t crc32c_table[8][256];
+
+static inline uint32_t crc32c_sw(uint32_t crc, const void* data, size_t bytes) {
+  const unsigned char* p = data;
+  crc                    = ~crc;
+
+  while (bytes >= 8) {
+    uint64_t word;
+    __builtin_memcpy(&word, p, 8);
+    word ^= crc;  // little-endian: the low 4 bytes absorb the running crc
+    crc = crc32c_table[7][word & 0xff] ^ crc32c_table[6][(word >> 8) & 0xff] ^ crc32c_table[5][(word >> 16) & 0xff] ^
+          crc32c_table[4][(word >> 24) & 0xff] ^ crc32c_table[3][(word >> 32) & 0xff] ^ crc32c_table[2][(word >> 40) & 0xff] ^
+          crc32c_table[1][(word >> 48) & 0xff] ^ crc32c_table[0][word >> 56];
+    p += 8;
+    bytes -= 8;
+  }
+  while (bytes-- > 0) {
+    crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+
+  return ~crc;
+}
+
+#ifdef Q3_HAVE_SSE42_CRC
+__attribute__((target("sse4.2"))) static inline uint32_t crc32c_hw(uint32_t crc, const void* data, size_t bytes) {
+  const unsigned char* p = data;
+  uint64_t c             = ~crc;
+
+  // Align to 8 bytes, then 32 bytes per iteration to keep the crc32 unit busy
+  while (bytes > 0 && ((uintptr_t)p & 7) != 0) {
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+    bytes--;
+  }
+  while (bytes >= 32) {
+    const uint64_t* w = (const uint64_t*)p;
+    c                 = _mm_crc32_u64(c, w[0]);
+    c                 = _mm_crc32_u64(c, w[1]);
+    c                 = _mm_crc32_u64(c, w[2]);
+    c                 = _mm_crc32_u64(c, w[3]);
+    p += 32;
+    bytes -= 32;
+  }
+  while (bytes >= 8) {
+    c = _mm_crc32_u64(c, *(const uint64_t*)p);
+    p += 8;
+    bytes -= 8;
+  }
+  while (bytes-- > 0) {
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+  }
+
+  return ~(uint32_t)c;
+}
+#endif
+
+// Builds the tables and picks the fastest implementation; call once before crc32c()
+static inline Crc32cFn crc32c_init(const char** name) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+    }
+    crc32c_table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int t = 1; t < 8; t++) {
+      crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xff];
+    }
+  }
+
+#ifdef Q3_HAVE_SSE42_CRC
+  if (__builtin_cpu_supports("sse4.2")) {
+    *name = "sse4.2";
+    return crc32c_hw;
+  }
+#endif
+  *name = "slicing-by-8";
+  return crc32c_sw;
+}
+
+// Re-reads the destination from the device (not the page cache) and checks it against the copy's CRC
+static inline int verify_checksum(int dst_fd, Crc32cFn crc32c, char* buffer, size_t block_size, CopyStats* stats) {
+  if (fdatasync(dst_fd) == -1) {
+    return -1;
+  }
+  (void)posix_fadvise(dst_fd, 0, 0, POSIX_FADV_DONTNEED);
+  stats->syscalls += 2;
+
+  uint32_t crc = 0;
+  off_t offset = 0;
+  ssize_t got;
+  while ((got = pread_full(dst_fd, buffer, block_size, offset, &stats->syscalls)) > 0) {
+    crc = crc32c(crc, buffer, got);
+    offset += got;
+  }
+  if (got == -1) {
+    return -1;
+  }
+
+  if (crc != stats->checksum || (uint64_t)offset != stats->bytes) {
+    (void)fprintf(stderr, "verify: destination crc32c %08x over %lld bytes, expected %08x over %llu bytes\n", crc, (long long)offset,
+                  stats->checksum, (unsigned long long)stats->bytes);
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+// Large-block copy that checksums every block while it is in the buffer; -V re-reads the destination to verify
+static inline int copy_checksum(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  size_t block_size = opt->block_size != 0 ? opt->block_size : CHECKSUM_BLOCK_SIZE;
+  char* buffer      = malloc(block_size);
+  if (buffer == NULL) {
+    return -1;
+  }
+
+  const char* impl;
+  Crc32cFn crc32c = crc32c_init(&impl);
+  stats->path     = opt->verify ? "read/crc32c/write + verify" : "read/crc32c/write";
+
+  uint32_t crc = 0;
+  ssize_t bytes_read;
+  while (1) {
+    bytes_read = read(src_fd, buffer, block_size);
+    stats->syscalls++;
+    if (bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      break;
+    }
+
+    double start = now_seconds();
+    crc          = crc32c(crc, buffer, bytes_read);
+    stats->checksum_seconds += now_seconds() - start;
+
+    if (write_all(dst_fd, buffer, bytes_read, &stats->syscalls) == -1) {
+      free(buffer);
+      return -1;
+    }
+    stats->bytes += bytes_read;
+  }
+  stats->checksum      = crc;
+  stats->checksum_name = impl;
+
+  if (bytes_read == -1 || (opt->verify && verify_checksum(dst_fd, crc32c, buffer, block_size, stats) == -1)) {
+    free(buffer);
+    return -1;
+  }
+
+  printf("%08x\n", crc);
+  free(buffer);
+  return 0;
+}
+
+#endif  // Q3_CHECKSUM_H
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>       // for PATH_MAX
+#include <linux/magic.h>  // for BTRFS_SUPER_MAGIC, XFS_SUPER_MAGIC, ...
+#include <spawn.h>        // for posix_spawnp()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>   // for fstatfs()
+#include <sys/statvfs.h>  // for statvfs()
+#include <sys/types.h>
+#include <sys/wait.h>     // for waitpid()
+#include <unistd.h>
+
+#include "q3_reflink.h"
+
+//--------------------------------------------------------------------------------
+// int statfs(const char* path, struct statfs* buf);
+// Brief: Reports which filesystem path lives on (f_type is a magic number such as BTRFS_SUPER_MAGIC)
+//
+// Returns: 0 on success; -1 on failure, setting errno to indicate the error
+//
+// Search statfs(2) for more information
+//--------------------------------------------------------------------------------
+// Check for q3 -m clone (q3_reflink.h) on the filesystems at hand
+// - In every target directory, writes a source file and copies it once per path: FICLONE, copy_file_range(),
+//   the read/write loop, and copy_reflink() itself, which must always succeed by falling back
+// - Each copy starts with the source dropped from the page cache, is timed up to and including the
+//   fdatasync() of the destination, and is compared with the source byte for byte
+// - A path the filesystem does not offer is reported as "skip", not as a failure
+// - Unless -n is given, also builds a loopback btrfs and XFS image (mkfs + mount -o loop, needs root) and
+//   requires FICLONE to work on them; without the mkfs tool or the privileges they are skipped
+// - Exit status is 0 when every copy that ran matched its source, 1 otherwise
+//
+// Usage:
+//   ./q3_clone_check                      (256 MiB in /tmp and /dev/shm, plus the loopback images)
+//   ./q3_clone_check -s 10G -n /mnt/data  (10 GiB on one filesystem: the latency of every path)
+//--------------------------------------------------------------------------------
+
+#define CHECK_CHUNK (1024 * 1024)
+#define LOOP_EXTRA ((size_t)1 << 30)  // room for metadata on top of two copies of the file
+
+typedef enum {
+  PATH_CLONE,
+  PATH_COPY_RANGE,
+  PATH_BUFFERED,
+  PATH_FALLBACK,
+} CheckPath;
+
+static const char* PATH_NAMES[] = {"FICLONE", "copy_file_range", "read/write", "clone method"};
+
+#define PATH_COUNT (sizeof(PATH_NAMES) / sizeof(PATH_NAMES[0]))
+
+typedef struct {
+  const char* fs;
+  const char* mkfs[6];  // image path appended
+} LoopFilesystem;
+
+static const LoopFilesystem LOOP_FILESYSTEMS[] = {
+    {"btrfs", {"mkfs.btrfs", "-q", "-f", NULL}},
+    {"xfs", {"mkfs.xfs", "-q", "-f", "-m", "reflink=1", NULL}},
+};
+
+#define LOOP_COUNT (sizeof(LOOP_FILESYSTEMS) / sizeof(LOOP_FILESYSTEMS[0]))
+
+void usage() {
+  fprintf(stderr, "Usage: ./q3_clone_check [-s size] [-n] [dir...]\n");
+  exit(EXIT_FAILURE);
+}
+
+const char* fs_name(const char* dir) {
+  struct statfs sfs;
+  if (statfs(dir, &sfs) == -1) {
+    return "?";
+  }
+  switch ((unsigned long)sfs.f_type) {
+    case BTRFS_SUPER_MAGIC:
+      return "btrfs";
+    case XFS_SUPER_MAGIC:
+      return "xfs";
+    case EXT4_SUPER_MAGIC:
+      return "ext4";
+    case TMPFS_MAGIC:
+      return "tmpfs";
+    default:
+      return "other";
+  }
+}
+
+// Writes size bytes of pseudo-random data and flushes it, so the copies start from a cold source
+int write_source(const char* path, size_t size) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return -1;
+  }
+  uint64_t* chunk = malloc(CHECK_CHUNK);
+  if (chunk == NULL) {
+    close(fd);
+    return -1;
+  }
+
+  uint64_t state    = 0x9e3779b97f4a7c15ULL;
+  uint64_t syscalls = 0;
+  int ret           = 0;
+  for (size_t offset = 0; offset < size && ret == 0; offset += CHECK_CHUNK) {
+    for (size_t i = 0; i < CHECK_CHUNK / sizeof(uint64_t); i++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      chunk[i] = state;
+    }
+    size_t len = size - offset < CHECK_CHUNK ? size - offset : CHECK_CHUNK;
+    ret        = pwrite_all(fd, chunk, len, offset, &syscalls) == -1 ? -1 : 0;
+  }
+  free(chunk);
+  if (ret == -1 || fsync(fd) == -1) {
+    close(fd);
+    return -1;
+  }
+  return close(fd);
+}
+
+// Returns 1 when both files hold the same bytes, 0 when they differ, -1 on failure
+int same_contents(const char* a_path, const char* b_path) {
+  int a      = open(a_path, O_RDONLY);
+  int b      = open(b_path, O_RDONLY);
+  char* bufs = malloc(2 * CHECK_CHUNK);
+  int ret    = a == -1 || b == -1 || bufs == NULL ? -1 : 1;
+
+  uint64_t syscalls = 0;
+  for (off_t offset = 0; ret == 1;) {
+    ssize_t got_a = pread_full(a, bufs, CHECK_CHUNK, offset, &syscalls);
+    ssize_t got_b = pread_full(b, bufs + CHECK_CHUNK, CHECK_CHUNK, offset, &syscalls);
+    if (got_a == -1 || got_b == -1) {
+      ret = -1;
+    } else if (got_a != got_b || memcmp(bufs, bufs + CHECK_CHUNK, got_a) != 0) {
+      ret = 0;
+    } else if (got_a == 0) {
+      break;
+    }
+    offset += got_a;
+  }
+
+  free(bufs);
+  if (a != -1) {
+    close(a);
+  }
+  if (b != -1) {
+    close(b);
+  }
+  return ret;
+}
+
+// Runs one path; returns 0 when it copied, 1 when the filesystem does not offer it, -1 on failure
+int copy_path(CheckPath path, int src_fd, int dst_fd, CopyStats* stats) {
+  CopyOptions opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.block_size = REFLINK_BLOCK_SIZE;
+
+  struct stat st;
+  off_t copied;
+  switch (path) {
+    case PATH_CLONE:
+      if (fstat(src_fd, &st) == -1) {
+        return -1;
+      }
+      if (reflink_clone(src_fd, dst_fd, st.st_size, stats) == 0) {
+        return 0;
+      }
+      return reflink_unsupported(errno) ? 1 : -1;
+    case PATH_COPY_RANGE:
+      if (reflink_copy_range(src_fd, dst_fd, &copied, stats) == 0) {
+        return 0;
+      }
+      return copied == 0 && reflink_unsupported(errno) ? 1 : -1;
+    case PATH_BUFFERED:
+      stats->path = "read/write";
+      return copy_buffered(src_fd, dst_fd, &opt, stats);
+    case PATH_FALLBACK:
+      return copy_reflink(src_fd, dst_fd, &opt, stats);
+  }
+  return -1;
+}
+
+// Copies src_path once per path into dir; returns the number of failures
+int check_paths(const char* label, const char* dir, const char* src_path, size_t size, int require_clone) {
+  char dst_path[PATH_MAX];
+  snprintf(dst_path, sizeof(dst_path), "%s/q3_clone_check.dst", dir);
+  int failures = 0;
+
+  for (size_t p = 0; p < PATH_COUNT; p++) {
+    int src_fd = open(src_path, O_RDONLY);
+    int dst_fd = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (src_fd == -1 || dst_fd == -1) {
+      perror("open");
+      if (src_fd != -1) {
+        close(src_fd);
+      }
+      return failures + 1;
+    }
+    (void)posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    CopyStats stats;
+    memset(&stats, 0, sizeof(stats));
+    double start  = now_seconds();
+    int ret       = copy_path((CheckPath)p, src_fd, dst_fd, &stats);
+    int err       = errno;
+    double copy_s = now_seconds() - start;
+    if (ret == 0 && fdatasync(dst_fd) == -1) {
+      ret = -1;
+      err = errno;
+    }
+    double total_s = now_seconds() - start;
+    close(src_fd);
+    close(dst_fd);
+
+    const char* name = PATH_NAMES[p];
+    if (ret == 1) {
+      int fail = p == PATH_CLONE && require_clone;
+      failures += fail;
+      (void)printf("%-8s %-6s %-16s %-5s (%s)\n", label, fs_name(dir), name, fail ? "FAIL" : "skip", strerror(err));
+    } else if (ret == -1) {
+      failures++;
+      (void)printf("%-8s %-6s %-16s FAIL  (%s)\n", label, fs_name(dir), name, strerror(err));
+    } else {
+      int same = same_contents(src_path, dst_path);
+      failures += same != 1;
+      (void)printf("%-8s %-6s %-16s %-5s %10.3f %10.3f %10.0f  %s\n", label, fs_name(dir), name, same == 1 ? "ok" : "FAIL", copy_s,
+                   total_s, total_s > 0 ? (double)size / total_s / (1024.0 * 1024.0) : 0, stats.path);
+    }
+    unlink(dst_path);
+  }
+  return failures;
+}
+
+// Checks every path in dir; a directory without room for two copies is skipped
+int check_dir(const char* label, const char* dir, size_t size, int require_clone) {
+  struct statvfs vfs;
+  if (statvfs(dir, &vfs) == -1) {
+    (void)printf("%-8s %-6s %-16s skip  (%s)\n", label, "?", "-", strerror(errno));
+    return 0;
+  }
+  if ((uint64_t)vfs.f_bavail * vfs.f_frsize < 2 * (uint64_t)size + CHECK_CHUNK) {
+    (void)printf("%-8s %-6s %-16s skip  (not enough space for two copies)\n", label, fs_name(dir), "-");
+    return 0;
+  }
+
+  char src_path[PATH_MAX];
+  snprintf(src_path, sizeof(src_path), "%s/q3_clone_check.src", dir);
+  if (write_source(src_path, size) == -1) {
+    (void)printf("%-8s %-6s %-16s FAIL  (writing the source: %s)\n", label, fs_name(dir), "-", strerror(errno));
+    unlink(src_path);
+    return 1;
+  }
+  int failures = check_paths(label, dir, src_path, size, require_clone);
+  unlink(src_path);
+  return failures;
+}
+
+// Runs a command with its stdout discarded; returns its exit status, 127 if it could not be started, -1 on failure
+int run_command(const char* const argv[]) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  pid_t pid;
+  int err = posix_spawnp(&pid, argv[0], &actions, NULL, (char* const*)argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (err != 0) {
+    return 127;
+  }
+  int status;
+  if (waitpid(pid, &status, 0) == -1) {
+    return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Builds a loopback image of the filesystem, mounts it and requires FICLONE there; skips without the tools
+int check_loop(const LoopFilesystem* loop, size_t size) {
+  if (geteuid() != 0) {
+    (void)printf("%-8s %-6s %-16s skip  (mounting a loopback image needs root)\n", "loop", loop->fs, "-");
+    return 0;
+  }
+
+  char image[PATH_MAX], mount_point[PATH_MAX];
+  snprintf(image, sizeof(image), "/tmp/q3_clone_check_%s.img", loop->fs);
+  snprintf(mount_point, sizeof(mount_point), "/tmp/q3_clone_check_%s", loop->fs);
+
+  // Sparse: only what the check writes takes space, so /tmp needs room for about two copies of the file
+  int fd = open(image, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1 || ftruncate(fd, 2 * size + LOOP_EXTRA) == -1) {
+    (void)printf("%-8s %-6s %-16s skip  (image: %s)\n", "loop", loop->fs, "-", strerror(errno));
+    if (fd != -1) {
+      close(fd);
+      unlink(image);
+    }
+    return 0;
+  }
+  close(fd);
+
+  const char* mkfs[8];
+  size_t n = 0;
+  for (; loop->mkfs[n] != NULL; n++) {
+    mkfs[n] = loop->mkfs[n];
+  }
+  mkfs[n++] = image;
+  mkfs[n]   = NULL;
+
+  int failures = 0;
+  int status   = run_command(mkfs);
+  if (status != 0) {
+    (void)printf("%-8s %-6s %-16s skip  (%s %s)\n", "loop", loop->fs, "-", mkfs[0], status == 127 ? "not found" : "failed");
+  } else if (mkdir(mount_point, 0755) == -1 && errno != EEXIST) {
+    (void)printf("%-8s %-6s %-16s skip  (mkdir: %s)\n", "loop", loop->fs, "-", strerror(errno));
+  } else {
+    const char* mount[] = {"mount", "-o", "loop", image, mount_point, NULL};
+    if (run_command(mount) != 0) {
+      (void)printf("%-8s %-6s %-16s skip  (mount -o loop failed)\n", "loop", loop->fs, "-");
+    } else {
+      failures             = check_dir("loop", mount_point, size, 1);
+      const char* umount[] = {"umount", mount_point, NULL};
+      if (run_command(umount) != 0) {
+        fprintf(stderr, "q3_clone_check: umount %s failed, image %s left behind\n", mount_point, image);
+        return failures;
+      }
+    }
+    rmdir(mount_point);
+  }
+  unlink(image);
+  return failures;
+}
+
+// Program to check the reflink, copy_file_range and read/write paths of q3 -m clone and time each one
+int main(int argc, char* argv[]) {
+  size_t size = 256 * 1024 * 1024;
+  int loops   = 1;
+
+  int c;
+  while ((c = getopt(argc, argv, "s:n")) != -1) {
+    switch (c) {
+      case 's':
+        if ((size = parse_size(optarg)) == 0) {
+          usage();
+        }
+        break;
+      case 'n':
+        loops = 0;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  (void)printf("%zu MiB per copy, source cold, timed up to fdatasync() of the destination\n", size >> 20);
+  (void)printf("%-8s %-6s %-16s %-5s %10s %10s %10s  %s\n", "target", "fs", "path", "", "copy s", "total s", "MiB/s", "q3 path");
+
+  int failures = 0;
+  if (optind == argc) {
+    failures += check_dir("/tmp", "/tmp", size, 0);
+    failures += check_dir("/dev/shm", "/dev/shm", size, 0);
+  }
+  for (int i = optind; i < argc; i++) {
+    failures += check_dir(argv[i], argv[i], size, 0);
+  }
+  for (size_t l = 0; l < LOOP_COUNT && loops; l++) {
+    failures += check_loop(&LOOP_FILESYSTEMS[l], size);
+  }
+
+  if (failures != 0) {
+    (void)printf("%d check(s) FAILED\n", failures);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+#ifndef Q3_COMMON_H
+#define Q3_COMMON_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+//--------------------------------------------------------------------------------
+// Shared pieces of the q3 copy methods
+// - Every method has the shape: int copy_xxx(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats);
+//   -> src_fd is open O_RDONLY, dst_fd is open O_WRONLY (truncated unless the method says otherwise)
+//   -> Returns 0 on success; -1 on failure with errno set, so the caller decides how to report it
+// - Methods fill in CopyStats so that q3 -v can report what actually happened
+//   -> path is the copy path that was taken, which differs from the method when a method falls back
+//--------------------------------------------------------------------------------
+
+#define BUFFER_SIZE 1024
+
+typedef struct {
+  size_t block_size;     // bytes per request; 0 picks the method default
+  unsigned queue_depth;  // requests kept in flight by asynchronous methods
+  unsigned threads;      // worker threads for parallel methods
+  int fadvise;           // advise SEQUENTIAL up front and DONTNEED behind the copy
+  int direct;            // bypass the page cache with O_DIRECT where supported
+  int cold;              // drop the source from the page cache before copying
+  int recursive;         // copy a directory tree instead of a single file
+  int verify;            // re-read the destination and compare checksums
+  const char* sidecar;   // block-hash file kept between delta copies
+  int verbose;           // print a report once the copy finishes
+} CopyOptions;
+
+typedef struct {
+  uint64_t bytes;     // bytes written to the destination
+  uint64_t skipped;   // bytes of the file that never had to be transferred (holes, zero blocks)
+  uint64_t encoded;   // bytes of the compressed side (compressing methods only)
+  uint64_t files;     // files copied (recursive copies only)
+  uint64_t syscalls;  // system calls issued on the data path
+  double seconds;     // wall time of the copy
+  const char* path;   // copy path that was actually taken
+
+  uint32_t checksum;          // crc32c of the copied data (checksumming methods only)
+  const char* checksum_name;  // implementation that computed it
+  double checksum_seconds;    // part of seconds spent checksumming
+} CopyStats;
+
+static inline double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Parses sizes such as "4096", "128K", "8M" or "1G"; returns 0 on malformed input
+static inline size_t parse_size(const char* text) {
+  char* end;
+  errno                  = 0;
+  unsigned long long val = strtoull(text, &end, 10);
+  if (errno != 0 || end == text) {
+    return 0;
+  }
+
+  switch (*end) {
+    case 'k':
+    case 'K':
+      val <<= 10;
+      end++;
+      break;
+    case 'm':
+    case 'M':
+      val <<= 20;
+      end++;
+      break;
+    case 'g':
+    case 'G':
+      val <<= 30;
+      end++;
+      break;
+  }
+
+  return *end == '\0' ? (size_t)val : 0;
+}
+
+// Regular files may still return short counts (signals, quotas), so loop until everything is written
+static inline ssize_t write_all(int fd, const void* buffer, size_t bytes, uint64_t* syscalls) {
+  size_t total    = 0;
+  const char* ptr = buffer;
+  while (total < bytes) {
+    ssize_t written = write(fd, ptr + total, bytes - total);
+    (*syscalls)++;
+    if (written <= 0) {
+      if (written == -1 && errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    total += written;
+  }
+  return total;
+}
+
+static inline ssize_t pwrite_all(int fd, const void* buffer, size_t bytes, off_t offset, uint64_t* syscalls) {
+  size_t total    = 0;
+  const char* ptr = buffer;
+  while (total < bytes) {
+    ssize_t written = pwrite(fd, ptr + total, bytes - total, offset + total);
+    (*syscalls)++;
+    if (written <= 0) {
+      if (written == -1 && errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    total += written;
+  }
+  return total;
+}
+
+// Reads until the buffer is full or EOF is hit; returns the number of bytes read
+static inline ssize_t pread_full(int fd, void* buffer, size_t bytes, off_t offset, uint64_t* syscalls) {
+  size_t total = 0;
+  char* ptr    = buffer;
+  while (total < bytes) {
+    ssize_t r = pread(fd, ptr + total, bytes - total, offset + total);
+    (*syscalls)++;
+    if (r == -1 && errno == EINTR) {
+      continue;
+    }
+    if (r == -1) {
+      return -1;
+    }
+    if (r == 0) {
+      break;
+    }
+    total += r;
+  }
+  return total;
+}
+
+// The original q3 loop: one read() followed by one write() per block
+static inline int copy_buffered(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  size_t block_size = opt->block_size != 0 ? opt->block_size : BUFFER_SIZE;
+  char* buffer      = malloc(block_size);
+  if (buffer == NULL) {
+    return -1;
+  }
+
+  stats->path = "read/write";
+
+  ssize_t bytes_read;
+  while (1) {
+    bytes_read = read(src_fd, buffer, block_size);
+    stats->syscalls++;
+    if (bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      break;
+    }
+
+    if (write_all(dst_fd, buffer, bytes_read, &stats->syscalls) == -1) {
+      free(buffer);
+      return -1;
+    }
+    stats->bytes += bytes_read;
+  }
+
+  free(buffer);
+  return bytes_read == -1 ? -1 : 0;
+}
+
+static inline void print_stats(const char* method, const CopyStats* stats) {
+  double mib        = (double)stats->bytes / (1024.0 * 1024.0);
+  double gib        = mib / 1024.0;
+  double throughput = stats->seconds > 0 ? mib / stats->seconds : 0;
+  double per_gib    = gib > 0 ? (double)stats->syscalls / gib : 0;
+  (void)fprintf(stderr, "method:      %s\n", method);
+  (void)fprintf(stderr, "path:        %s\n", stats->path != NULL ? stats->path : method);
+  (void)fprintf(stderr, "bytes:       %llu\n", (unsigned long long)stats->bytes);
+  if (stats->files != 0) {
+    (void)fprintf(stderr, "files:       %llu (%.0f files/s)\n", (unsigned long long)stats->files,
+                  stats->seconds > 0 ? (double)stats->files / stats->seconds : 0);
+  }
+  if (stats->encoded != 0) {
+    (void)fprintf(stderr, "encoded:     %llu (ratio %.3f)\n", (unsigned long long)stats->encoded, (double)stats->bytes / (double)stats->encoded);
+  }
+  if (stats->skipped != 0) {
+    (void)fprintf(stderr, "skipped:     %llu\n", (unsigned long long)stats->skipped);
+  }
+  (void)fprintf(stderr, "time:        %.6f s\n", stats->seconds);
+  (void)fprintf(stderr, "throughput:  %.1f MiB/s\n", throughput);
+  (void)fprintf(stderr, "syscalls:    %llu (%.0f per GiB)\n", (unsigned long long)stats->syscalls, per_gib);
+  if (stats->checksum_name != NULL) {
+    double share = stats->seconds > 0 ? 100.0 * stats->checksum_seconds / stats->seconds : 0;
+    (void)fprintf(stderr, "crc32c:      %08x via %s (%.1f MiB/s, %.1f%% of copy time)\n", stats->checksum, stats->checksum_name,
+                  stats->checksum_seconds > 0 ? mib / stats->checksum_seconds : 0, share);
+  }
+}
+
+#endif  // Q3_COMMON_H
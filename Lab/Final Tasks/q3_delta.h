@@ -0,0 +1,296 @@
+#ifndef Q3_DELTA_H
+#define Q3_DELTA_H
+
+#include "q3_common.h"
+
+#include <fcntl.h>     // for open()
+#include <pthread.h>   // for pthread_create(), pthread_join()
+#include <string.h>    // for memcmp(), memcpy()
+#include <sys/stat.h>  // for fstat()
+
+//--------------------------------------------------------------------------------
+// Block-level delta copy
+// - The destination is opened without O_TRUNC and compared with the source block by block
+//   -> Only blocks that differ are written with pwrite(); the rest of the destination is left alone
+//   -> Blocks are split across worker threads, each reading its source and destination ranges
+// - With a sidecar (-H file) every block's 64-bit hash is saved after the copy
+//   -> If the destination still has the size and mtime recorded in the sidecar, the next run
+//      compares source hashes against the sidecar and never reads the destination
+// - Report: bytes written vs skipped, for e.g. a 1% change in a large file
+//     ./q3 -m delta -H img.hashes -v disk.img backup.img
+//--------------------------------------------------------------------------------
+
+#define DELTA_BLOCK_SIZE (128 * 1024)
+#define DELTA_MAX_THREADS 64
+#define DELTA_MAGIC 0x31544c4544335158ULL  // "XQ3DELT1"
+
+// Small XXH64 implementation: fast 64-bit non-cryptographic hash for the block table
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+static inline uint64_t xxh_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_P2;
+  acc = xxh_rotl(acc, 31);
+  return acc * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+  acc ^= xxh_round(0, val);
+  return acc * XXH_P1 + XXH_P4;
+}
+
+static inline uint64_t xxh64(const void* data, size_t len, uint64_t seed) {
+  const unsigned char* p   = data;
+  const unsigned char* end = p + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t v1 = seed + XXH_P1 + XXH_P2;
+    uint64_t v2 = seed + XXH_P2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - XXH_P1;
+    do {
+      uint64_t w[4];
+      memcpy(w, p, 32);
+      v1 = xxh_round(v1, w[0]);
+      v2 = xxh_round(v2, w[1]);
+      v3 = xxh_round(v3, w[2]);
+      v4 = xxh_round(v4, w[3]);
+      p += 32;
+    } while (end - p >= 32);
+    h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+    h = xxh_merge(h, v1);
+    h = xxh_merge(h, v2);
+    h = xxh_merge(h, v3);
+    h = xxh_merge(h, v4);
+  } else {
+    h = seed + XXH_P5;
+  }
+  h += len;
+
+  while (end - p >= 8) {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    h ^= xxh_round(0, k);
+    h = xxh_rotl(h, 27) * XXH_P1 + XXH_P4;
+    p += 8;
+  }
+  if (end - p >= 4) {
+    uint32_t k;
+    memcpy(&k, p, 4);
+    h ^= (uint64_t)k * XXH_P1;
+    h = xxh_rotl(h, 23) * XXH_P2 + XXH_P3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= (*p++) * XXH_P5;
+    h = xxh_rotl(h, 11) * XXH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+// On-disk sidecar: this header followed by one uint64_t hash per block
+typedef struct {
+  uint64_t magic;
+  uint64_t block_size;
+  uint64_t file_size;     // destination size after the copy
+  int64_t dst_mtime_sec;  // destination mtime after the copy
+  int64_t dst_mtime_nsec;
+} DeltaSidecar;
+
+typedef struct {
+  int src_fd;
+  int dst_fd;
+  off_t src_size;
+  off_t dst_size;
+  size_t block_size;
+  off_t first_block;
+  off_t last_block;            // exclusive
+  const uint64_t* old_hashes;  // trusted sidecar hashes, or NULL to read the destination
+  uint64_t* new_hashes;
+  uint64_t written;
+  uint64_t skipped;
+  uint64_t syscalls;
+  int error;
+} DeltaRange;
+
+static void* delta_range(void* arg) {
+  DeltaRange* r = (DeltaRange*)arg;
+  char* src_buf = malloc(r->block_size);
+  char* dst_buf = malloc(r->block_size);
+  if (src_buf == NULL || dst_buf == NULL) {
+    r->error = ENOMEM;
+    free(src_buf);
+    free(dst_buf);
+    return NULL;
+  }
+
+  for (off_t b = r->first_block; b < r->last_block; b++) {
+    off_t offset = b * (off_t)r->block_size;
+    ssize_t got  = pread_full(r->src_fd, src_buf, r->block_size, offset, &r->syscalls);
+    if (got <= 0) {
+      r->error = got == -1 ? errno : 0;
+      break;
+    }
+
+    uint64_t hash    = xxh64(src_buf, got, 0);
+    r->new_hashes[b] = hash;
+
+    int same = 0;
+    if (r->old_hashes != NULL) {
+      same = offset + got <= r->dst_size && r->old_hashes[b] == hash;
+    } else if (offset + got <= r->dst_size) {
+      // Both blocks are in memory anyway, so compare bytes rather than trusting a hash
+      ssize_t have = pread_full(r->dst_fd, dst_buf, got, offset, &r->syscalls);
+      if (have == -1) {
+        r->error = errno;
+        break;
+      }
+      same = have == got && memcmp(src_buf, dst_buf, got) == 0;
+    }
+
+    if (same) {
+      r->skipped += got;
+      continue;
+    }
+    if (pwrite_all(r->dst_fd, src_buf, got, offset, &r->syscalls) == -1) {
+      r->error = errno;
+      break;
+    }
+    r->written += got;
+  }
+
+  free(src_buf);
+  free(dst_buf);
+  return NULL;
+}
+
+// Loads the sidecar hashes if they still describe the destination; returns NULL otherwise
+static inline uint64_t* delta_load_sidecar(const char* path, const struct stat* dst, size_t block_size, off_t blocks) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  DeltaSidecar hdr;
+  uint64_t* hashes  = NULL;
+  uint64_t syscalls = 0;
+  if (pread_full(fd, &hdr, sizeof(hdr), 0, &syscalls) == (ssize_t)sizeof(hdr) && hdr.magic == DELTA_MAGIC &&
+      hdr.block_size == block_size && hdr.file_size == (uint64_t)dst->st_size && hdr.dst_mtime_sec == dst->st_mtim.tv_sec &&
+      hdr.dst_mtime_nsec == dst->st_mtim.tv_nsec) {
+    off_t old_blocks = (dst->st_size + (off_t)block_size - 1) / (off_t)block_size;
+    hashes           = calloc(blocks > old_blocks ? blocks : old_blocks, sizeof(uint64_t));
+    size_t bytes     = old_blocks * sizeof(uint64_t);
+    if (hashes != NULL && pread_full(fd, hashes, bytes, sizeof(hdr), &syscalls) != (ssize_t)bytes) {
+      free(hashes);
+      hashes = NULL;
+    }
+  }
+
+  close(fd);
+  return hashes;
+}
+
+static inline int delta_save_sidecar(const char* path, int dst_fd, size_t block_size, const uint64_t* hashes, off_t blocks) {
+  struct stat st;
+  if (fsync(dst_fd) == -1 || fstat(dst_fd, &st) == -1) {
+    return -1;
+  }
+
+  DeltaSidecar hdr = {DELTA_MAGIC, block_size, (uint64_t)st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+  int fd           = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1) {
+    return -1;
+  }
+  uint64_t syscalls = 0;
+  int ret           = 0;
+  if (write_all(fd, &hdr, sizeof(hdr), &syscalls) == -1 || write_all(fd, hashes, blocks * sizeof(uint64_t), &syscalls) == -1) {
+    ret = -1;
+  }
+  close(fd);
+  return ret;
+}
+
+// Rewrites only the destination blocks that differ from the source
+static inline int copy_delta(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  size_t block_size = opt->block_size != 0 ? opt->block_size : DELTA_BLOCK_SIZE;
+  unsigned threads  = opt->threads != 0 ? opt->threads : 2;
+  if (threads > DELTA_MAX_THREADS) {
+    threads = DELTA_MAX_THREADS;
+  }
+
+  struct stat src_st, dst_st;
+  if (fstat(src_fd, &src_st) == -1 || fstat(dst_fd, &dst_st) == -1) {
+    return -1;
+  }
+  stats->syscalls += 2;
+
+  off_t blocks         = (src_st.st_size + (off_t)block_size - 1) / (off_t)block_size;
+  uint64_t* old_hashes = opt->sidecar != NULL ? delta_load_sidecar(opt->sidecar, &dst_st, block_size, blocks) : NULL;
+  uint64_t* new_hashes = calloc(blocks > 0 ? blocks : 1, sizeof(uint64_t));
+  if (new_hashes == NULL) {
+    free(old_hashes);
+    return -1;
+  }
+  stats->path = old_hashes != NULL ? "delta (source + sidecar hashes)" : "delta (source + destination compare)";
+
+  pthread_t ids[DELTA_MAX_THREADS];
+  DeltaRange ranges[DELTA_MAX_THREADS];
+  off_t per_thread = (blocks + threads - 1) / threads;
+  unsigned created = 0;
+  int error        = 0;
+  for (unsigned i = 0; i < threads && (off_t)i * per_thread < blocks; i++) {
+    off_t first = (off_t)i * per_thread;
+    off_t last  = first + per_thread < blocks ? first + per_thread : blocks;
+    ranges[i]   = (DeltaRange){src_fd, dst_fd, src_st.st_size, dst_st.st_size, block_size, first, last, old_hashes, new_hashes, 0, 0, 0, 0};
+    if ((error = pthread_create(&ids[i], NULL, delta_range, &ranges[i])) != 0) {
+      break;
+    }
+    created++;
+  }
+
+  for (unsigned i = 0; i < created; i++) {
+    pthread_join(ids[i], NULL);
+    stats->bytes += ranges[i].written;
+    stats->skipped += ranges[i].skipped;
+    stats->syscalls += ranges[i].syscalls;
+    if (ranges[i].error != 0 && error == 0) {
+      error = ranges[i].error;
+    }
+  }
+
+  // Drop whatever the old destination had beyond the new end
+  if (error == 0 && dst_st.st_size != src_st.st_size) {
+    if (ftruncate(dst_fd, src_st.st_size) == -1) {
+      error = errno;
+    }
+    stats->syscalls++;
+  }
+
+  if (error == 0 && opt->sidecar != NULL && delta_save_sidecar(opt->sidecar, dst_fd, block_size, new_hashes, blocks) == -1) {
+    error = errno;
+  }
+
+  free(old_hashes);
+  free(new_hashes);
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+#endif  // Q3_DELTA_H
@@ -0,0 +1,369 @@
+#ifndef Q3_FANOUT_H
+#define Q3_FANOUT_H
+
+#include "q3_common.h"
+
+#include <fcntl.h>    // for splice(), tee(), F_SETPIPE_SZ
+#include <pthread.h>  // for pthread_create(), mutexes and condition variables
+
+//--------------------------------------------------------------------------------
+// ssize_t tee(int fd_in, int fd_out, size_t len, unsigned flags);
+// Brief: Duplicates up to len bytes from one pipe into another without consuming them from fd_in
+//
+// Parameters: fd_in, fd_out - Both must be pipes
+//             flags         - SPLICE_F_NONBLOCK to not block; other splice flags are ignored
+//
+// Returns: number of bytes duplicated on success (0 if fd_in is empty and has no writers);
+//          -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - No data is copied; fd_out gets references to the same pages as fd_in
+// - tee() always starts at the head of fd_in, so a short tee cannot be resumed in the middle;
+//   give fd_out at least the capacity of fd_in and only tee into an empty pipe
+// - After every destination has its copy, the data still has to be consumed from fd_in (splice it to the last one)
+//
+// Search tee(2) for more information
+//--------------------------------------------------------------------------------
+// Fan-out copy: read the source once, write it to N destinations in parallel
+// - fanout: one reader fills a ring of shared buffers; one writer thread per destination
+//   -> A buffer is refilled only after every writer has written it
+// - tee:    the source is spliced into a staging pipe, tee()d into one pipe per destination and
+//           each destination thread splices its pipe into its file
+//   -> The data never enters user space
+// Compare against N sequential copies:
+//   ./q3 -v -m fanout src a b c d      versus      for d in a b c d; do ./q3 -v -m tuned src $d; done
+//--------------------------------------------------------------------------------
+
+#define FANOUT_BLOCK_SIZE (1024 * 1024)
+#define FANOUT_MAX_DESTINATIONS 64
+#define FANOUT_SLOTS 8
+#define TEE_PIPE_SIZE (1024 * 1024)
+
+typedef struct {
+  char* data;
+  size_t len;
+  unsigned pending;  // writers that still have to write this slot
+} FanoutSlot;
+
+typedef struct {
+  FanoutSlot* slots;
+  unsigned slot_count;
+  unsigned writers;
+  uint64_t produced;  // blocks published by the reader
+  int eof;
+  int error;  // errno of the first failure; stops everybody
+  pthread_mutex_t lock;
+  pthread_cond_t filled;  // reader -> writers
+  pthread_cond_t freed;   // writers -> reader
+} Fanout;
+
+typedef struct {
+  Fanout* fan;
+  int fd;
+  uint64_t syscalls;
+} FanoutWriter;
+
+static void* fanout_writer(void* arg) {
+  FanoutWriter* w = (FanoutWriter*)arg;
+  Fanout* fan     = w->fan;
+
+  for (uint64_t seq = 0;; seq++) {
+    pthread_mutex_lock(&fan->lock);
+    while (fan->produced <= seq && !fan->eof && fan->error == 0) {
+      pthread_cond_wait(&fan->filled, &fan->lock);
+    }
+    if (fan->produced <= seq || fan->error != 0) {
+      pthread_mutex_unlock(&fan->lock);
+      break;
+    }
+    FanoutSlot* slot = &fan->slots[seq % fan->slot_count];
+    pthread_mutex_unlock(&fan->lock);
+
+    int ok = write_all(w->fd, slot->data, slot->len, &w->syscalls) != -1;
+
+    pthread_mutex_lock(&fan->lock);
+    if (!ok && fan->error == 0) {
+      fan->error = errno;
+      pthread_cond_broadcast(&fan->filled);
+    }
+    if (--slot->pending == 0 || !ok) {
+      pthread_cond_signal(&fan->freed);
+    }
+    pthread_mutex_unlock(&fan->lock);
+    if (!ok) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Shared-buffer fan-out: the calling thread reads, one thread per destination writes
+static inline int copy_fanout(int src_fd, const int* dst_fds, unsigned n, const CopyOptions* opt, CopyStats* stats) {
+  size_t block_size = opt->block_size != 0 ? opt->block_size : FANOUT_BLOCK_SIZE;
+  unsigned slots    = opt->queue_depth != 0 ? opt->queue_depth : FANOUT_SLOTS;
+  if (n == 0 || n > FANOUT_MAX_DESTINATIONS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  Fanout fan = {0};
+  fan.slots  = calloc(slots, sizeof(FanoutSlot));
+  char* data = malloc(block_size * slots);
+  if (fan.slots == NULL || data == NULL) {
+    free(fan.slots);
+    free(data);
+    errno = ENOMEM;
+    return -1;
+  }
+  for (unsigned i = 0; i < slots; i++) {
+    fan.slots[i].data = data + i * block_size;
+  }
+  fan.slot_count = slots;
+  fan.writers    = n;
+  pthread_mutex_init(&fan.lock, NULL);
+  pthread_cond_init(&fan.filled, NULL);
+  pthread_cond_init(&fan.freed, NULL);
+
+  pthread_t ids[FANOUT_MAX_DESTINATIONS];
+  FanoutWriter writers[FANOUT_MAX_DESTINATIONS];
+  unsigned created = 0;
+  for (unsigned i = 0; i < n; i++) {
+    writers[i] = (FanoutWriter){&fan, dst_fds[i], 0};
+    if (pthread_create(&ids[i], NULL, fanout_writer, &writers[i]) != 0) {
+      pthread_mutex_lock(&fan.lock);
+      fan.error = EAGAIN;
+      pthread_mutex_unlock(&fan.lock);
+      break;
+    }
+    created++;
+  }
+
+  uint64_t seq = 0;
+  int error    = 0;  // fan.error as last seen under the lock; the writers set it
+  while (1) {
+    FanoutSlot* slot = &fan.slots[seq % slots];
+
+    pthread_mutex_lock(&fan.lock);
+    while (slot->pending != 0 && fan.error == 0) {
+      pthread_cond_wait(&fan.freed, &fan.lock);
+    }
+    error = fan.error;
+    pthread_mutex_unlock(&fan.lock);
+    if (error != 0) {
+      break;
+    }
+
+    ssize_t got = read(src_fd, slot->data, block_size);
+    stats->syscalls++;
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+
+    pthread_mutex_lock(&fan.lock);
+    if (got == -1) {
+      fan.error = errno;
+    } else if (got == 0) {
+      fan.eof = 1;
+    } else {
+      slot->len     = got;
+      slot->pending = n;
+      fan.produced++;
+      stats->bytes += (uint64_t)got * n;
+    }
+    error = fan.error;
+    pthread_cond_broadcast(&fan.filled);
+    pthread_mutex_unlock(&fan.lock);
+    if (got <= 0) {
+      break;
+    }
+    seq++;
+  }
+
+  if (error != 0) {
+    // Wake writers that are waiting for a block that will never come
+    pthread_mutex_lock(&fan.lock);
+    pthread_cond_broadcast(&fan.filled);
+    pthread_mutex_unlock(&fan.lock);
+  }
+  for (unsigned i = 0; i < created; i++) {
+    pthread_join(ids[i], NULL);
+    stats->syscalls += writers[i].syscalls;
+  }
+
+  pthread_mutex_destroy(&fan.lock);
+  pthread_cond_destroy(&fan.filled);
+  pthread_cond_destroy(&fan.freed);
+  free(data);
+  free(fan.slots);
+
+  stats->path = "fan-out (shared buffers)";
+  if (fan.error != 0) {  // the writers are joined, nobody else touches it now
+    errno = fan.error;
+    return -1;
+  }
+  return 0;
+}
+
+typedef struct {
+  int pipe_fd;  // read end of this destination's pipe
+  int dst_fd;
+  uint64_t drained;  // bytes moved from the pipe into the file
+  uint64_t syscalls;
+  int error;
+  pthread_mutex_t* lock;
+  pthread_cond_t* progress;
+} TeeWriter;
+
+static void* tee_writer(void* arg) {
+  TeeWriter* w = (TeeWriter*)arg;
+  while (1) {
+    ssize_t n = splice(w->pipe_fd, NULL, w->dst_fd, NULL, TEE_PIPE_SIZE, SPLICE_F_MOVE);
+    w->syscalls++;
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+
+    pthread_mutex_lock(w->lock);
+    if (n > 0) {
+      w->drained += n;
+    } else if (n == -1) {
+      w->error = errno;
+    }
+    pthread_cond_broadcast(w->progress);
+    pthread_mutex_unlock(w->lock);
+    if (n <= 0) {
+      break;  // 0: main closed the write end
+    }
+  }
+  return NULL;
+}
+
+// Moves exactly len bytes between two fds, one of which is a pipe
+static inline int splice_all(int in_fd, int out_fd, size_t len, uint64_t* syscalls) {
+  while (len > 0) {
+    ssize_t n = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+    (*syscalls)++;
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      if (n == 0) {
+        errno = EIO;
+      }
+      return -1;
+    }
+    len -= n;
+  }
+  return 0;
+}
+
+// tee() fan-out: src -> staging pipe -> tee() into N-1 pipes + splice into the last one -> N files in parallel
+static inline int copy_fanout_tee(int src_fd, const int* dst_fds, unsigned n, const CopyOptions* opt, CopyStats* stats) {
+  (void)opt;
+  if (n == 0 || n > FANOUT_MAX_DESTINATIONS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int staging[2];
+  int pipes[FANOUT_MAX_DESTINATIONS][2];
+  if (pipe(staging) == -1) {
+    return -1;
+  }
+  int chunk = fcntl(staging[1], F_SETPIPE_SZ, TEE_PIPE_SIZE);
+  if (chunk == -1) {
+    chunk = fcntl(staging[1], F_GETPIPE_SZ);
+  }
+  stats->syscalls += 2;
+
+  pthread_mutex_t lock    = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t progress = PTHREAD_COND_INITIALIZER;
+  pthread_t ids[FANOUT_MAX_DESTINATIONS];
+  TeeWriter writers[FANOUT_MAX_DESTINATIONS];
+  unsigned opened = 0, created = 0;
+  int error       = 0;
+
+  for (unsigned i = 0; i < n && error == 0; i++) {
+    // Each destination pipe must hold a whole staging pipe, see the tee() notes above
+    if (pipe(pipes[i]) == -1) {
+      error = errno;
+      break;
+    }
+    opened++;
+    if (fcntl(pipes[i][1], F_SETPIPE_SZ, chunk) < chunk) {
+      error = errno;
+      break;
+    }
+    writers[i] = (TeeWriter){pipes[i][0], dst_fds[i], 0, 0, 0, &lock, &progress};
+    if ((error = pthread_create(&ids[i], NULL, tee_writer, &writers[i])) != 0) {
+      break;
+    }
+    created++;
+  }
+
+  uint64_t sent = 0;
+  while (error == 0) {
+    ssize_t got = splice(src_fd, NULL, staging[1], NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+    stats->syscalls++;
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      error = got == -1 ? errno : 0;
+      break;
+    }
+
+    // Wait until every destination pipe is empty again so the tee() below cannot come back short
+    pthread_mutex_lock(&lock);
+    for (unsigned i = 0; i < n && error == 0; i++) {
+      while (writers[i].drained < sent && writers[i].error == 0) {
+        pthread_cond_wait(&progress, &lock);
+      }
+      error = writers[i].error;
+    }
+    pthread_mutex_unlock(&lock);
+    if (error != 0) {
+      break;
+    }
+
+    for (unsigned i = 0; i + 1 < n; i++) {
+      ssize_t dup = tee(staging[0], pipes[i][1], got, 0);
+      stats->syscalls++;
+      if (dup != got) {
+        error = dup == -1 ? errno : EIO;
+        break;
+      }
+    }
+    if (error == 0 && splice_all(staging[0], pipes[n - 1][1], got, &stats->syscalls) == -1) {
+      error = errno;
+    }
+    sent += got;
+    stats->bytes += (uint64_t)got * n;
+  }
+
+  // Closing the write ends lets every writer see EOF once its pipe is drained
+  for (unsigned i = 0; i < opened; i++) {
+    close(pipes[i][1]);
+  }
+  for (unsigned i = 0; i < created; i++) {
+    pthread_join(ids[i], NULL);
+    stats->syscalls += writers[i].syscalls;
+    if (error == 0) {
+      error = writers[i].error;
+    }
+  }
+  for (unsigned i = 0; i < opened; i++) {
+    close(pipes[i][0]);
+  }
+  close(staging[0]);
+  close(staging[1]);
+
+  stats->path = "fan-out (splice + tee)";
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+#endif  // Q3_FANOUT_H
@@ -0,0 +1,132 @@
+#ifndef Q3_KERNEL_H
+#define Q3_KERNEL_H
+
+#include "q3_common.h"
+
+#include <fcntl.h>         // for splice(), F_SETPIPE_SZ
+#include <sys/sendfile.h>  // for sendfile()
+
+//--------------------------------------------------------------------------------
+// ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+// Brief: Copies data from in_fd to out_fd inside the kernel
+//
+// Parameters: out_fd - Destination (any file or socket since Linux 2.6.33)
+//             in_fd  - Source; must support mmap-like access (a regular file)
+//             offset - Where to read from, or NULL to use and advance the file position of in_fd
+//             count  - Maximum number of bytes to copy (at most 0x7ffff000 per call)
+//
+// Returns: number of bytes copied (0 at EOF) on success; -1 on failure, setting errno to indicate the error
+//
+// Search sendfile(2) for more information
+//--------------------------------------------------------------------------------
+// ssize_t splice(int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t len, unsigned flags);
+// Brief: Moves data between a file and a pipe without copying it through user space
+//
+// Parameters: One of fd_in / fd_out must be a pipe
+//             flags - SPLICE_F_MOVE (move pages if possible), SPLICE_F_MORE (more data is coming)
+//
+// Returns: number of bytes moved (0 at EOF) on success; -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - A file-to-file copy is two splices per chunk: file -> pipe, then pipe -> file
+// - The pipe's capacity bounds each chunk; F_SETPIPE_SZ raises it up to /proc/sys/fs/pipe-max-size
+//
+// Search splice(2) for more information
+//--------------------------------------------------------------------------------
+
+#define KERNEL_CHUNK (1U << 30)
+#define SPLICE_PIPE_SIZE (1024 * 1024)
+
+static inline int copy_sendfile(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  (void)opt;
+  stats->path = "sendfile";
+  while (1) {
+    ssize_t n = sendfile(dst_fd, src_fd, NULL, KERNEL_CHUNK);
+    stats->syscalls++;
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return (int)n;
+    }
+    stats->bytes += n;
+  }
+}
+
+// copy_file_range() only, without the reflink attempt or buffered fallback of the clone method
+static inline int copy_range_kernel(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  (void)opt;
+  stats->path = "copy_file_range";
+  while (1) {
+    ssize_t n = copy_file_range(src_fd, NULL, dst_fd, NULL, KERNEL_CHUNK, 0);
+    stats->syscalls++;
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return (int)n;
+    }
+    stats->bytes += n;
+  }
+}
+
+static inline int copy_splice(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  int pipe_fd[2];
+  if (pipe(pipe_fd) == -1) {
+    return -1;
+  }
+  stats->syscalls++;
+
+  // A bigger pipe means fewer splice pairs; keep the default 64 KiB if the limit does not allow it
+  size_t chunk = opt->block_size != 0 ? opt->block_size : SPLICE_PIPE_SIZE;
+  int size     = fcntl(pipe_fd[1], F_SETPIPE_SZ, (int)chunk);
+  stats->syscalls++;
+  if (size == -1) {
+    size = fcntl(pipe_fd[1], F_GETPIPE_SZ);
+    stats->syscalls++;
+  }
+  if (size > 0) {
+    chunk = (size_t)size;
+  }
+
+  stats->path = "splice (file -> pipe -> file)";
+  int ret     = 0;
+  while (1) {
+    ssize_t in = splice(src_fd, NULL, pipe_fd[1], NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+    stats->syscalls++;
+    if (in == -1 && errno == EINTR) {
+      continue;
+    }
+    if (in <= 0) {
+      ret = (int)in;
+      break;
+    }
+
+    // Drain everything that went into the pipe before reading more
+    ssize_t left = in;
+    while (left > 0) {
+      ssize_t out = splice(pipe_fd[0], NULL, dst_fd, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+      stats->syscalls++;
+      if (out == -1 && errno == EINTR) {
+        continue;
+      }
+      if (out <= 0) {
+        ret = -1;
+        break;
+      }
+      left -= out;
+    }
+    if (ret == -1) {
+      break;
+    }
+    stats->bytes += in;
+  }
+
+  int err = errno;
+  close(pipe_fd[0]);
+  close(pipe_fd[1]);
+  errno = err;
+  return ret;
+}
+
+#endif  // Q3_KERNEL_H
@@ -0,0 +1,164 @@
+#ifndef Q3_LZ_H
+#define Q3_LZ_H
+
+#include "q3_common.h"
+
+#include "../common/lz.h"
+
+//--------------------------------------------------------------------------------
+// Compressed copies with the in-tree LZ codec (see ../common/lz.h for the formats)
+// - lz:   source -> LZ frame; a batch of one block per thread is compressed in parallel, then written in order
+// - unlz: LZ frame -> original file; the same batches decompressed in parallel
+// Usage:
+//   ./q3 -v -m lz -t 4 app.log app.log.lz
+//   ./q3 -v -m unlz app.log.lz app.log
+//--------------------------------------------------------------------------------
+
+#define LZ_COPY_THREADS 4
+
+static inline int copy_lz_compress(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  size_t block_size = opt->block_size != 0 ? opt->block_size : LZ_BLOCK_SIZE;
+  unsigned threads  = opt->threads != 0 ? opt->threads : LZ_COPY_THREADS;
+  if (block_size > LZ_MAX_BLOCK_SIZE || threads > LZ_MAX_THREADS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  size_t batch = block_size * threads;
+  size_t cap   = lz_frame_bound(batch, block_size);
+  uint8_t* in  = malloc(batch);
+  uint8_t* out = malloc(cap);
+  if (in == NULL || out == NULL) {
+    free(in);
+    free(out);
+    errno = ENOMEM;
+    return -1;
+  }
+  stats->path = threads > 1 ? "lz compress (parallel blocks)" : "lz compress";
+
+  uint8_t header[LZ_HEADER_SIZE];
+  lz_put32(header, LZ_MAGIC);
+  lz_put32(header + 4, (uint32_t)block_size);
+  int ret = write_all(dst_fd, header, sizeof(header), &stats->syscalls) == -1 ? -1 : 0;
+  stats->encoded += sizeof(header);
+
+  off_t offset = 0;
+  while (ret == 0) {
+    ssize_t got = pread_full(src_fd, in, batch, offset, &stats->syscalls);
+    if (got <= 0) {
+      ret = (int)got;
+      break;
+    }
+
+    ssize_t size = lz_encode_blocks(in, got, out, cap, block_size, threads);
+    if (size == -1 || write_all(dst_fd, out, size, &stats->syscalls) == -1) {
+      ret = -1;
+      break;
+    }
+    offset += got;
+    stats->bytes += got;
+    stats->encoded += size;
+  }
+
+  if (ret == 0) {
+    memset(header, 0, sizeof(header));
+    ret = write_all(dst_fd, header, sizeof(header), &stats->syscalls) == -1 ? -1 : 0;
+    stats->encoded += sizeof(header);
+  }
+
+  int err = errno;
+  free(in);
+  free(out);
+  errno = err;
+  return ret;
+}
+
+// Reads exactly bytes; a frame that ends early is reported as EINVAL
+static inline int lz_read_frame(int fd, void* buffer, size_t bytes, CopyStats* stats) {
+  stats->syscalls++;
+  if (lz_read_all(fd, buffer, bytes) == -1) {
+    if (errno == EPIPE) {
+      errno = EINVAL;
+    }
+    return -1;
+  }
+  stats->encoded += bytes;
+  return 0;
+}
+
+static inline int copy_lz_decompress(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  unsigned threads = opt->threads != 0 ? opt->threads : LZ_COPY_THREADS;
+  if (threads > LZ_MAX_THREADS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint8_t header[LZ_HEADER_SIZE];
+  if (lz_read_frame(src_fd, header, sizeof(header), stats) == -1) {
+    return -1;
+  }
+  size_t block_size = lz_get32(header + 4);
+  if (lz_get32(header) != LZ_MAGIC || block_size == 0 || block_size > LZ_MAX_BLOCK_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // Every block record fits in LZ_HEADER_SIZE + block_size bytes, stored or not
+  size_t slot      = LZ_HEADER_SIZE + block_size;
+  uint8_t* records = malloc(slot * threads);
+  uint8_t* out     = malloc(block_size * threads);
+  if (records == NULL || out == NULL) {
+    free(records);
+    free(out);
+    errno = ENOMEM;
+    return -1;
+  }
+  stats->path = threads > 1 ? "lz decompress (parallel blocks)" : "lz decompress";
+
+  int ret  = 0;
+  int done = 0;
+  while (ret == 0 && !done) {
+    // Gather up to one block per thread, stopping at the terminator
+    size_t used = 0;
+    for (unsigned i = 0; i < threads; i++) {
+      if (lz_read_frame(src_fd, records + used, LZ_HEADER_SIZE, stats) == -1) {
+        ret = -1;
+        break;
+      }
+      uint32_t raw    = lz_get32(records + used);
+      uint32_t stored = lz_get32(records + used + 4) & ~LZ_STORED;
+      if (raw == 0 && stored == 0) {
+        done = 1;
+        break;
+      }
+      if (raw > block_size || stored > block_size) {
+        errno = EINVAL;
+        ret   = -1;
+        break;
+      }
+      if (lz_read_frame(src_fd, records + used + LZ_HEADER_SIZE, stored, stats) == -1) {
+        ret = -1;
+        break;
+      }
+      used += LZ_HEADER_SIZE + stored;
+    }
+    if (ret == -1 || used == 0) {
+      break;
+    }
+
+    ssize_t size = lz_decode_blocks(records, used, out, block_size * threads, threads);
+    if (size == -1 || write_all(dst_fd, out, size, &stats->syscalls) == -1) {
+      ret = -1;
+      break;
+    }
+    stats->bytes += size;
+  }
+
+  int err = errno;
+  free(records);
+  free(out);
+  errno = err;
+  return ret;
+}
+
+#endif  // Q3_LZ_H
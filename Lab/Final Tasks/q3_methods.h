@@ -0,0 +1,98 @@
+#ifndef Q3_METHODS_H
+#define Q3_METHODS_H
+
+#include "q3_checksum.h"
+#include "q3_common.h"
+#include "q3_delta.h"
+#include "q3_fanout.h"
+#include "q3_kernel.h"
+#include "q3_lz.h"
+#include "q3_mmap.h"
+#include "q3_parallel.h"
+#include "q3_reflink.h"
+#include "q3_sparse.h"
+#include "q3_tuned.h"
+#include "q3_uring.h"
+#include "q3_writebehind.h"
+
+#include <fcntl.h>   // for open()
+#include <string.h>  // for strcmp()
+
+// Every copy method q3 and q3_bench know about, selected by name with -m
+
+typedef int (*CopyMethod)(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats);
+
+#define DST_TRUNCATE (O_WRONLY | O_CREAT | O_TRUNC)
+#define DST_MAPPED (O_RDWR | O_CREAT | O_TRUNC)  // writable shared mappings need O_RDWR
+#define DST_KEEP (O_RDWR | O_CREAT)              // compare against the existing destination
+
+typedef struct {
+  const char* name;
+  CopyMethod copy;
+  int dst_flags;  // open() flags for the destination
+} CopyMethodEntry;
+
+static const CopyMethodEntry METHODS[] = {
+    {"rw", copy_buffered, DST_TRUNCATE},  // default: the original read()/write() loop
+    {"uring", copy_uring, DST_TRUNCATE},
+    {"parallel", copy_parallel, DST_TRUNCATE},
+    {"tuned", copy_tuned, DST_TRUNCATE},     // adaptive block size, honours -F and -D
+    {"wb", copy_writebehind, DST_TRUNCATE},  // tuned + sync_file_range() write-behind
+    {"sparse", copy_sparse, DST_TRUNCATE},
+    {"clone", copy_reflink, DST_TRUNCATE},  // FICLONE -> copy_file_range -> read/write
+    {"crc", copy_checksum, DST_TRUNCATE},   // prints the crc32c, honours -V
+    {"delta", copy_delta, DST_KEEP},        // rewrites changed blocks only, honours -H
+    {"mmap", copy_mmap, DST_MAPPED},
+    {"mmapw", copy_mmap_write, DST_TRUNCATE},  // write() from the mapped source
+    {"sendfile", copy_sendfile, DST_TRUNCATE},
+    {"cfr", copy_range_kernel, DST_TRUNCATE},  // copy_file_range() only
+    {"splice", copy_splice, DST_TRUNCATE},
+    {"lz", copy_lz_compress, DST_TRUNCATE},  // writes an LZ frame, -t threads
+    {"unlz", copy_lz_decompress, DST_TRUNCATE},
+};
+
+#define METHOD_COUNT (sizeof(METHODS) / sizeof(METHODS[0]))
+
+static inline const CopyMethodEntry* find_method(const char* name) {
+  for (size_t i = 0; i < METHOD_COUNT; i++) {
+    if (strcmp(METHODS[i].name, name) == 0) {
+      return &METHODS[i];
+    }
+  }
+  return NULL;
+}
+
+// Fan-out methods read the source once and write every destination
+typedef int (*FanoutMethod)(int src_fd, const int* dst_fds, unsigned n, const CopyOptions* opt, CopyStats* stats);
+
+typedef struct {
+  const char* name;
+  FanoutMethod copy;
+} FanoutMethodEntry;
+
+static const FanoutMethodEntry FANOUT_METHODS[] = {
+    {"fanout", copy_fanout},  // default with more than one destination: shared buffers, one writer thread each
+    {"tee", copy_fanout_tee},
+};
+
+#define FANOUT_METHOD_COUNT (sizeof(FANOUT_METHODS) / sizeof(FANOUT_METHODS[0]))
+
+static inline const FanoutMethodEntry* find_fanout_method(const char* name) {
+  for (size_t i = 0; i < FANOUT_METHOD_COUNT; i++) {
+    if (strcmp(FANOUT_METHODS[i].name, name) == 0) {
+      return &FANOUT_METHODS[i];
+    }
+  }
+  return NULL;
+}
+
+// Verification reads the destination back through the same descriptor, so it needs O_RDWR too
+static inline int open_destination(const char* name, const CopyMethodEntry* method, const CopyOptions* opt) {
+  int flags = method->dst_flags;
+  if (opt->verify) {
+    flags = (flags & ~O_WRONLY) | O_RDWR;
+  }
+  return open(name, flags, 0666);
+}
+
+#endif  // Q3_METHODS_H
@@ -0,0 +1,283 @@
+#ifndef Q3_MMAP_H
+#define Q3_MMAP_H
+
+#include "q3_common.h"
+
+#include <string.h>    // for memcpy(), memcmp()
+#include <sys/mman.h>  // for mmap(), munmap(), madvise()
+#include <sys/stat.h>  // for fstat()
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>  // for _mm_cmpeq_epi8(), _mm256_cmpeq_epi8()
+#define Q3_HAVE_SIMD_CMP 1
+#endif
+
+//--------------------------------------------------------------------------------
+// void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset);
+// Brief: Maps a file into the address space so it can be accessed like memory
+//
+// Parameters: prot  - PROT_READ for the source; PROT_READ | PROT_WRITE for a writable destination
+//             flags - MAP_SHARED so stores reach the file
+//             fd    - Must be open O_RDWR for a writable shared mapping (O_WRONLY is not enough)
+//
+// Returns: address of the mapping on success; MAP_FAILED on failure, setting errno to indicate the error
+//
+// Notes:
+// - The destination must already have its final size (ftruncate()) before it is mapped
+// - Touching pages past the end of the file raises SIGBUS
+//
+// Search mmap(2) for more information
+//--------------------------------------------------------------------------------
+// int madvise(void* addr, size_t length, int advice);
+// Brief: Tells the kernel how a mapped range is going to be accessed
+//
+// Parameters: advice - MADV_SEQUENTIAL: read ahead aggressively and free pages soon after they are touched
+//                      MADV_DONTNEED:   the range will not be accessed again soon
+//
+// Returns: 0 on success; -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - Without MADV_SEQUENTIAL every 4 KiB page of a cold file is a separate page fault with small read-ahead
+//
+// Search madvise(2) for more information
+//--------------------------------------------------------------------------------
+// Three mapped paths:
+// - mmap:  memcpy() from the mapped source into the mapped, ftruncate()d destination
+// - mmapw: write() straight from the mapped source, the kernel copies out of the page cache once
+// - cmp:   compare two files through their mappings, reporting the first differing byte like cmp(1)
+//--------------------------------------------------------------------------------
+
+#define MMAP_WRITE_CHUNK (8 * 1024 * 1024)
+#define CMP_READ_BLOCK (1024 * 1024)
+
+typedef size_t (*MismatchFn)(const unsigned char* a, const unsigned char* b, size_t bytes);
+
+// Index of the first differing byte, or bytes if the ranges are equal
+static inline size_t mismatch_scalar(const unsigned char* a, const unsigned char* b, size_t bytes) {
+  size_t i = 0;
+  // memcmp() is vectorized by libc, so only use the byte loop to locate the difference
+  for (; i + 4096 <= bytes; i += 4096) {
+    if (memcmp(a + i, b + i, 4096) != 0) {
+      break;
+    }
+  }
+  while (i < bytes && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+#ifdef Q3_HAVE_SIMD_CMP
+static inline size_t mismatch_sse2(const unsigned char* a, const unsigned char* b, size_t bytes) {
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i eq    = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+    unsigned mask = (unsigned)_mm_movemask_epi8(eq) ^ 0xffffu;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + mismatch_scalar(a + i, b + i, bytes - i);
+}
+
+// 64 bytes per step: two compares folded together, the exact position is only worked out on a mismatch
+__attribute__((target("avx2"))) static inline size_t mismatch_avx2(const unsigned char* a, const unsigned char* b, size_t bytes) {
+  size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+    __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+    if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(eq0, eq1)) != 0xffffffffu) {
+      unsigned mask = ~(unsigned)_mm256_movemask_epi8(eq0);
+      if (mask != 0) {
+        return i + __builtin_ctz(mask);
+      }
+      return i + 32 + __builtin_ctz(~(unsigned)_mm256_movemask_epi8(eq1));
+    }
+  }
+  return i + mismatch_sse2(a + i, b + i, bytes - i);
+}
+#endif
+
+static inline MismatchFn mismatch_init(const char** name) {
+#ifdef Q3_HAVE_SIMD_CMP
+  if (__builtin_cpu_supports("avx2")) {
+    *name = "avx2";
+    return mismatch_avx2;
+  }
+  *name = "sse2";
+  return mismatch_sse2;
+#else
+  *name = "memcmp";
+  return mismatch_scalar;
+#endif
+}
+
+// Maps a whole file read-only for a sequential pass; an empty file yields NULL
+static inline void* map_sequential(int fd, size_t size, CopyStats* stats) {
+  if (size == 0) {
+    return NULL;
+  }
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  stats->syscalls++;
+  if (map == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+  stats->syscalls++;
+  return map;
+}
+
+// Maps both files and copies with one memcpy(); the destination must be open O_RDWR
+static inline int copy_mmap(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  (void)opt;
+  struct stat st;
+  if (fstat(src_fd, &st) == -1) {
+    return -1;
+  }
+  stats->syscalls++;
+  stats->path = "mmap + memcpy";
+
+  size_t size = (size_t)st.st_size;
+  if (size == 0) {
+    return 0;
+  }
+
+  if (ftruncate(dst_fd, st.st_size) == -1) {
+    return -1;
+  }
+  char* src = map_sequential(src_fd, size, stats);
+  char* dst = src == MAP_FAILED ? MAP_FAILED : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, dst_fd, 0);
+  stats->syscalls += 2;
+  if (dst != MAP_FAILED) {
+    madvise(dst, size, MADV_SEQUENTIAL);
+    stats->syscalls++;
+  }
+  if (dst == MAP_FAILED) {
+    int err = errno;
+    if (src != MAP_FAILED) {
+      munmap(src, size);
+    }
+    errno = err;
+    return -1;
+  }
+
+  memcpy(dst, src, size);
+  stats->bytes = size;
+
+  munmap(src, size);
+  munmap(dst, size);
+  stats->syscalls += 2;
+  return 0;
+}
+
+// write() straight out of the mapped source: no user-space buffer, one copy from the page cache
+static inline int copy_mmap_write(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  struct stat st;
+  if (fstat(src_fd, &st) == -1) {
+    return -1;
+  }
+  stats->syscalls++;
+  stats->path = "mmap + write";
+
+  size_t size = (size_t)st.st_size;
+  char* src   = map_sequential(src_fd, size, stats);
+  if (src == MAP_FAILED) {
+    return -1;
+  }
+
+  size_t chunk = opt->block_size != 0 ? opt->block_size : MMAP_WRITE_CHUNK;
+  int ret      = 0;
+  for (size_t offset = 0; offset < size; offset += chunk) {
+    size_t len = size - offset < chunk ? size - offset : chunk;
+    if (write_all(dst_fd, src + offset, len, &stats->syscalls) == -1) {
+      ret = -1;
+      break;
+    }
+    stats->bytes += len;
+  }
+
+  if (src != NULL) {
+    int err = errno;
+    munmap(src, size);
+    stats->syscalls++;
+    errno = err;
+  }
+  return ret;
+}
+
+// Compares two files through mappings; returns 0 if equal, 1 if they differ (*diff is the first differing
+// offset, or the size of the shorter file), -1 on failure with errno set
+static inline int compare_mapped(int a_fd, int b_fd, uint64_t* diff, CopyStats* stats) {
+  struct stat a_st, b_st;
+  if (fstat(a_fd, &a_st) == -1 || fstat(b_fd, &b_st) == -1) {
+    return -1;
+  }
+  stats->syscalls += 2;
+
+  const char* impl;
+  MismatchFn mismatch = mismatch_init(&impl);
+  stats->path         = impl;
+
+  size_t size = (size_t)(a_st.st_size < b_st.st_size ? a_st.st_size : b_st.st_size);
+  char* a     = map_sequential(a_fd, size, stats);
+  char* b     = a == MAP_FAILED ? MAP_FAILED : map_sequential(b_fd, size, stats);
+  if (b == MAP_FAILED) {
+    int err = errno;
+    if (a != MAP_FAILED && a != NULL) {
+      munmap(a, size);
+    }
+    errno = err;
+    return -1;
+  }
+
+  size_t at    = size > 0 ? mismatch((const unsigned char*)a, (const unsigned char*)b, size) : 0;
+  stats->bytes = at;
+  if (size > 0) {
+    munmap(a, size);
+    munmap(b, size);
+    stats->syscalls += 2;
+  }
+
+  *diff = at;
+  return at < size || a_st.st_size != b_st.st_size;
+}
+
+// The same comparison through read(), for comparing against the mapped version
+static inline int compare_read(int a_fd, int b_fd, uint64_t* diff, CopyStats* stats) {
+  const char* impl;
+  MismatchFn mismatch = mismatch_init(&impl);
+  stats->path         = "read";
+
+  char* a = malloc(2 * CMP_READ_BLOCK);
+  if (a == NULL) {
+    return -1;
+  }
+  char* b = a + CMP_READ_BLOCK;
+
+  int ret = 0;
+  while (1) {
+    ssize_t a_got = pread_full(a_fd, a, CMP_READ_BLOCK, stats->bytes, &stats->syscalls);
+    ssize_t b_got = a_got == -1 ? -1 : pread_full(b_fd, b, CMP_READ_BLOCK, stats->bytes, &stats->syscalls);
+    if (b_got == -1) {
+      ret = -1;
+      break;
+    }
+
+    size_t len = (size_t)(a_got < b_got ? a_got : b_got);
+    size_t at  = mismatch((const unsigned char*)a, (const unsigned char*)b, len);
+    stats->bytes += at;
+    if (at < len || a_got != b_got) {
+      ret = 1;  // a difference, or one file ended first
+      break;
+    }
+    if (len == 0) {
+      break;
+    }
+  }
+
+  free(a);
+  *diff = stats->bytes;
+  return ret;
+}
+
+#endif  // Q3_MMAP_H
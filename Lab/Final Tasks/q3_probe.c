@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "../common/histogram.h"
+#include "q3_common.h"
+
+//--------------------------------------------------------------------------------
+// int fdatasync(int fd);
+// Brief: Flushes the data of a file (and the metadata needed to read it back) to the device
+//
+// Returns: 0 on success; -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - Returns only once the data is on stable storage, so it queues up behind any writeback already in flight
+//   on the same device -> a burst of dirty pages from another process shows up here as a latency spike
+//
+// Search fdatasync(2) for more information
+//--------------------------------------------------------------------------------
+// Write-latency probe for q3's write-behind mode
+// - Every interval, appends one small record to a file and fdatasync()s it, timing the pair
+// - At the end, prints percentiles and every spike above the threshold with the time it happened
+// - -j adds the percentiles as one JSON line (../common/histogram.h), for scripts comparing runs
+//
+// Usage (in a second terminal, on the same device as the copy destination):
+//   ./q3_probe -d /mnt/disk -s 30 -t 50
+//--------------------------------------------------------------------------------
+
+#define PROBE_RECORD 4096
+#define MAX_SPIKES 4096
+
+void usage() {
+  fprintf(stderr, "Usage: ./q3_probe [-d dir] [-s seconds] [-i interval_ms] [-t spike_ms] [-j]\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+  const char* dir    = ".";
+  double duration    = 10;
+  double interval_ms = 10;
+  double spike_ms    = 50;
+  int json           = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "d:s:i:t:j")) != -1) {
+    switch (c) {
+      case 'd':
+        dir = optarg;
+        break;
+      case 's':
+        duration = atof(optarg);
+        break;
+      case 'i':
+        interval_ms = atof(optarg);
+        break;
+      case 't':
+        spike_ms = atof(optarg);
+        break;
+      case 'j':
+        json = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/q3_probe.log", dir);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd == -1) {
+    perror("open");
+    exit(EXIT_FAILURE);
+  }
+
+  Histogram* latency = hist_create();
+  double* spike_at   = malloc(MAX_SPIKES * sizeof(double));
+  double* spike_ms_v = malloc(MAX_SPIKES * sizeof(double));
+  if (latency == NULL || spike_at == NULL || spike_ms_v == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+
+  char record[PROBE_RECORD];
+  memset(record, 'p', sizeof(record));
+  uint64_t syscalls = 0;
+  size_t spikes     = 0, spikes_seen = 0;
+  double start      = now_seconds();
+  while (now_seconds() - start < duration) {
+    double t0 = now_seconds();
+    if (write_all(fd, record, sizeof(record), &syscalls) == -1 || fdatasync(fd) == -1) {
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    double t1 = now_seconds();
+
+    hist_record(latency, (uint64_t)((t1 - t0) * 1e9));
+    if ((t1 - t0) * 1e3 > spike_ms) {
+      if (spikes < MAX_SPIKES) {
+        spike_at[spikes]   = t0 - start;
+        spike_ms_v[spikes] = (t1 - t0) * 1e3;
+        spikes++;
+      }
+      spikes_seen++;
+    }
+
+    double sleep_ms = interval_ms - (t1 - t0) * 1e3;
+    if (sleep_ms > 0) {
+      usleep((useconds_t)(sleep_ms * 1e3));
+    }
+  }
+  close(fd);
+  unlink(path);
+
+  if (hist_count(latency) == 0) {
+    fprintf(stderr, "No samples taken\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("Spikes above %.1f ms:\n", spike_ms);
+  for (size_t i = 0; i < spikes; i++) {
+    printf("  t=%8.3f s  %9.3f ms\n", spike_at[i], spike_ms_v[i]);
+  }
+
+  printf("samples: %llu  spikes: %zu\n", (unsigned long long)hist_count(latency), spikes_seen);
+  printf("p50: %.3f ms  p99: %.3f ms  p99.9: %.3f ms  max: %.3f ms\n", hist_percentile(latency, 50) / 1e6,
+         hist_percentile(latency, 99) / 1e6, hist_percentile(latency, 99.9) / 1e6, hist_max(latency) / 1e6);
+  if (json) {
+    hist_print_json(stdout, "fdatasync_ns", latency);
+  }
+
+  free(latency);
+  free(spike_at);
+  free(spike_ms_v);
+  return EXIT_SUCCESS;
+}
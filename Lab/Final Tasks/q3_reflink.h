@@ -0,0 +1,143 @@
+#ifndef Q3_REFLINK_H
+#define Q3_REFLINK_H
+
+#include "q3_common.h"
+
+#include <sys/ioctl.h>  // for ioctl()
+#include <sys/stat.h>   // for fstat()
+
+#if defined(__linux__)
+#include <linux/fs.h>  // for FICLONE
+#endif
+
+//--------------------------------------------------------------------------------
+// int ioctl(int dst_fd, FICLONE, int src_fd);
+// int ioctl(int dst_fd, FICLONERANGE, struct file_clone_range* range);
+// Brief: Makes the destination share the source's data extents (reflink); no data is read or written
+//
+// Parameters: dst_fd - Destination, open for writing
+//             src_fd - Source, open for reading, on the same filesystem
+//             range  - FICLONERANGE only: src_fd, src_offset, src_length (0 = to EOF), dest_offset
+//
+// Returns: 0 on success; -1 on failure, setting errno to indicate the error
+//
+// Errors:
+// - EOPNOTSUPP - The filesystem cannot share extents (ext4, tmpfs, ...)
+// - EXDEV      - Source and destination are on different filesystems
+// - EINVAL     - Unaligned range, or the filesystem does not support cloning
+// - ENOTTY     - The ioctl is unknown to this kernel
+//
+// Usage:
+//   if (ioctl(dst_fd, FICLONE, src_fd) == -1) {
+//     // fall back to copy_file_range() or a read/write loop
+//   }
+//
+// Notes:
+// - Supported by btrfs, XFS (reflink=1), bcachefs, OCFS2 and overlayfs on top of those
+// - A clone is a metadata operation, so a 10 GiB file takes about as long as a 10 KiB file
+// - Later writes to either file unshare only the blocks they touch (copy-on-write)
+// - FICLONERANGE is needed to clone into an existing file or a part of it; the whole-file copy here uses FICLONE
+//
+// Search ioctl_ficlone(2) for more information
+//--------------------------------------------------------------------------------
+// ssize_t copy_file_range(int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t len, unsigned flags);
+// Brief: Copies a range between two files inside the kernel, without bouncing through user space
+//
+// Parameters: off_in/off_out - Offsets to use and advance, or NULL to use and advance the file positions
+//             len            - Maximum number of bytes to copy
+//             flags          - Must be 0
+//
+// Returns: number of bytes copied (0 at EOF) on success; -1 on failure, setting errno to indicate the error
+//
+// Errors:
+// - EXDEV      - Cross-filesystem copy on kernels before 5.3 (and again between some filesystems after 5.19)
+// - ENOSYS     - Kernel older than 4.5
+// - EOPNOTSUPP - The filesystem does not implement it
+//
+// Notes:
+// - Filesystems may implement it as a reflink (btrfs, XFS) or a server-side copy (NFS 4.2, CIFS)
+// - Like read()/write(), it may copy fewer bytes than asked for; loop until EOF
+//
+// Search copy_file_range(2) for more information
+//--------------------------------------------------------------------------------
+
+#define REFLINK_CHUNK (1U << 30)  // copy_file_range() request size
+#define REFLINK_BLOCK_SIZE (1024 * 1024)
+
+// Errors that mean "this path is not available here", as opposed to a real I/O failure
+static inline int reflink_unsupported(int err) {
+  return err == EOPNOTSUPP || err == EXDEV || err == EINVAL || err == ENOTTY || err == ENOSYS || err == EBADF;
+}
+
+// Clones the whole file; -1 with reflink_unsupported(errno) means the next path should be tried
+static inline int reflink_clone(int src_fd, int dst_fd, off_t size, CopyStats* stats) {
+#ifdef FICLONE
+  stats->syscalls++;
+  if (ioctl(dst_fd, FICLONE, src_fd) == 0) {
+    stats->path  = "reflink (FICLONE)";
+    stats->bytes = size;
+    return 0;
+  }
+#else
+  (void)src_fd;
+  (void)dst_fd;
+  (void)size;
+  (void)stats;
+  errno = ENOTTY;
+#endif
+  return -1;
+}
+
+// copy_file_range() to EOF; -1 with *copied == 0 and reflink_unsupported(errno) means the next path should be tried
+static inline int reflink_copy_range(int src_fd, int dst_fd, off_t* copied, CopyStats* stats) {
+  *copied = 0;
+  while (1) {
+    ssize_t n = copy_file_range(src_fd, NULL, dst_fd, NULL, REFLINK_CHUNK, 0);
+    stats->syscalls++;
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      return -1;
+    }
+    if (n == 0) {
+      stats->path  = "copy_file_range";
+      stats->bytes = *copied;
+      return 0;
+    }
+    *copied += n;
+  }
+}
+
+// Tries FICLONE, then copy_file_range(), then the buffered loop; stats->path says which one worked
+static inline int copy_reflink(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  struct stat st;
+  if (fstat(src_fd, &st) == -1) {
+    return -1;
+  }
+  stats->syscalls++;
+
+  if (reflink_clone(src_fd, dst_fd, st.st_size, stats) == 0) {
+    return 0;
+  }
+  if (!reflink_unsupported(errno)) {
+    return -1;
+  }
+
+  off_t copied;
+  if (reflink_copy_range(src_fd, dst_fd, &copied, stats) == 0) {
+    return 0;
+  }
+  // Nothing copied yet: the whole file can still go through the buffered loop
+  if (copied != 0 || !reflink_unsupported(errno)) {
+    return -1;
+  }
+
+  CopyOptions fallback = *opt;
+  fallback.block_size  = opt->block_size != 0 ? opt->block_size : REFLINK_BLOCK_SIZE;
+  int ret              = copy_buffered(src_fd, dst_fd, &fallback, stats);
+  stats->path          = "read/write (no reflink, no copy_file_range)";
+  return ret;
+}
+
+#endif  // Q3_REFLINK_H
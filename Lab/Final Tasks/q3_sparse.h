@@ -0,0 +1,151 @@
+#ifndef Q3_SPARSE_H
+#define Q3_SPARSE_H
+
+#include "q3_common.h"
+
+#include <string.h>    // for memcmp()
+#include <sys/stat.h>  // for fstat()
+
+//--------------------------------------------------------------------------------
+// off_t lseek(int fd, off_t offset, int whence);   with whence = SEEK_DATA | SEEK_HOLE
+// Brief: Finds the next data extent or the next hole at or after offset
+//
+// Parameters: fd     - File descriptor of a regular file
+//             offset - Where the search starts
+//             whence - SEEK_DATA: first byte of data at or after offset
+//                      SEEK_HOLE: first byte of a hole at or after offset (the end of file counts as a hole)
+//
+// Returns: the resulting offset on success; -1 on failure, setting errno to indicate the error
+//
+// Errors:
+// - ENXIO  - SEEK_DATA: no more data after offset (only a hole up to EOF); or offset is past EOF
+// - EINVAL - whence is not supported by this kernel/filesystem
+//
+// Usage:
+//   off_t data = lseek(fd, pos, SEEK_DATA);  // start of next extent
+//   off_t hole = lseek(fd, data, SEEK_HOLE); // end of that extent
+//   // copy [data, hole), then continue from hole
+//
+// Notes:
+// - Filesystems that do not track holes report the whole file as one data extent,
+//   so zero blocks have to be detected by looking at the data itself
+// - The destination gets its holes back by simply not writing those ranges and setting the size with ftruncate();
+//   an existing destination would need fallocate(FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE) instead
+//
+// Search lseek(2) for more information
+//--------------------------------------------------------------------------------
+
+#define SPARSE_BLOCK_SIZE (1024 * 1024)
+#define SPARSE_ZERO_GRAIN 4096  // granularity of the zero-block fallback (one filesystem block)
+
+static inline int is_zero(const char* buffer, size_t bytes) {
+  return bytes == 0 || (buffer[0] == 0 && memcmp(buffer, buffer + 1, bytes - 1) == 0);
+}
+
+// Writes one block, leaving every all-zero SPARSE_ZERO_GRAIN piece unwritten so it stays a hole
+static inline int write_sparse(int dst_fd, const char* buffer, size_t bytes, off_t offset, CopyStats* stats) {
+  size_t run_start = 0;
+  size_t pos       = 0;
+  while (pos < bytes) {
+    size_t grain = bytes - pos < SPARSE_ZERO_GRAIN ? bytes - pos : SPARSE_ZERO_GRAIN;
+    if (is_zero(buffer + pos, grain)) {
+      // flush the pending non-zero run before the zero grain
+      if (pos > run_start && pwrite_all(dst_fd, buffer + run_start, pos - run_start, offset + run_start, &stats->syscalls) == -1) {
+        return -1;
+      }
+      stats->bytes += pos - run_start;
+      stats->skipped += grain;
+      run_start = pos + grain;
+    }
+    pos += grain;
+  }
+
+  if (bytes > run_start && pwrite_all(dst_fd, buffer + run_start, bytes - run_start, offset + run_start, &stats->syscalls) == -1) {
+    return -1;
+  }
+  stats->bytes += bytes - run_start;
+  return 0;
+}
+
+// Copies only the data extents reported by SEEK_DATA/SEEK_HOLE, then restores the size with ftruncate()
+static inline int copy_sparse(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  size_t block_size = opt->block_size != 0 ? opt->block_size : SPARSE_BLOCK_SIZE;
+
+  struct stat st;
+  if (fstat(src_fd, &st) == -1) {
+    return -1;
+  }
+  stats->syscalls++;
+
+  char* buffer = malloc(block_size);
+  if (buffer == NULL) {
+    return -1;
+  }
+
+  stats->path = "SEEK_DATA/SEEK_HOLE + zero blocks";
+
+  off_t size = st.st_size;
+  off_t pos  = 0;
+  int ret    = 0;
+  while (pos < size) {
+    off_t data = lseek(src_fd, pos, SEEK_DATA);
+    off_t hole = -1;
+    stats->syscalls++;
+    if (data == -1 && errno == ENXIO) {
+      break;  // nothing but a hole up to EOF
+    }
+    if (data == -1 && errno == EINVAL) {
+      // No hole reporting at all: treat the rest as data and rely on zero-block detection
+      stats->path = "zero blocks only";
+      data        = pos;
+      hole        = size;
+    } else if (data == -1) {
+      ret = -1;
+      break;
+    }
+
+    if (hole == -1) {
+      hole = lseek(src_fd, data, SEEK_HOLE);
+      stats->syscalls++;
+      if (hole == -1) {
+        ret = -1;
+        break;
+      }
+    }
+    stats->skipped += data - pos;
+
+    for (off_t offset = data; offset < hole;) {
+      size_t want = (size_t)(hole - offset) < block_size ? (size_t)(hole - offset) : block_size;
+      ssize_t got = pread_full(src_fd, buffer, want, offset, &stats->syscalls);
+      if (got <= 0) {
+        ret  = got == -1 ? -1 : 0;
+        hole = offset;  // file shrank while copying
+        break;
+      }
+      if (write_sparse(dst_fd, buffer, got, offset, stats) == -1) {
+        ret = -1;
+        break;
+      }
+      offset += got;
+    }
+    if (ret == -1) {
+      break;
+    }
+    pos = hole;
+  }
+
+  if (ret == 0 && pos < size) {
+    stats->skipped += size - pos;
+  }
+
+  // Trailing holes and skipped zero blocks only exist once the size is set
+  if (ret == 0 && ftruncate(dst_fd, size) == -1) {
+    ret = -1;
+  }
+  stats->syscalls++;
+
+  free(buffer);
+  return ret;
+}
+
+#endif  // Q3_SPARSE_H
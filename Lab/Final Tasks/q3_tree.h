@@ -0,0 +1,589 @@
+#ifndef Q3_TREE_H
+#define Q3_TREE_H
+
+#include "q3_common.h"
+
+#include <dirent.h>        // for fdopendir(), readdir()
+#include <fcntl.h>         // for openat(), AT_SYMLINK_NOFOLLOW
+#include <limits.h>        // for PATH_MAX
+#include <pthread.h>       // for pthread_create(), mutexes and condition variables
+#include <string.h>        // for strlen(), memcpy()
+#include <sys/resource.h>  // for getrlimit(), RLIMIT_NOFILE
+#include <sys/stat.h>      // for fstatat(), mkdirat(), fchmodat()
+
+//--------------------------------------------------------------------------------
+// int openat(int dir_fd, const char* name, int flags, ... /* mode_t mode */);
+// int fstatat(int dir_fd, const char* name, struct stat* st, int flags);
+// int mkdirat(int dir_fd, const char* name, mode_t mode);
+// Brief: open()/stat()/mkdir() with name resolved relative to an open directory instead of the cwd
+//
+// Parameters: dir_fd - Directory file descriptor (open with O_DIRECTORY), or AT_FDCWD for the cwd
+//             name   - Single path component (or relative path) inside dir_fd
+//             flags  - fstatat(): AT_SYMLINK_NOFOLLOW to stat a symlink itself
+//
+// Returns: openat() a file descriptor; fstatat()/mkdirat() 0; -1 on failure, setting errno to indicate the error
+//
+// Errors:
+// - ENOENT  - name does not exist in dir_fd
+// - ENOTDIR - dir_fd is not a directory
+// - EMFILE  - Too many open files (see the descriptor budget below)
+//
+// Usage:
+//   int dir_fd = open("/src", O_RDONLY | O_DIRECTORY);
+//   int fd     = openat(dir_fd, "file.txt", O_RDONLY);
+//
+// Notes:
+// - The kernel only walks one component per call instead of the whole path from the root every time
+// - Files are opened relative to their directory fd, so they stay correct even if a parent directory is renamed
+//
+// Search openat(2) | fstatat(2) | mkdirat(2) for more information
+//--------------------------------------------------------------------------------
+// DIR* fdopendir(int fd);
+// struct dirent* readdir(DIR* dir);
+// Brief: Iterates the entries of an already open directory
+//
+// Notes:
+// - fdopendir() takes ownership of fd, closedir() closes it, so pass a dup() if the fd is still needed
+// - d_type (DT_REG, DT_DIR, DT_LNK, ...) often saves an fstatat(); DT_UNKNOWN means the filesystem did not fill it
+//
+// Search fdopendir(3) | readdir(3) for more information
+//--------------------------------------------------------------------------------
+// Layout of the recursive copy
+// - Directory readers pop directories, create the matching destination directory and push
+//   every regular file onto the file queue and every subdirectory back onto the directory queue
+// - File copiers pop files and copy them relative to the parent directory fds
+//   -> Files that fit the buffer take the fast path: one read() and one write()
+// - pending counts queued + running tasks; when it drops to zero every worker is woken up to exit
+// - Directory modes are applied after every worker has finished, deepest first, so a read-only directory
+//   never blocks the copy of what is below it
+//
+// Descriptor budget
+// - A queued subdirectory is only its path below the root: it holds no descriptors. A reader opens the
+//   source/destination pair when it pops the directory, and the pair stays open until the reader and every
+//   copier of its files are done with it
+// - At most max_open_dirs pairs are open at once; a reader that would exceed it waits for copiers to close one.
+//   The limit comes from RLIMIT_NOFILE minus the root pair, stdio, two descriptors per copier and one listing
+//   descriptor per reader, so the copy needs O(threads) descriptors whatever the width of the tree
+// - Paths of queued directories are limited to PATH_MAX (ENAMETOOLONG otherwise)
+//--------------------------------------------------------------------------------
+
+#define TREE_BLOCK_SIZE (1024 * 1024)
+#define TREE_MAX_THREADS 64
+#define TREE_MAX_OPEN_DIRS 256
+
+// Open source/destination directory pair shared by the reader and the copiers of its files
+typedef struct {
+  int src_fd;
+  int dst_fd;
+  int refs;
+} DirHandle;
+
+typedef struct TreeTask {
+  struct TreeTask* next;
+  DirHandle* dir;  // directory holding name (file queue); the root or NULL (dir queue)
+  mode_t mode;     // final permissions (dir queue)
+  char name[];     // file name, or directory path below the root ("" for the root)
+} TreeTask;
+
+typedef struct {
+  TreeTask* head;
+  TreeTask* tail;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+} TaskQueue;
+
+typedef struct {
+  TaskQueue dirs;
+  TaskQueue files;
+  DirHandle* root;
+  pthread_mutex_t open_lock;  // guards open_dirs and read_dirs
+  pthread_cond_t closed;
+  size_t open_dirs;
+  size_t max_open_dirs;
+  TreeTask* read_dirs;  // directories already read, for their final mode
+  size_t pending;
+  int done;
+  int error;  // errno of the first failure
+  size_t block_size;
+  uint64_t bytes;
+  uint64_t files_copied;
+  uint64_t syscalls;
+} TreeCopy;
+
+static inline void dir_release(TreeCopy* tree, DirHandle* dir) {
+  if (__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+  close(dir->src_fd);
+  close(dir->dst_fd);
+  free(dir);
+
+  pthread_mutex_lock(&tree->open_lock);
+  tree->open_dirs--;
+  pthread_cond_signal(&tree->closed);
+  pthread_mutex_unlock(&tree->open_lock);
+}
+
+static inline void tree_fail(TreeCopy* tree, const char* what, const char* name) {
+  int err = errno;
+  (void)fprintf(stderr, "q3: %s %s: %s\n", what, name, strerror(err));
+  int expected = 0;
+  __atomic_compare_exchange_n(&tree->error, &expected, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static inline int tree_push(TreeCopy* tree, TaskQueue* queue, DirHandle* dir, mode_t mode, const char* name) {
+  size_t len     = strlen(name) + 1;
+  TreeTask* task = malloc(sizeof(TreeTask) + len);
+  if (task == NULL) {
+    return -1;
+  }
+  task->next = NULL;
+  task->dir  = dir;
+  task->mode = mode;
+  memcpy(task->name, name, len);
+
+  __atomic_add_fetch(&tree->pending, 1, __ATOMIC_ACQ_REL);
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail == NULL) {
+    queue->head = task;
+  } else {
+    queue->tail->next = task;
+  }
+  queue->tail = task;
+  pthread_cond_signal(&queue->ready);
+  pthread_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+// Blocks until a task is available; returns NULL once the whole tree is done
+static inline TreeTask* tree_pop(TreeCopy* tree, TaskQueue* queue) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->head == NULL && !__atomic_load_n(&tree->done, __ATOMIC_ACQUIRE)) {
+    pthread_cond_wait(&queue->ready, &queue->lock);
+  }
+  TreeTask* task = queue->head;
+  if (task != NULL) {
+    queue->head = task->next;
+    if (queue->head == NULL) {
+      queue->tail = NULL;
+    }
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return task;
+}
+
+// Wakes every worker so it sees done (and every reader waiting for a directory slot)
+static inline void tree_wake_all(TreeCopy* tree) {
+  TaskQueue* queues[2] = {&tree->dirs, &tree->files};
+  for (int i = 0; i < 2; i++) {
+    pthread_mutex_lock(&queues[i]->lock);
+    pthread_cond_broadcast(&queues[i]->ready);
+    pthread_mutex_unlock(&queues[i]->lock);
+  }
+  pthread_mutex_lock(&tree->open_lock);
+  pthread_cond_broadcast(&tree->closed);
+  pthread_mutex_unlock(&tree->open_lock);
+}
+
+static inline void tree_task_finished(TreeCopy* tree) {
+  if (__atomic_sub_fetch(&tree->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    __atomic_store_n(&tree->done, 1, __ATOMIC_RELEASE);
+    tree_wake_all(tree);
+  }
+}
+
+static inline void tree_task_done(TreeCopy* tree, TreeTask* task) {
+  dir_release(tree, task->dir);
+  free(task);
+  tree_task_finished(tree);
+}
+
+// Copies one regular file; small files take one read() and one write()
+static inline int tree_copy_file(TreeCopy* tree, DirHandle* dir, const char* name, char* buffer, uint64_t* syscalls) {
+  int src_fd = openat(dir->src_fd, name, O_RDONLY | O_NOFOLLOW);
+  (*syscalls)++;
+  if (src_fd == -1) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(src_fd, &st) == -1) {
+    close(src_fd);
+    return -1;
+  }
+
+  int dst_fd = openat(dir->dst_fd, name, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777);
+  *syscalls += 2;
+  if (dst_fd == -1) {
+    close(src_fd);
+    return -1;
+  }
+
+  uint64_t copied = 0;
+  int ret         = 0;
+  int finished    = 0;
+  if ((size_t)st.st_size < tree->block_size) {
+    // Fast path: ask for one byte more than fstat() reported so EOF is seen in the same call
+    ssize_t got = read(src_fd, buffer, (size_t)st.st_size + 1);
+    (*syscalls)++;
+    if (got == -1 || write_all(dst_fd, buffer, got, syscalls) == -1) {
+      ret      = -1;
+      finished = 1;
+    } else {
+      copied   = got;
+      finished = got == st.st_size;  // otherwise it grew or the read came back short
+    }
+  }
+
+  if (!finished) {
+    ssize_t got;
+    while ((got = read(src_fd, buffer, tree->block_size)) > 0) {
+      (*syscalls)++;
+      if (write_all(dst_fd, buffer, got, syscalls) == -1) {
+        ret = -1;
+        break;
+      }
+      copied += got;
+    }
+    (*syscalls)++;
+    if (got == -1) {
+      ret = -1;
+    }
+  }
+
+  int err = errno;
+  close(src_fd);
+  close(dst_fd);
+  *syscalls += 2;
+  errno = err;
+
+  __atomic_add_fetch(&tree->bytes, copied, __ATOMIC_RELAXED);
+  return ret;
+}
+
+static void* tree_copier(void* arg) {
+  TreeCopy* tree    = (TreeCopy*)arg;
+  uint64_t syscalls = 0;
+  char* buffer      = malloc(tree->block_size + 1);
+  if (buffer == NULL) {
+    tree_fail(tree, "malloc", "copy buffer");
+  }
+
+  TreeTask* task;
+  while ((task = tree_pop(tree, &tree->files)) != NULL) {
+    if (buffer != NULL) {
+      if (tree_copy_file(tree, task->dir, task->name, buffer, &syscalls) == -1) {
+        tree_fail(tree, "copy", task->name);
+      } else {
+        __atomic_add_fetch(&tree->files_copied, 1, __ATOMIC_RELAXED);
+      }
+    }
+    tree_task_done(tree, task);
+  }
+
+  free(buffer);
+  __atomic_add_fetch(&tree->syscalls, syscalls, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+// Opens the source/destination pair of a queued directory once a slot of the descriptor budget is free
+static inline DirHandle* tree_open_dir(TreeCopy* tree, const char* path, uint64_t* syscalls) {
+  pthread_mutex_lock(&tree->open_lock);
+  while (tree->open_dirs >= tree->max_open_dirs && !__atomic_load_n(&tree->done, __ATOMIC_ACQUIRE)) {
+    pthread_cond_wait(&tree->closed, &tree->open_lock);
+  }
+  tree->open_dirs++;
+  pthread_mutex_unlock(&tree->open_lock);
+
+  DirHandle* dir = malloc(sizeof(DirHandle));
+  if (dir == NULL) {
+    tree_fail(tree, "malloc", path);
+  } else {
+    dir->refs   = 1;
+    dir->src_fd = openat(tree->root->src_fd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    dir->dst_fd = dir->src_fd == -1 ? -1 : openat(tree->root->dst_fd, path, O_RDONLY | O_DIRECTORY);
+    *syscalls += 2;
+    if (dir->src_fd != -1 && dir->dst_fd != -1) {
+      return dir;
+    }
+    tree_fail(tree, "open", path);
+    if (dir->src_fd != -1) {
+      close(dir->src_fd);
+    }
+    free(dir);
+  }
+
+  pthread_mutex_lock(&tree->open_lock);
+  tree->open_dirs--;
+  pthread_cond_signal(&tree->closed);
+  pthread_mutex_unlock(&tree->open_lock);
+  return NULL;
+}
+
+// Reads one directory: files go to the copiers, subdirectories back onto the directory queue
+static inline void tree_read_dir(TreeCopy* tree, DirHandle* dir, const char* path, uint64_t* syscalls) {
+  int list_fd = dup(dir->src_fd);
+  DIR* stream = list_fd == -1 ? NULL : fdopendir(list_fd);
+  *syscalls += 2;
+  if (stream == NULL) {
+    if (list_fd != -1) {
+      close(list_fd);
+    }
+    tree_fail(tree, "opendir", "directory");
+    return;
+  }
+  rewinddir(stream);  // the dup shares its offset with src_fd
+
+  struct dirent* entry;
+  while ((entry = readdir(stream)) != NULL) {
+    const char* name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      continue;
+    }
+
+    struct stat st;
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN || type == DT_DIR) {
+      // directories need their mode; unknown types need classifying
+      if (fstatat(dir->src_fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+        tree_fail(tree, "stat", name);
+        continue;
+      }
+      (*syscalls)++;
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+    }
+
+    if (type == DT_REG) {
+      __atomic_add_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL);
+      if (tree_push(tree, &tree->files, dir, 0, name) == -1) {
+        dir_release(tree, dir);
+        tree_fail(tree, "queue", name);
+      }
+    } else if (type == DT_DIR) {
+      // Create it writable for now; the real mode is applied once everything below is copied
+      if (mkdirat(dir->dst_fd, name, S_IRWXU) == -1 && errno != EEXIST) {
+        tree_fail(tree, "mkdir", name);
+        continue;
+      }
+      (*syscalls)++;
+      char child[PATH_MAX];
+      int len = snprintf(child, sizeof(child), "%s%s%s", path, path[0] != '\0' ? "/" : "", name);
+      if (len < 0 || (size_t)len >= sizeof(child)) {
+        errno = ENAMETOOLONG;
+        tree_fail(tree, "queue", name);
+        continue;
+      }
+      // Queued by path only: its descriptors are opened when a reader pops it
+      if (tree_push(tree, &tree->dirs, NULL, st.st_mode & 07777, child) == -1) {
+        tree_fail(tree, "queue", name);
+      }
+    } else if (type == DT_LNK) {
+      char target[PATH_MAX];
+      ssize_t len = readlinkat(dir->src_fd, name, target, sizeof(target) - 1);
+      *syscalls += 2;
+      if (len == -1) {
+        tree_fail(tree, "readlink", name);
+        continue;
+      }
+      target[len] = '\0';
+      if (symlinkat(target, dir->dst_fd, name) == -1 && errno != EEXIST) {
+        tree_fail(tree, "symlink", name);
+      }
+    }
+    // sockets, FIFOs and device nodes are not copied
+  }
+  (*syscalls)++;
+  closedir(stream);
+}
+
+static void* tree_reader(void* arg) {
+  TreeCopy* tree    = (TreeCopy*)arg;
+  uint64_t syscalls = 0;
+
+  TreeTask* task;
+  while ((task = tree_pop(tree, &tree->dirs)) != NULL) {
+    DirHandle* dir = task->dir != NULL ? task->dir : tree_open_dir(tree, task->name, &syscalls);
+    if (dir != NULL) {
+      tree_read_dir(tree, dir, task->name, &syscalls);
+      dir_release(tree, dir);
+    }
+
+    // Keep the task for its final mode: the copiers may still be writing below this directory
+    task->dir = NULL;
+    pthread_mutex_lock(&tree->open_lock);
+    task->next      = tree->read_dirs;
+    tree->read_dirs = task;
+    pthread_mutex_unlock(&tree->open_lock);
+    tree_task_finished(tree);
+  }
+
+  __atomic_add_fetch(&tree->syscalls, syscalls, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+static inline int tree_depth(const char* path) {
+  int depth = path[0] != '\0';
+  for (; *path != '\0'; path++) {
+    depth += *path == '/';
+  }
+  return depth;
+}
+
+static inline int tree_deeper_first(const void* a, const void* b) {
+  return tree_depth((*(TreeTask* const*)b)->name) - tree_depth((*(TreeTask* const*)a)->name);
+}
+
+static inline void tree_apply_mode(TreeCopy* tree, const TreeTask* task) {
+  (void)fchmodat(tree->root->dst_fd, task->name[0] != '\0' ? task->name : ".", task->mode, 0);
+}
+
+// Applies the source modes to the copied directories, deepest first, and frees their tasks
+static inline void tree_apply_modes(TreeCopy* tree) {
+  size_t count = 0;
+  for (TreeTask* task = tree->read_dirs; task != NULL; task = task->next) {
+    count++;
+  }
+
+  TreeTask** sorted = malloc((count + 1) * sizeof(TreeTask*));
+  if (sorted != NULL) {
+    size_t i = 0;
+    for (TreeTask* task = tree->read_dirs; task != NULL; task = task->next) {
+      sorted[i++] = task;
+    }
+    qsort(sorted, count, sizeof(TreeTask*), tree_deeper_first);
+    for (i = 0; i < count; i++) {
+      tree_apply_mode(tree, sorted[i]);
+    }
+    free(sorted);
+  } else {
+    // Newest first: children were mostly read after their parents, so this is roughly deepest first
+    for (TreeTask* task = tree->read_dirs; task != NULL; task = task->next) {
+      tree_apply_mode(tree, task);
+    }
+  }
+
+  while (tree->read_dirs != NULL) {
+    TreeTask* next = tree->read_dirs->next;
+    free(tree->read_dirs);
+    tree->read_dirs = next;
+  }
+}
+
+// Recursively copies the contents of src_dir into dst_dir (created if missing)
+//   ./q3 -r -t 16 -v src_tree dst_tree      versus      time cp -r src_tree dst_tree
+static inline int copy_tree(const char* src_dir, const char* dst_dir, const CopyOptions* opt, CopyStats* stats) {
+  unsigned copiers = opt->threads != 0 ? opt->threads : 4;
+  if (copiers > TREE_MAX_THREADS) {
+    copiers = TREE_MAX_THREADS;
+  }
+  unsigned readers = (copiers + 3) / 4;  // directory reading is cheap next to copying
+
+  struct stat st;
+  if (stat(src_dir, &st) == -1) {
+    return -1;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    errno = ENOTDIR;
+    return -1;
+  }
+  if (mkdir(dst_dir, S_IRWXU) == -1 && errno != EEXIST) {
+    return -1;
+  }
+
+  DirHandle* root = malloc(sizeof(DirHandle));
+  if (root == NULL) {
+    return -1;
+  }
+  root->refs   = 1;  // held by copy_tree() until the end, so it never counts against max_open_dirs
+  root->src_fd = open(src_dir, O_RDONLY | O_DIRECTORY);
+  root->dst_fd = open(dst_dir, O_RDONLY | O_DIRECTORY);
+  if (root->src_fd == -1 || root->dst_fd == -1) {
+    int err = errno;
+    if (root->src_fd != -1) {
+      close(root->src_fd);
+    }
+    free(root);
+    errno = err;
+    return -1;
+  }
+
+  TreeCopy tree;
+  memset(&tree, 0, sizeof(tree));
+  tree.block_size    = opt->block_size != 0 ? opt->block_size : TREE_BLOCK_SIZE;
+  tree.root          = root;
+  tree.max_open_dirs = TREE_MAX_OPEN_DIRS;
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+    // stdio and the root pair, a source/destination pair per copier and a listing per reader
+    rlim_t reserved    = 8 + 2 * (rlim_t)copiers + readers;
+    rlim_t budget      = limit.rlim_cur > reserved + 2 ? (limit.rlim_cur - reserved) / 2 : 1;
+    tree.max_open_dirs = budget < TREE_MAX_OPEN_DIRS ? budget : TREE_MAX_OPEN_DIRS;
+  }
+  pthread_mutex_init(&tree.dirs.lock, NULL);
+  pthread_mutex_init(&tree.files.lock, NULL);
+  pthread_mutex_init(&tree.open_lock, NULL);
+  pthread_cond_init(&tree.dirs.ready, NULL);
+  pthread_cond_init(&tree.files.ready, NULL);
+  pthread_cond_init(&tree.closed, NULL);
+
+  root->refs++;  // the root task reads through the already open pair
+  if (tree_push(&tree, &tree.dirs, root, st.st_mode & 07777, "") == -1) {
+    close(root->src_fd);
+    close(root->dst_fd);
+    free(root);
+    return -1;
+  }
+
+  pthread_t ids[TREE_MAX_THREADS + TREE_MAX_THREADS / 4 + 1];
+  unsigned created         = 0;
+  unsigned created_readers = 0;
+  for (unsigned i = 0; i < readers + copiers; i++) {
+    if (pthread_create(&ids[created], NULL, i < readers ? tree_reader : tree_copier, &tree) != 0) {
+      break;
+    }
+    created++;
+    created_readers += i < readers;
+  }
+
+  if (created_readers == 0 || created == created_readers) {
+    // Without at least one reader and one copier the queues never drain: stop everyone that did start
+    errno = EAGAIN;
+    tree_fail(&tree, "pthread_create", "workers");
+    __atomic_store_n(&tree.done, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&tree.dirs.lock);
+    tree.dirs.head = NULL;  // abandon queued work
+    pthread_mutex_unlock(&tree.dirs.lock);
+    pthread_mutex_lock(&tree.files.lock);
+    tree.files.head = NULL;
+    pthread_mutex_unlock(&tree.files.lock);
+    tree_wake_all(&tree);
+  }
+
+  for (unsigned i = 0; i < created; i++) {
+    pthread_join(ids[i], NULL);
+  }
+
+  tree_apply_modes(&tree);
+  close(root->src_fd);
+  close(root->dst_fd);
+  free(root);
+  pthread_mutex_destroy(&tree.dirs.lock);
+  pthread_mutex_destroy(&tree.files.lock);
+  pthread_mutex_destroy(&tree.open_lock);
+  pthread_cond_destroy(&tree.dirs.ready);
+  pthread_cond_destroy(&tree.files.ready);
+  pthread_cond_destroy(&tree.closed);
+
+  stats->path     = "parallel tree (openat/fstatat)";
+  stats->bytes    = tree.bytes;
+  stats->files    = tree.files_copied;
+  stats->syscalls = tree.syscalls;
+
+  if (tree.error != 0) {
+    errno = tree.error;
+    return -1;
+  }
+  return 0;
+}
+
+#endif  // Q3_TREE_H
@@ -0,0 +1,173 @@
+#ifndef Q3_TUNED_H
+#define Q3_TUNED_H
+
+#include "q3_common.h"
+
+#include <fcntl.h>     // for posix_fadvise(), fcntl(), O_DIRECT
+#include <sys/stat.h>  // for fstat()
+
+//--------------------------------------------------------------------------------
+// int posix_fadvise(int fd, off_t offset, off_t len, int advice);
+// Brief: Tells the kernel how a byte range of a file is going to be used
+//
+// Parameters: fd     - Open file descriptor
+//             offset - Start of the range
+//             len    - Length of the range; 0 means "to the end of the file"
+//             advice - POSIX_FADV_SEQUENTIAL: read-ahead more aggressively
+//                      POSIX_FADV_DONTNEED:   drop the range from the page cache
+//
+// Returns: 0 on success; an error number on failure (errno is NOT set)
+//
+// Errors:
+// - EBADF  - fd is not a valid file descriptor
+// - ESPIPE - fd refers to a pipe or FIFO
+//
+// Usage:
+//   posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+//   // ... copy a window ...
+//   posix_fadvise(src_fd, window_start, window_len, POSIX_FADV_DONTNEED);
+//
+// Notes:
+// - DONTNEED only drops clean pages; on dirty pages it starts writeback, so a second call later drops them
+// - Advice is a hint, the kernel may ignore it
+//
+// Search posix_fadvise(2) for more information
+//--------------------------------------------------------------------------------
+// O_DIRECT (open(2) / fcntl(F_SETFL) flag)
+// Brief: Transfers data straight between the user buffer and the device, bypassing the page cache
+//
+// Notes:
+// - Buffer address, file offset and length must all be multiples of the logical block size (4096 is safe)
+// - The final partial block of a file cannot be written with O_DIRECT; clear the flag and write it normally
+// - Filesystems without support (tmpfs on older kernels) fail with EINVAL
+// - Linux allows toggling O_DIRECT on an open descriptor with fcntl(fd, F_SETFL, ...)
+//
+// Search open(2) for more information
+//--------------------------------------------------------------------------------
+
+#define TUNED_MIN_BLOCK (128 * 1024)
+#define TUNED_MAX_BLOCK (8 * 1024 * 1024)
+#define DIRECT_ALIGN 4096
+#define FADVISE_WINDOW (32 * 1024 * 1024)
+
+// Picks a block size that amortizes syscalls over roughly 64 requests, clamped to [128 KiB, 8 MiB]
+static inline size_t adaptive_block_size(off_t file_size) {
+  size_t block = TUNED_MIN_BLOCK;
+  while (block < TUNED_MAX_BLOCK && (off_t)block * 64 < file_size) {
+    block <<= 1;
+  }
+  return block;
+}
+
+static inline int set_direct(int fd, int enable) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1) {
+    return -1;
+  }
+  flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+  return fcntl(fd, F_SETFL, flags);
+}
+
+// Large-block copy with optional page cache advice (-F) and O_DIRECT (-D)
+static inline int copy_tuned(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  struct stat st;
+  if (fstat(src_fd, &st) == -1) {
+    return -1;
+  }
+  stats->syscalls++;
+
+  size_t block_size = opt->block_size != 0 ? opt->block_size : adaptive_block_size(st.st_size);
+  int direct        = opt->direct;
+  if (direct) {
+    // O_DIRECT needs whole aligned blocks
+    block_size = (block_size + DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1);
+    if (set_direct(src_fd, 1) == -1 || set_direct(dst_fd, 1) == -1) {
+      if (errno != EINVAL) {
+        return -1;
+      }
+      set_direct(src_fd, 0);
+      direct = 0;  // filesystem does not support it, carry on through the page cache
+    }
+  }
+  stats->path = direct ? (opt->fadvise ? "O_DIRECT + fadvise" : "O_DIRECT") : (opt->fadvise ? "large blocks + fadvise" : "large blocks");
+
+  if (opt->fadvise) {
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(dst_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    stats->syscalls += 2;
+  }
+
+  char* buffer;
+  if (posix_memalign((void**)&buffer, DIRECT_ALIGN, block_size) != 0) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  off_t offset       = 0;
+  off_t advised      = 0;  // everything below this offset was already advised DONTNEED
+  off_t prev_advised = 0;
+  int ret            = 0;
+  while (1) {
+    ssize_t got = read(src_fd, buffer, block_size);
+    stats->syscalls++;
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got == -1) {
+      ret = -1;
+      break;
+    }
+    if (got == 0) {
+      break;
+    }
+
+    size_t head = (size_t)got;
+    if (direct && (got % DIRECT_ALIGN) != 0) {
+      // Tail (or an odd short read): write the aligned part directly, the rest through the page cache
+      head = (size_t)got & ~(size_t)(DIRECT_ALIGN - 1);
+    }
+    if (head > 0 && write_all(dst_fd, buffer, head, &stats->syscalls) == -1) {
+      ret = -1;
+      break;
+    }
+    if (head < (size_t)got) {
+      if (set_direct(src_fd, 0) == -1 || set_direct(dst_fd, 0) == -1) {
+        ret = -1;
+        break;
+      }
+      stats->syscalls += 4;
+      direct = 0;
+      if (write_all(dst_fd, buffer + head, got - head, &stats->syscalls) == -1) {
+        ret = -1;
+        break;
+      }
+    }
+    stats->bytes += got;
+    offset += got;
+
+    if (opt->fadvise && offset - advised >= FADVISE_WINDOW) {
+      // Drop the source window, start writeback of the destination window, and drop the previous
+      // destination window which by now should be clean
+      posix_fadvise(src_fd, advised, offset - advised, POSIX_FADV_DONTNEED);
+      posix_fadvise(dst_fd, advised, offset - advised, POSIX_FADV_DONTNEED);
+      stats->syscalls += 2;
+      if (advised > prev_advised) {  // a zero length would mean "to the end of the file"
+        posix_fadvise(dst_fd, prev_advised, advised - prev_advised, POSIX_FADV_DONTNEED);
+        stats->syscalls++;
+      }
+      prev_advised = advised;
+      advised      = offset;
+    }
+  }
+
+  if (opt->fadvise && ret == 0) {
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED);
+    posix_fadvise(dst_fd, 0, 0, POSIX_FADV_DONTNEED);
+    stats->syscalls += 2;
+  }
+
+  free(buffer);
+  return ret;
+}
+
+#endif  // Q3_TUNED_H
@@ -0,0 +1,397 @@
+#ifndef Q3_URING_H
+#define Q3_URING_H
+
+#include "q3_common.h"
+
+#include <string.h>    // for memset()
+#include <sys/mman.h>  // for mmap(), munmap()
+#include <sys/stat.h>  // for fstat()
+#include <sys/uio.h>   // for struct iovec
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define Q3_HAVE_URING 1
+#endif
+#endif
+#endif
+
+//--------------------------------------------------------------------------------
+// int io_uring_setup(unsigned entries, struct io_uring_params* params);
+// Brief: Creates a submission queue (SQ) and completion queue (CQ) shared between the process and the kernel
+//
+// Parameters: entries - Number of submission queue entries (rounded up to a power of two)
+//             params  - Setup flags in, ring offsets and supported features out
+//
+// Returns: a ring file descriptor on success; -1 on failure, setting errno to indicate the error
+//
+// Errors:
+// - ENOSYS - The kernel was built without io_uring
+// - EPERM  - io_uring is disabled (sysctl kernel.io_uring_disabled) or filtered by seccomp
+// - ENOMEM - Insufficient kernel resources for the rings
+//
+// Usage:
+//   struct io_uring_params p;
+//   memset(&p, 0, sizeof(p));
+//   int ring_fd = syscall(__NR_io_uring_setup, 64, &p);
+//   // mmap() the SQ ring, CQ ring and SQE array using the offsets in p.sq_off and p.cq_off
+//
+// Notes:
+// - No glibc wrapper exists; liburing wraps these calls, here they are issued through syscall()
+// - With IORING_FEAT_SINGLE_MMAP the SQ and CQ rings share one mapping
+//
+// Search io_uring_setup(2) for more information
+//--------------------------------------------------------------------------------
+// int io_uring_register(int ring_fd, unsigned opcode, void* arg, unsigned nr_args);
+// Brief: Registers long-lived resources with a ring
+//
+// Parameters: ring_fd - Descriptor returned by io_uring_setup()
+//             opcode  - IORING_REGISTER_BUFFERS (arg is struct iovec[]) or IORING_REGISTER_FILES (arg is int[])
+//             nr_args - Number of entries in arg
+//
+// Returns: 0 on success; -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - Registered buffers are pinned once instead of on every request (IORING_OP_READ_FIXED / WRITE_FIXED)
+// - Registered files skip the per-request fd table lookup (IOSQE_FIXED_FILE, fd field becomes an index)
+// - Pinned memory counts against RLIMIT_MEMLOCK on older kernels
+//   -> copy_uring() then falls back to plain IORING_OP_READ/WRITE on unregistered buffers (ENOMEM), and to
+//      ordinary fds if the files cannot be registered; only the setup itself failing drops io_uring altogether
+//
+// Search io_uring_register(2) for more information
+//--------------------------------------------------------------------------------
+// int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags, sigset_t* sig);
+// Brief: Submits queued SQEs and optionally waits for completions
+//
+// Parameters: to_submit    - Number of new SQEs published at the SQ tail
+//             min_complete - Completions to wait for when IORING_ENTER_GETEVENTS is set
+//
+// Returns: number of SQEs consumed on success; -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - One call both submits a batch and reaps completions, which is where the syscall savings come from
+// - IOSQE_IO_LINK chains the next SQE so a write only starts after its read completed in full
+//   -> If the read comes back short the linked write completes with -ECANCELED
+//
+// Search io_uring_enter(2) for more information
+//--------------------------------------------------------------------------------
+
+#define URING_BLOCK_SIZE (128 * 1024)
+#define URING_MAX_DEPTH 256
+
+#ifdef Q3_HAVE_URING
+
+typedef struct {
+  int fd;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  struct io_uring_cqe* cqes;
+  struct io_uring_sqe* sqes;
+  void* sq_ptr;
+  void* cq_ptr;
+  size_t sq_len;
+  size_t cq_len;
+  size_t sqes_len;
+  unsigned pending;  // SQEs queued but not yet handed to io_uring_enter()
+  int fixed_files;   // the fd field is an index into the registered files
+  int files[2];      // source and destination, for when they are not registered
+} Ring;
+
+// One slot owns one registered buffer and carries a read -> write chain for a single block
+typedef struct {
+  off_t offset;
+  size_t length;
+  int read_res;
+  int busy;
+} UringSlot;
+
+static inline void ring_close(Ring* ring) {
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+    munmap(ring->sqes, ring->sqes_len);
+  }
+  if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+    munmap(ring->cq_ptr, ring->cq_len);
+  }
+  if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED) {
+    munmap(ring->sq_ptr, ring->sq_len);
+  }
+  if (ring->fd != -1) {
+    close(ring->fd);
+  }
+}
+
+static inline int ring_open(Ring* ring, unsigned entries) {
+  memset(ring, 0, sizeof(*ring));
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (ring->fd == -1) {
+    return -1;
+  }
+
+  ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_len > ring->sq_len) {
+      ring->sq_len = ring->cq_len;
+    }
+    ring->cq_len = ring->sq_len;
+  }
+
+  ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ptr == MAP_FAILED) {
+    ring_close(ring);
+    return -1;
+  }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ptr = ring->sq_ptr;
+  } else {
+    ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) {
+      ring_close(ring);
+      return -1;
+    }
+  }
+
+  ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes     = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring_close(ring);
+    return -1;
+  }
+
+  char* sq       = ring->sq_ptr;
+  char* cq       = ring->cq_ptr;
+  ring->sq_head  = (unsigned*)(sq + p.sq_off.head);
+  ring->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+  ring->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned*)(sq + p.sq_off.array);
+  ring->cq_head  = (unsigned*)(cq + p.cq_off.head);
+  ring->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+  ring->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+  ring->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  return 0;
+}
+
+// Queues one SQE on file 0 (source) or 1 (destination); the caller guarantees there is room (2 SQEs per slot,
+// ring sized for every slot)
+static inline void ring_queue(Ring* ring, uint8_t opcode, int file_index, void* addr, unsigned len, off_t offset, uint16_t buf_index,
+                              uint8_t flags, uint64_t user_data) {
+  unsigned tail            = *ring->sq_tail;
+  unsigned index           = tail & *ring->sq_mask;
+  struct io_uring_sqe* sqe = &ring->sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = opcode;
+  sqe->flags     = flags | (ring->fixed_files ? IOSQE_FIXED_FILE : 0);
+  sqe->fd        = ring->fixed_files ? file_index : ring->files[file_index];
+  sqe->addr      = (uint64_t)(uintptr_t)addr;
+  sqe->len       = len;
+  sqe->off       = (uint64_t)offset;
+  sqe->buf_index = buf_index;
+  sqe->user_data = user_data;
+
+  ring->sq_array[index] = index;
+
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->pending++;
+}
+
+// Waits for the CQEs of every submitted SQE, so no request still targets the buffers once they are freed
+static inline int ring_drain(Ring* ring, unsigned outstanding) {
+  while (1) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    outstanding -= tail - head < outstanding ? tail - head : outstanding;
+    __atomic_store_n(ring->cq_head, tail, __ATOMIC_RELEASE);
+    if (outstanding == 0) {
+      return 0;
+    }
+    if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 && errno != EINTR) {
+      return -1;
+    }
+  }
+}
+
+// Finishes a slot whose chain was broken by a short read or write, using plain pread/pwrite
+static inline int uring_finish_slot(int src_fd, int dst_fd, char* buffer, const UringSlot* slot, CopyStats* stats) {
+  ssize_t got = pread_full(src_fd, buffer, slot->length, slot->offset, &stats->syscalls);
+  if (got == -1) {
+    return -1;
+  }
+  if (pwrite_all(dst_fd, buffer, got, slot->offset, &stats->syscalls) == -1) {
+    return -1;
+  }
+  stats->bytes += got;
+  return 0;
+}
+
+// Keeps up to queue_depth linked read -> write chains in flight, over registered buffers and files when it can
+static inline int copy_uring(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  size_t block_size = opt->block_size != 0 ? opt->block_size : URING_BLOCK_SIZE;
+  unsigned depth    = opt->queue_depth != 0 ? opt->queue_depth : 32;
+  if (depth > URING_MAX_DEPTH) {
+    depth = URING_MAX_DEPTH;
+  }
+  if (block_size > (1U << 30)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(src_fd, &st) == -1) {
+    return -1;
+  }
+  stats->syscalls++;
+
+  Ring ring;
+  if (ring_open(&ring, depth * 2) == -1) {
+    if (errno == ENOSYS || errno == EPERM || errno == ENOMEM) {
+      // Kernel without io_uring, with it disabled or out of locked memory: keep the block size, lose the queue depth
+      CopyOptions fallback = *opt;
+      fallback.block_size  = block_size;
+      int ret              = copy_buffered(src_fd, dst_fd, &fallback, stats);
+      stats->path          = "read/write (io_uring unavailable)";
+      return ret;
+    }
+    return -1;
+  }
+  stats->syscalls++;
+
+  int ret              = -1;
+  unsigned outstanding = 0;  // submitted SQEs whose CQE has not been reaped
+  char* arena          = NULL;
+  UringSlot* slots     = calloc(depth, sizeof(UringSlot));
+  struct iovec* iov    = calloc(depth, sizeof(struct iovec));
+  if (slots == NULL || iov == NULL || posix_memalign((void**)&arena, 4096, block_size * depth) != 0) {
+    arena = NULL;
+    errno = ENOMEM;
+    goto out;
+  }
+
+  for (unsigned i = 0; i < depth; i++) {
+    iov[i].iov_base = arena + i * block_size;
+    iov[i].iov_len  = block_size;
+  }
+
+  // Registration only saves per-request work: without it (RLIMIT_MEMLOCK, seccomp, ...) use plain buffers and fds
+  ring.files[0]     = src_fd;
+  ring.files[1]     = dst_fd;
+  int fixed_buffers = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iov, depth) == 0;
+  ring.fixed_files  = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_FILES, ring.files, 2) == 0;
+  stats->syscalls += 2;
+  stats->path = fixed_buffers ? (ring.fixed_files ? "io_uring (fixed buffers, fixed files)" : "io_uring (fixed buffers)")
+                              : (ring.fixed_files ? "io_uring (fixed files)" : "io_uring");
+  uint8_t read_op  = fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  uint8_t write_op = fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+
+  off_t size        = st.st_size;
+  off_t next_offset = 0;
+  unsigned inflight = 0;  // busy slots
+  int error         = 0;
+
+  while ((next_offset < size || inflight > 0) && error == 0) {
+    // Refill every free slot with a new read -> write chain
+    for (unsigned i = 0; i < depth && next_offset < size; i++) {
+      if (slots[i].busy) {
+        continue;
+      }
+      size_t len = (size_t)(size - next_offset) < block_size ? (size_t)(size - next_offset) : block_size;
+      slots[i]   = (UringSlot){next_offset, len, 0, 1};
+      uint16_t buf_index = fixed_buffers ? (uint16_t)i : 0;
+      ring_queue(&ring, read_op, 0, iov[i].iov_base, len, next_offset, buf_index, IOSQE_IO_LINK, (uint64_t)i << 1);
+      ring_queue(&ring, write_op, 1, iov[i].iov_base, len, next_offset, buf_index, 0, ((uint64_t)i << 1) | 1);
+      next_offset += len;
+      inflight++;
+    }
+
+    int submitted = (int)syscall(__NR_io_uring_enter, ring.fd, ring.pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    stats->syscalls++;
+    if (submitted == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      goto out;
+    }
+    ring.pending -= (unsigned)submitted;
+    outstanding += (unsigned)submitted;
+
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    // Every CQE is consumed even after a failure, so that outstanding stays exact for ring_drain()
+    for (; head != tail; head++, outstanding--) {
+      struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+      UringSlot* slot          = &slots[cqe->user_data >> 1];
+      int is_write             = (int)(cqe->user_data & 1);
+
+      if (!is_write) {
+        slot->read_res = cqe->res;
+        continue;
+      }
+
+      // The write CQE always arrives last, so the slot is done either way
+      slot->busy = 0;
+      inflight--;
+      if (error != 0) {
+        continue;
+      }
+      if (slot->read_res < 0) {
+        error = -slot->read_res;
+      } else if (cqe->res == (int)slot->length) {
+        stats->bytes += slot->length;
+      } else if (cqe->res == -ECANCELED || cqe->res >= 0) {
+        if (uring_finish_slot(src_fd, dst_fd, iov[cqe->user_data >> 1].iov_base, slot, stats) == -1) {
+          error = errno;
+        }
+      } else {
+        error = -cqe->res;
+      }
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  if (error != 0) {
+    errno = error;
+  } else {
+    ret = 0;
+  }
+
+out:
+  if (ret == -1) {
+    // Chains still in flight read into and write from the arena: wait for them before it is freed
+    int err = errno;
+    if (ring_drain(&ring, outstanding) == -1) {
+      arena = NULL;  // could not wait: leak the arena rather than let the kernel write into freed memory
+    }
+    errno = err;
+  }
+  ring_close(&ring);
+  free(arena);
+  free(iov);
+  free(slots);
+  return ret;
+}
+
+#else  // !Q3_HAVE_URING
+
+// Built without io_uring headers: the method still exists but degrades to the buffered loop
+static inline int copy_uring(int src_fd, int dst_fd, const CopyOptions* opt, CopyStats* stats) {
+  CopyOptions fallback = *opt;
+  fallback.block_size  = opt->block_size != 0 ? opt->block_size : URING_BLOCK_SIZE;
+  int ret              = copy_buffered(src_fd, dst_fd, &fallback, stats);
+  stats->path          = "read/write (built without io_uring)";
+  return ret;
+}
+
+#endif  // Q3_HAVE_URING
+
+#endif  // Q3_URING_H
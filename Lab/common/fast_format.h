@@ -0,0 +1,161 @@
+#ifndef LAB_FAST_FORMAT_H
+#define LAB_FAST_FORMAT_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>   // for fflush()
+#include <string.h>  // for memcpy(), strlen()
+#include <unistd.h>  // for write(), STDOUT_FILENO
+
+//--------------------------------------------------------------------------------
+// Fast integer output for printing whole arrays
+// Brief: Formats integers two digits at a time from a "00".."99" table into one large buffer,
+//        which is handed to write() once (or once per FMT_BUFFER_SIZE bytes) instead of one printf() per element
+//
+// Usage:
+//   FmtBuffer out = {0};
+//   for (size_t i = 0; i < n; i++) {
+//     fmt_int(&out, arr[i]);
+//     fmt_char(&out, ' ');
+//   }
+//   fmt_char(&out, '\n');
+//   if (fmt_flush(&out, STDOUT_FILENO) == -1) { perror("write"); }
+//
+// Notes:
+// - printf() parses the format string and takes the stdio lock for every call; here one element costs a
+//   few table lookups and stores
+// - Anything already printed with stdio is flushed first, so output stays in order when both are mixed
+// - A FmtBuffer is large (FMT_BUFFER_SIZE); keep it static or on the stack of main()
+//--------------------------------------------------------------------------------
+
+#define FMT_BUFFER_SIZE (64 * 1024)
+#define FMT_MAX_INT 20  // "-9223372036854775808"
+
+typedef struct {
+  size_t len;
+  int fd;      // where fmt_reserve() flushes a full buffer, set by the first fmt_flush(); stdout until then
+  int failed;  // a flush failed; errno was saved in error
+  int error;
+  char data[FMT_BUFFER_SIZE];
+} FmtBuffer;
+
+static const char FMT_DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static inline unsigned fmt_digits(uint64_t v) {
+  unsigned n = 1;
+  for (; v >= 10000; v /= 10000) {
+    n += 4;
+  }
+  return n + (v >= 10) + (v >= 100) + (v >= 1000);
+}
+
+// Writes v at p without a terminator; returns the end of the digits
+static inline char* fmt_u64_raw(char* p, uint64_t v) {
+  unsigned n = fmt_digits(v);
+  char* end  = p + n;
+  char* q    = end;
+  while (v >= 100) {
+    unsigned pair = (unsigned)(v % 100) * 2;
+    v /= 100;
+    q -= 2;
+    memcpy(q, FMT_DIGIT_PAIRS + pair, 2);
+  }
+  if (v >= 10) {
+    memcpy(q - 2, FMT_DIGIT_PAIRS + v * 2, 2);
+  } else {
+    q[-1] = (char)('0' + v);
+  }
+  return end;
+}
+
+static inline char* fmt_i64_raw(char* p, int64_t v) {
+  if (v < 0) {
+    *p++ = '-';
+    return fmt_u64_raw(p, 0 - (uint64_t)v);  // also right for INT64_MIN
+  }
+  return fmt_u64_raw(p, (uint64_t)v);
+}
+
+static inline int fmt_write_all(int fd, const char* data, size_t bytes) {
+  while (bytes > 0) {
+    ssize_t written = write(fd, data, bytes);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return -1;
+    }
+    data += written;
+    bytes -= written;
+  }
+  return 0;
+}
+
+// Writes out everything buffered with a single write() (more only if the fd takes partial writes)
+static inline int fmt_flush(FmtBuffer* b, int fd) {
+  b->fd = fd;
+  if (fd == STDOUT_FILENO) {
+    (void)fflush(stdout);
+  }
+  if (!b->failed && b->len > 0 && fmt_write_all(fd, b->data, b->len) == -1) {
+    b->failed = 1;
+    b->error  = errno;
+  }
+  b->len = 0;
+  if (b->failed) {
+    errno = b->error;
+    return -1;
+  }
+  return 0;
+}
+
+// Makes room for n bytes, flushing a full buffer to the fd of the last flush (stdout by default)
+static inline char* fmt_reserve(FmtBuffer* b, size_t n) {
+  if (FMT_BUFFER_SIZE - b->len < n) {
+    (void)fmt_flush(b, b->fd != 0 ? b->fd : STDOUT_FILENO);
+  }
+  return b->data + b->len;
+}
+
+static inline void fmt_int(FmtBuffer* b, int64_t v) {
+  char* p = fmt_reserve(b, FMT_MAX_INT);
+  b->len  = fmt_i64_raw(p, v) - b->data;
+}
+
+static inline void fmt_uint(FmtBuffer* b, uint64_t v) {
+  char* p = fmt_reserve(b, FMT_MAX_INT);
+  b->len  = fmt_u64_raw(p, v) - b->data;
+}
+
+static inline void fmt_char(FmtBuffer* b, char c) {
+  char* p = fmt_reserve(b, 1);
+  *p      = c;
+  b->len++;
+}
+
+static inline void fmt_str(FmtBuffer* b, const char* s) {
+  for (size_t n = strlen(s); n > 0;) {
+    size_t room = FMT_BUFFER_SIZE - b->len;
+    if (room == 0) {
+      fmt_reserve(b, 1);
+      continue;
+    }
+    size_t chunk = n < room ? n : room;
+    memcpy(b->data + b->len, s, chunk);
+    b->len += chunk;
+    s += chunk;
+    n -= chunk;
+  }
+}
+
+#endif  // LAB_FAST_FORMAT_H
@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fast_format.h"
+
+//--------------------------------------------------------------------------------
+// Lines per second: printf() per element versus fast_format.h
+// - Prints the same pseudo-random integers, one per line, both ways to stdout
+// - Timings go to stderr, so redirect stdout to a file or /dev/null
+//
+// Usage:
+//   ./fast_format_bench -n 10000000 > /dev/null
+//   ./fast_format_bench -n 1000000 > out.txt   (the two halves of out.txt are identical)
+//--------------------------------------------------------------------------------
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[]) {
+  size_t lines = 10 * 1000 * 1000;
+
+  int c;
+  while ((c = getopt(argc, argv, "n:")) != -1) {
+    if (c != 'n') {
+      fprintf(stderr, "Usage: ./fast_format_bench [-n lines] > /dev/null\n");
+      exit(EXIT_FAILURE);
+    }
+    lines = strtoull(optarg, NULL, 10);
+  }
+
+  int* values = malloc(lines * sizeof(int) + 1);
+  if (values == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  // Mixed magnitudes and signs, as in the lab inputs
+  uint32_t state = 2463534242u;
+  for (size_t i = 0; i < lines; i++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    values[i] = (int)(state >> (state % 31));
+  }
+
+  double start = now_seconds();
+  for (size_t i = 0; i < lines; i++) {
+    printf("%d\n", values[i]);
+  }
+  fflush(stdout);
+  double printf_seconds = now_seconds() - start;
+
+  static FmtBuffer out;
+  start = now_seconds();
+  for (size_t i = 0; i < lines; i++) {
+    fmt_int(&out, values[i]);
+    fmt_char(&out, '\n');
+  }
+  if (fmt_flush(&out, STDOUT_FILENO) == -1) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+  double fast_seconds = now_seconds() - start;
+
+  fprintf(stderr, "printf:      %.0f lines/s (%.3f s)\n", (double)lines / printf_seconds, printf_seconds);
+  fprintf(stderr, "fast_format: %.0f lines/s (%.3f s)\n", (double)lines / fast_seconds, fast_seconds);
+  fprintf(stderr, "speedup:     %.1fx\n", printf_seconds / fast_seconds);
+
+  free(values);
+  return EXIT_SUCCESS;
+}
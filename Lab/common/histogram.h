@@ -0,0 +1,193 @@
+#ifndef LAB_HISTOGRAM_H
+#define LAB_HISTOGRAM_H
+
+#include <stdatomic.h>  // for atomic_fetch_add_explicit(), atomic_compare_exchange_weak_explicit()
+#include <stdint.h>
+#include <stdio.h>      // for FILE, fprintf()
+#include <stdlib.h>     // for calloc(), free()
+#include <time.h>       // for clock_gettime()
+
+//--------------------------------------------------------------------------------
+// Latency histogram (HDR-style, log-linear)
+// Brief: Counts values (nanoseconds, by convention) in buckets whose width grows with the value, so the whole
+//        uint64_t range fits in a fixed HIST_BUCKETS counters while every value keeps 1/HIST_SUB_BUCKETS precision
+//
+// Layout:
+// - Values below HIST_SUB_BUCKETS (128) get a bucket each
+// - Every power of two above that, [2^k, 2^(k+1)), is split into HIST_SUB_BUCKETS equal buckets,
+//   so a bucket is never wider than 1/128 (0.8%) of the values in it
+//   -> 1 us and 1 s are both recorded to within 0.8%, in 7424 buckets (58 KiB) instead of one per nanosecond
+//
+// Usage:
+//   Histogram* h = hist_create();                     // one per thread: recording never contends
+//   uint64_t t0 = hist_now_ns();
+//   ... operation ...
+//   hist_record(h, hist_now_ns() - t0);
+//
+//   hist_merge(total, h);                             // after the threads are joined (or while they run)
+//   hist_percentile(total, 99.9);                     // upper bound of the bucket holding the 99.9th percentile
+//   hist_print_json(stdout, "round_trip_ns", total);  // {"name": ..., "count": ..., "p50": ..., ...}
+//
+// Notes:
+// - hist_record() is three relaxed atomic adds, plus a compare-exchange when a new min or max is seen; it takes no
+//   lock, so several threads may also share one histogram (at the price of cache-line ping-pong on the counters)
+// - Reading or merging a histogram that is still being recorded into gives a consistent-enough snapshot:
+//   each counter is read atomically, but counts recorded meanwhile may or may not be included
+// - Percentiles report the highest value of their bucket (as HdrHistogram does), clamped to the recorded max,
+//   so they never understate a tail
+//--------------------------------------------------------------------------------
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB_BUCKETS (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct {
+  _Atomic uint64_t count;
+  _Atomic uint64_t sum;  // wraps after 584 years of nanoseconds
+  _Atomic uint64_t min;
+  _Atomic uint64_t max;
+  _Atomic uint64_t buckets[HIST_BUCKETS];
+} Histogram;
+
+static inline uint64_t hist_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void hist_reset(Histogram* h) {
+  atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+  atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+  atomic_store_explicit(&h->min, UINT64_MAX, memory_order_relaxed);
+  atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+  for (size_t i = 0; i < HIST_BUCKETS; i++) {
+    atomic_store_explicit(&h->buckets[i], 0, memory_order_relaxed);
+  }
+}
+
+// Returns a zeroed histogram, or NULL with errno set; free() it when done
+static inline Histogram* hist_create() {
+  Histogram* h = calloc(1, sizeof(Histogram));
+  if (h != NULL) {
+    hist_reset(h);
+  }
+  return h;
+}
+
+static inline size_t hist_bucket(uint64_t value) {
+  if (value < HIST_SUB_BUCKETS) {
+    return (size_t)value;
+  }
+  unsigned msb   = 63 - (unsigned)__builtin_clzll(value);
+  unsigned shift = msb - HIST_SUB_BITS;  // the top HIST_SUB_BITS + 1 bits select the bucket
+  return (size_t)(shift + 1) * HIST_SUB_BUCKETS + (size_t)((value >> shift) - HIST_SUB_BUCKETS);
+}
+
+// Highest value that lands in bucket i
+static inline uint64_t hist_bucket_high(size_t i) {
+  if (i < HIST_SUB_BUCKETS) {
+    return (uint64_t)i;
+  }
+  unsigned shift = (unsigned)(i / HIST_SUB_BUCKETS) - 1;
+  uint64_t low   = (uint64_t)(HIST_SUB_BUCKETS + i % HIST_SUB_BUCKETS) << shift;
+  return low + ((1ull << shift) - 1);
+}
+
+static inline void hist_update_min(Histogram* h, uint64_t value) {
+  uint64_t seen = atomic_load_explicit(&h->min, memory_order_relaxed);
+  while (value < seen && !atomic_compare_exchange_weak_explicit(&h->min, &seen, value, memory_order_relaxed, memory_order_relaxed)) {
+  }
+}
+
+static inline void hist_update_max(Histogram* h, uint64_t value) {
+  uint64_t seen = atomic_load_explicit(&h->max, memory_order_relaxed);
+  while (value > seen && !atomic_compare_exchange_weak_explicit(&h->max, &seen, value, memory_order_relaxed, memory_order_relaxed)) {
+  }
+}
+
+static inline void hist_record_n(Histogram* h, uint64_t value, uint64_t n) {
+  atomic_fetch_add_explicit(&h->buckets[hist_bucket(value)], n, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->count, n, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum, value * n, memory_order_relaxed);
+  hist_update_min(h, value);
+  hist_update_max(h, value);
+}
+
+static inline void hist_record(Histogram* h, uint64_t value) {
+  hist_record_n(h, value, 1);
+}
+
+// Adds every count of src to dst; src is left as it is
+static inline void hist_merge(Histogram* dst, const Histogram* src) {
+  Histogram* s = (Histogram*)src;  // atomic loads take non-const pointers
+  for (size_t i = 0; i < HIST_BUCKETS; i++) {
+    uint64_t n = atomic_load_explicit(&s->buckets[i], memory_order_relaxed);
+    if (n != 0) {
+      atomic_fetch_add_explicit(&dst->buckets[i], n, memory_order_relaxed);
+    }
+  }
+  atomic_fetch_add_explicit(&dst->count, atomic_load_explicit(&s->count, memory_order_relaxed), memory_order_relaxed);
+  atomic_fetch_add_explicit(&dst->sum, atomic_load_explicit(&s->sum, memory_order_relaxed), memory_order_relaxed);
+  hist_update_min(dst, atomic_load_explicit(&s->min, memory_order_relaxed));
+  hist_update_max(dst, atomic_load_explicit(&s->max, memory_order_relaxed));
+}
+
+static inline uint64_t hist_count(const Histogram* h) {
+  return atomic_load_explicit(&((Histogram*)h)->count, memory_order_relaxed);
+}
+
+static inline uint64_t hist_min(const Histogram* h) {
+  return hist_count(h) == 0 ? 0 : atomic_load_explicit(&((Histogram*)h)->min, memory_order_relaxed);
+}
+
+static inline uint64_t hist_max(const Histogram* h) {
+  return atomic_load_explicit(&((Histogram*)h)->max, memory_order_relaxed);
+}
+
+static inline double hist_mean(const Histogram* h) {
+  uint64_t count = hist_count(h);
+  return count == 0 ? 0 : (double)atomic_load_explicit(&((Histogram*)h)->sum, memory_order_relaxed) / (double)count;
+}
+
+// Smallest recorded value (to bucket precision) that at least percentile% of the values are less than or equal to
+static inline uint64_t hist_percentile(const Histogram* h, double percentile) {
+  Histogram* s   = (Histogram*)h;
+  uint64_t count = hist_count(h);
+  if (count == 0) {
+    return 0;
+  }
+  if (percentile >= 100) {
+    return hist_max(h);
+  }
+  uint64_t rank = (uint64_t)(percentile / 100.0 * (double)count + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HIST_BUCKETS; i++) {
+    seen += atomic_load_explicit(&s->buckets[i], memory_order_relaxed);
+    if (seen >= rank) {
+      uint64_t high = hist_bucket_high(i);
+      uint64_t max  = hist_max(h);
+      return high < max ? high : max;
+    }
+  }
+  return hist_max(h);
+}
+
+// One JSON object on one line: {"name": "...", "count": N, "min": ..., "mean": ..., "p50": ..., "p90": ...,
+// "p99": ..., "p99.9": ..., "max": ...}; name is written as given, so keep it to plain characters
+static inline int hist_print_json(FILE* out, const char* name, const Histogram* h) {
+  return fprintf(out,
+                 "{\"name\": \"%s\", \"count\": %llu, \"min\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, "
+                 "\"p99\": %llu, \"p99.9\": %llu, \"max\": %llu}\n",
+                 name, (unsigned long long)hist_count(h), (unsigned long long)hist_min(h), hist_mean(h),
+                 (unsigned long long)hist_percentile(h, 50), (unsigned long long)hist_percentile(h, 90),
+                 (unsigned long long)hist_percentile(h, 99), (unsigned long long)hist_percentile(h, 99.9),
+                 (unsigned long long)hist_max(h)) < 0
+             ? -1
+             : 0;
+}
+
+#endif  // LAB_HISTOGRAM_H
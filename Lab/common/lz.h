@@ -0,0 +1,659 @@
+#ifndef LAB_LZ_H
+#define LAB_LZ_H
+
+#include <errno.h>
+#include <pthread.h>  // for pthread_create(), pthread_join()
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>  // for memcpy()
+#include <sys/types.h>
+#include <unistd.h>  // for read(), write()
+
+//--------------------------------------------------------------------------------
+// Small LZ77 codec in the style of LZ4, shared by q3 (-m lz / unlz) and the pipe labs
+//
+// Block format (one compressed block, decodable on its own):
+//   sequence := token [literal length bytes] literals [offset (2 bytes LE) [match length bytes]]
+//   token    := high nibble literal length, low nibble match length - 4 (15 means "more bytes follow")
+//   -> Extra length bytes are added up until one is below 255
+//   -> The last sequence has literals only; matches reach back at most 65535 bytes
+//
+// Frame format (what goes into a file or down a pipe):
+//   "LZB1" | block size (u32) | { raw size (u32) | stored size (u32) | payload }... | 0 (u32) | 0 (u32)
+//   -> LZ_STORED in the stored size marks a block kept uncompressed because it did not shrink
+//   -> Blocks share no history, so they are compressed and decompressed by threads independently
+//
+// Usage:
+//   ssize_t size = lz_encode(data, n, frame, lz_frame_bound(n, LZ_BLOCK_SIZE), LZ_BLOCK_SIZE, 4);
+//   ssize_t raw  = lz_decode(frame, size, data, n, 4);
+//   lz_send(pipe_fd[1], data, n, 4);  /  lz_recv(pipe_fd[0], &data, &n, 4);
+//
+// Notes:
+// - All functions return -1 and set errno on failure: EINVAL for malformed input, ENOSPC if the output does not fit
+// - Greedy parsing with a single hash probe per position; incompressible input is skipped faster and faster
+//--------------------------------------------------------------------------------
+
+#define LZ_MAGIC 0x31425a4cu  // "LZB1" little-endian
+#define LZ_BLOCK_SIZE (256 * 1024)
+#define LZ_MAX_BLOCK_SIZE (64 * 1024 * 1024)
+#define LZ_STORED 0x80000000u
+#define LZ_HEADER_SIZE 8  // magic + block size, or one block header
+#define LZ_MAX_THREADS 64
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_LAST_LITERALS 5  // the block always ends with at least this many literals
+#define LZ_MATCH_LIMIT 12   // no match starts within this many bytes of the end
+#define LZ_MAX_OFFSET 65535
+
+static inline uint32_t lz_read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t lz_read64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline void lz_put32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t lz_get32(const uint8_t* p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Worst case of one compressed block: every byte a literal plus the length bytes
+static inline size_t lz_block_bound(size_t n) {
+  return n + n / 255 + 16;
+}
+
+// Worst case of a whole frame: every block stored, plus all headers
+static inline size_t lz_frame_bound(size_t n, size_t block_size) {
+  return n + (n / block_size + 2) * LZ_HEADER_SIZE + LZ_HEADER_SIZE;
+}
+
+// Number of bytes the two positions have in common, up to limit
+static inline size_t lz_common(const uint8_t* a, const uint8_t* b, size_t limit) {
+  size_t len = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (len + 8 <= limit) {
+    uint64_t diff = lz_read64(a + len) ^ lz_read64(b + len);
+    if (diff != 0) {
+      return len + (__builtin_ctzll(diff) >> 3);
+    }
+    len += 8;
+  }
+#endif
+  while (len < limit && a[len] == b[len]) {
+    len++;
+  }
+  return len;
+}
+
+#define LZ_WILD_COPY 16  // bytes copied per step when there is room to overrun the end
+
+// Copies literals in 16-byte steps when both buffers have room for the overrun
+static inline void lz_copy_literals(uint8_t* op, const uint8_t* ip, size_t len, size_t out_room, size_t in_room) {
+  if (out_room < len + LZ_WILD_COPY || in_room < len + LZ_WILD_COPY) {
+    memcpy(op, ip, len);
+    return;
+  }
+  for (size_t i = 0; i < len; i += LZ_WILD_COPY) {
+    memcpy(op + i, ip + i, LZ_WILD_COPY);
+  }
+}
+
+// Writes a length that did not fit in its nibble as a run of 255s and a remainder
+static inline uint8_t* lz_put_length(uint8_t* op, size_t len) {
+  for (; len >= 255; len -= 255) {
+    *op++ = 255;
+  }
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+// Emits literals [anchor, anchor + literals) followed by a match, or literals only if match_len is 0
+static inline uint8_t* lz_put_sequence(uint8_t* op, uint8_t* end, const uint8_t* anchor, const uint8_t* src_end, size_t literals, size_t offset,
+                                       size_t match_len) {
+  size_t need = 1 + literals / 255 + 1 + literals + (match_len != 0 ? 2 + match_len / 255 + 1 : 0);
+  if ((size_t)(end - op) < need) {
+    return NULL;
+  }
+
+  uint8_t* token = op++;
+  *token         = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+  if (literals >= 15) {
+    op = lz_put_length(op, literals - 15);
+  }
+  lz_copy_literals(op, anchor, literals, end - op, src_end - anchor);
+  op += literals;
+
+  if (match_len != 0) {
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    match_len -= LZ_MIN_MATCH;
+    *token |= (uint8_t)(match_len >= 15 ? 15 : match_len);
+    if (match_len >= 15) {
+      op = lz_put_length(op, match_len - 15);
+    }
+  }
+  return op;
+}
+
+// Compresses one block; returns the compressed size, or 0 if it does not fit in cap
+static inline size_t lz_compress_block(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+  uint32_t table[1 << LZ_HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  uint8_t* op           = dst;
+  uint8_t* end          = dst + cap;
+  const uint8_t* anchor = src;
+  const uint8_t* ip     = src + 1;
+  unsigned misses       = 0;
+
+  if (n > LZ_MATCH_LIMIT) {
+    const uint8_t* limit       = src + n - LZ_MATCH_LIMIT;
+    const uint8_t* match_limit = src + n - LZ_LAST_LITERALS;
+    while (ip < limit) {
+      uint32_t h           = lz_hash(lz_read32(ip));
+      const uint8_t* match = src + table[h];
+      table[h]             = (uint32_t)(ip - src);
+
+      if (match >= ip || ip - match > LZ_MAX_OFFSET || lz_read32(match) != lz_read32(ip)) {
+        ip += 1 + (misses++ >> 6);  // step further the longer nothing matches
+        continue;
+      }
+      misses = 0;
+
+      // Grow the match backwards into pending literals, then forwards
+      while (ip > anchor && match > src && ip[-1] == match[-1]) {
+        ip--;
+        match--;
+      }
+      size_t len = LZ_MIN_MATCH + lz_common(ip + LZ_MIN_MATCH, match + LZ_MIN_MATCH, match_limit - ip - LZ_MIN_MATCH);
+
+      if ((op = lz_put_sequence(op, end, anchor, src + n, ip - anchor, ip - match, len)) == NULL) {
+        return 0;
+      }
+      ip += len;
+      anchor = ip;
+      if (ip < limit) {
+        table[lz_hash(lz_read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+      }
+    }
+  }
+
+  if ((op = lz_put_sequence(op, end, anchor, src + n, src + n - anchor, 0, 0)) == NULL) {
+    return 0;
+  }
+  return op - dst;
+}
+
+// Reads a length continued in 255-bytes; returns -1 if the input ends first
+static inline ssize_t lz_get_length(const uint8_t** ip, const uint8_t* end, size_t len) {
+  uint8_t b;
+  do {
+    if (*ip >= end) {
+      return -1;
+    }
+    b = *(*ip)++;
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+// Copies a match that may overlap its own output: with offset < len the last offset bytes repeat
+static inline void lz_copy_match(uint8_t* op, size_t offset, size_t len, size_t room) {
+  if (offset < 8) {
+    // Short periods: lay down the first 8 bytes one at a time, then copy from the nearest multiple of offset >= 8
+    size_t first = len < 8 ? len : 8;
+    for (size_t i = 0; i < first; i++) {
+      op[i] = op[i - offset];
+    }
+    if (len <= 8) {
+      return;
+    }
+    offset = offset * ((8 + offset - 1) / offset);
+    op += 8;
+    len -= 8;
+    room -= 8;
+  }
+
+  // With offset >= 8 every 8-byte step reads only bytes that are already written
+  const uint8_t* match = op - offset;
+  size_t i             = 0;
+  if (room >= len + 8) {
+    for (; i < len; i += 8) {
+      memcpy(op + i, match + i, 8);
+    }
+    return;
+  }
+  for (; i + 8 <= len; i += 8) {
+    memcpy(op + i, match + i, 8);
+  }
+  for (; i < len; i++) {
+    op[i] = match[i];
+  }
+}
+
+// Decompresses one block; returns the decompressed size, or -1 if the block is malformed or exceeds cap
+static inline ssize_t lz_decompress_block(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+  const uint8_t* ip  = src;
+  const uint8_t* end = src + n;
+  uint8_t* op        = dst;
+  uint8_t* op_end    = dst + cap;
+
+  while (ip < end) {
+    unsigned token = *ip++;
+    ssize_t lit    = token >> 4;
+    if (lit == 15 && (lit = lz_get_length(&ip, end, 15)) == -1) {
+      return -1;
+    }
+    if (end - ip < lit || op_end - op < lit) {
+      return -1;
+    }
+    lz_copy_literals(op, ip, lit, op_end - op, end - ip);
+    ip += lit;
+    op += lit;
+    if (ip == end) {
+      break;  // the last sequence has no match
+    }
+
+    if (end - ip < 2) {
+      return -1;
+    }
+    size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    ssize_t len = token & 15;
+    if (len == 15 && (len = lz_get_length(&ip, end, 15)) == -1) {
+      return -1;
+    }
+    len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - dst) || op_end - op < len) {
+      return -1;
+    }
+
+    lz_copy_match(op, offset, len, op_end - op);
+    op += len;
+  }
+  return op - dst;
+}
+
+// One thread's share of an encode or decode: blocks first, first + stride, ...
+typedef struct {
+  const uint8_t* src;  // encode: raw input;     decode: block records
+  uint8_t* dst;        // encode: scratch slots; decode: raw output
+  size_t block_size;
+  size_t slot_size;  // encode only: bytes reserved per block in dst
+  size_t blocks;
+  const size_t* in_offsets;   // decode only: where each payload starts in src
+  const uint32_t* in_sizes;   // decode only: stored sizes (with LZ_STORED)
+  const size_t* out_offsets;  // decode only: where each block goes in dst
+  const uint32_t* out_sizes;  // decode only: raw sizes
+  size_t* encoded;            // encode only: record size of each block
+  size_t total;               // encode only: raw input size
+  unsigned first;
+  unsigned stride;
+  int failed;
+} LzJob;
+
+// Writes one block record (header + payload) at out, which has room for LZ_HEADER_SIZE + n bytes
+static inline size_t lz_encode_one(const uint8_t* src, size_t n, uint8_t* out) {
+  size_t size = lz_compress_block(src, n, out + LZ_HEADER_SIZE, n);
+  uint32_t stored;
+  if (size == 0 || size >= n) {
+    memcpy(out + LZ_HEADER_SIZE, src, n);
+    size   = n;
+    stored = (uint32_t)n | LZ_STORED;
+  } else {
+    stored = (uint32_t)size;
+  }
+  lz_put32(out, (uint32_t)n);
+  lz_put32(out + 4, stored);
+  return LZ_HEADER_SIZE + size;
+}
+
+static void* lz_encode_worker(void* arg) {
+  LzJob* job = (LzJob*)arg;
+  for (size_t i = job->first; i < job->blocks; i += job->stride) {
+    size_t offset   = i * job->block_size;
+    size_t n        = job->total - offset < job->block_size ? job->total - offset : job->block_size;
+    job->encoded[i] = lz_encode_one(job->src + offset, n, job->dst + i * job->slot_size);
+  }
+  return NULL;
+}
+
+static void* lz_decode_worker(void* arg) {
+  LzJob* job = (LzJob*)arg;
+  for (size_t i = job->first; i < job->blocks && !job->failed; i += job->stride) {
+    uint32_t stored = job->in_sizes[i];
+    uint8_t* out    = job->dst + job->out_offsets[i];
+    if (stored & LZ_STORED) {
+      memcpy(out, job->src + job->in_offsets[i], stored & ~LZ_STORED);
+    } else if (lz_decompress_block(job->src + job->in_offsets[i], stored, out, job->out_sizes[i]) != (ssize_t)job->out_sizes[i]) {
+      job->failed = 1;
+    }
+  }
+  return NULL;
+}
+
+// Runs the job on up to threads threads (block i goes to thread i % threads); the calling thread takes a share
+static inline int lz_run(LzJob* job, void* (*worker)(void*), unsigned threads) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  if (threads > LZ_MAX_THREADS) {
+    threads = LZ_MAX_THREADS;
+  }
+  if (threads > job->blocks) {
+    threads = job->blocks > 0 ? (unsigned)job->blocks : 1;
+  }
+
+  LzJob jobs[LZ_MAX_THREADS];
+  pthread_t ids[LZ_MAX_THREADS];
+  unsigned created = 0;
+  for (unsigned t = 0; t < threads; t++) {
+    jobs[t]        = *job;
+    jobs[t].first  = t;
+    jobs[t].stride = threads;
+  }
+  for (unsigned t = 1; t < threads; t++, created++) {
+    if (pthread_create(&ids[t], NULL, worker, &jobs[t]) != 0) {
+      break;
+    }
+  }
+  // Blocks of threads that could not be started are done here
+  for (unsigned t = 0; t < threads; t++) {
+    if (t == 0 || t > created) {
+      worker(&jobs[t]);
+    }
+  }
+
+  int failed = 0;
+  for (unsigned t = 0; t < threads; t++) {
+    if (t >= 1 && t <= created) {
+      pthread_join(ids[t], NULL);
+    }
+    failed |= jobs[t].failed;
+  }
+  return failed ? -1 : 0;
+}
+
+// Compresses n bytes into block records (no frame header or terminator); returns the bytes written
+static inline ssize_t lz_encode_blocks(const void* src, size_t n, void* dst, size_t cap, size_t block_size, unsigned threads) {
+  if (block_size == 0 || block_size > LZ_MAX_BLOCK_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+  size_t blocks = (n + block_size - 1) / block_size;
+  uint8_t* out  = dst;
+
+  if (threads <= 1 || blocks <= 1) {
+    size_t total = 0;
+    for (size_t offset = 0; offset < n; offset += block_size) {
+      size_t len = n - offset < block_size ? n - offset : block_size;
+      if (cap - total < LZ_HEADER_SIZE + len) {
+        errno = ENOSPC;
+        return -1;
+      }
+      total += lz_encode_one((const uint8_t*)src + offset, len, out + total);
+    }
+    return total;
+  }
+
+  // In parallel every block gets a worst-case slot; the records are packed together afterwards
+  size_t slot_size = LZ_HEADER_SIZE + block_size;
+  uint8_t* scratch = malloc(blocks * slot_size);
+  size_t* encoded  = malloc(blocks * sizeof(size_t));
+  if (scratch == NULL || encoded == NULL) {
+    free(scratch);
+    free(encoded);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  LzJob job = {src, scratch, block_size, slot_size, blocks, NULL, NULL, NULL, NULL, encoded, n, 0, 1, 0};
+  lz_run(&job, lz_encode_worker, threads);
+
+  size_t total = 0;
+  for (size_t i = 0; i < blocks; i++) {
+    if (cap - total < encoded[i]) {
+      free(scratch);
+      free(encoded);
+      errno = ENOSPC;
+      return -1;
+    }
+    memcpy(out + total, scratch + i * slot_size, encoded[i]);
+    total += encoded[i];
+  }
+  free(scratch);
+  free(encoded);
+  return total;
+}
+
+// Decompresses complete block records (no frame header or terminator); returns the raw bytes written
+static inline ssize_t lz_decode_blocks(const void* src, size_t n, void* dst, size_t cap, unsigned threads) {
+  const uint8_t* in = src;
+
+  // First pass: find every block so that they can be handed out to threads
+  size_t blocks = 0;
+  for (size_t pos = 0; pos < n; blocks++) {
+    if (n - pos < LZ_HEADER_SIZE) {
+      errno = EINVAL;
+      return -1;
+    }
+    size_t stored = lz_get32(in + pos + 4) & ~LZ_STORED;
+    if (n - pos - LZ_HEADER_SIZE < stored) {
+      errno = EINVAL;
+      return -1;
+    }
+    pos += LZ_HEADER_SIZE + stored;
+  }
+
+  size_t* in_offsets  = malloc(blocks * sizeof(size_t) + 1);
+  size_t* out_offsets = malloc(blocks * sizeof(size_t) + 1);
+  uint32_t* in_sizes  = malloc(blocks * sizeof(uint32_t) + 1);
+  uint32_t* out_sizes = malloc(blocks * sizeof(uint32_t) + 1);
+  if (in_offsets == NULL || out_offsets == NULL || in_sizes == NULL || out_sizes == NULL) {
+    free(in_offsets);
+    free(out_offsets);
+    free(in_sizes);
+    free(out_sizes);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  size_t total = 0;
+  int error    = 0;
+  for (size_t i = 0, pos = 0; i < blocks; i++) {
+    in_sizes[i]    = lz_get32(in + pos + 4);
+    out_sizes[i]   = lz_get32(in + pos);
+    in_offsets[i]  = pos + LZ_HEADER_SIZE;
+    out_offsets[i] = total;
+    if ((in_sizes[i] & LZ_STORED) && (in_sizes[i] & ~LZ_STORED) != out_sizes[i]) {
+      error = EINVAL;
+    }
+    if (cap - total < out_sizes[i]) {
+      error = ENOSPC;
+    }
+    if (error != 0) {
+      break;
+    }
+    total += out_sizes[i];
+    pos += LZ_HEADER_SIZE + (in_sizes[i] & ~LZ_STORED);
+  }
+
+  if (error == 0) {
+    LzJob job = {in, dst, 0, 0, blocks, in_offsets, in_sizes, out_offsets, out_sizes, NULL, 0, 0, 1, 0};
+    if (lz_run(&job, lz_decode_worker, threads) == -1) {
+      error = EINVAL;
+    }
+  }
+
+  free(in_offsets);
+  free(out_offsets);
+  free(in_sizes);
+  free(out_sizes);
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return total;
+}
+
+// Compresses n bytes into a complete frame; returns the frame size
+static inline ssize_t lz_encode(const void* src, size_t n, void* dst, size_t cap, size_t block_size, unsigned threads) {
+  uint8_t* out = dst;
+  if (cap < 3 * LZ_HEADER_SIZE) {
+    errno = ENOSPC;
+    return -1;
+  }
+  lz_put32(out, LZ_MAGIC);
+  lz_put32(out + 4, (uint32_t)block_size);
+
+  ssize_t size = lz_encode_blocks(src, n, out + LZ_HEADER_SIZE, cap - 2 * LZ_HEADER_SIZE, block_size, threads);
+  if (size == -1) {
+    return -1;
+  }
+  memset(out + LZ_HEADER_SIZE + size, 0, LZ_HEADER_SIZE);
+  return 2 * LZ_HEADER_SIZE + size;
+}
+
+// Decompresses a complete frame; returns the raw size
+static inline ssize_t lz_decode(const void* src, size_t n, void* dst, size_t cap, unsigned threads) {
+  const uint8_t* in = src;
+  if (n < 2 * LZ_HEADER_SIZE || lz_get32(in) != LZ_MAGIC || lz_get32(in + n - 8) != 0 || lz_get32(in + n - 4) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return lz_decode_blocks(in + LZ_HEADER_SIZE, n - 2 * LZ_HEADER_SIZE, dst, cap, threads);
+}
+
+static inline int lz_write_all(int fd, const void* buffer, size_t bytes) {
+  const char* ptr = buffer;
+  while (bytes > 0) {
+    ssize_t written = write(fd, ptr, bytes);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return -1;
+    }
+    ptr += written;
+    bytes -= written;
+  }
+  return 0;
+}
+
+// Returns 0 once bytes were read, -1 on failure or if the stream ends early (errno EPIPE)
+static inline int lz_read_all(int fd, void* buffer, size_t bytes) {
+  char* ptr = buffer;
+  while (bytes > 0) {
+    ssize_t got = read(fd, ptr, bytes);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      if (got == 0) {
+        errno = EPIPE;
+      }
+      return -1;
+    }
+    ptr += got;
+    bytes -= got;
+  }
+  return 0;
+}
+
+// Sends n bytes down a pipe (or any fd) as one frame; returns the encoded size
+static inline ssize_t lz_send(int fd, const void* data, size_t n, unsigned threads) {
+  size_t cap   = lz_frame_bound(n, LZ_BLOCK_SIZE);
+  uint8_t* out = malloc(cap);
+  if (out == NULL) {
+    return -1;
+  }
+  ssize_t size = lz_encode(data, n, out, cap, LZ_BLOCK_SIZE, threads);
+  if (size != -1 && lz_write_all(fd, out, size) == -1) {
+    size = -1;
+  }
+  int err = errno;
+  free(out);
+  errno = err;
+  return size;
+}
+
+// Receives one frame sent with lz_send(); *data is malloc()ed and must be freed by the caller
+static inline ssize_t lz_recv(int fd, void** data, size_t* n, unsigned threads) {
+  uint8_t header[LZ_HEADER_SIZE];
+  if (lz_read_all(fd, header, sizeof(header)) == -1) {
+    return -1;
+  }
+  if (lz_get32(header) != LZ_MAGIC) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // Collect the block records until the terminator, then decode them all at once
+  size_t used = 0, cap = 0, raw = 0;
+  uint8_t* records = NULL;
+  while (1) {
+    if (lz_read_all(fd, header, sizeof(header)) == -1) {
+      free(records);
+      return -1;
+    }
+    uint32_t raw_size = lz_get32(header);
+    uint32_t stored   = lz_get32(header + 4) & ~LZ_STORED;
+    if (raw_size == 0 && stored == 0) {
+      break;
+    }
+    if (raw_size > LZ_MAX_BLOCK_SIZE || stored > LZ_MAX_BLOCK_SIZE) {
+      free(records);
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (cap - used < LZ_HEADER_SIZE + stored) {
+      cap           = 2 * (used + LZ_HEADER_SIZE + stored);
+      uint8_t* next = realloc(records, cap);
+      if (next == NULL) {
+        free(records);
+        errno = ENOMEM;
+        return -1;
+      }
+      records = next;
+    }
+    memcpy(records + used, header, LZ_HEADER_SIZE);
+    if (lz_read_all(fd, records + used + LZ_HEADER_SIZE, stored) == -1) {
+      free(records);
+      return -1;
+    }
+    used += LZ_HEADER_SIZE + stored;
+    raw += raw_size;
+  }
+
+  uint8_t* out = malloc(raw + 1);
+  ssize_t size = out == NULL ? -1 : lz_decode_blocks(records, used, out, raw, threads);
+  int err      = errno;
+  free(records);
+  if (size == -1) {
+    free(out);
+    errno = out == NULL ? ENOMEM : err;
+    return -1;
+  }
+  *data = out;
+  *n    = (size_t)size;
+  return LZ_HEADER_SIZE + used + LZ_HEADER_SIZE;
+}
+
+#endif  // LAB_LZ_H
@@ -0,0 +1,270 @@
+#ifndef LAB_PERF_REGION_H
+#define LAB_PERF_REGION_H
+
+#include <errno.h>
+#include <linux/perf_event.h>  // for struct perf_event_attr, PERF_* constants
+#include <pthread.h>           // for pthread_mutex_lock(), pthread_once()
+#include <stdint.h>
+#include <stdio.h>             // for fprintf()
+#include <stdlib.h>            // for getenv(), atexit()
+#include <string.h>            // for memset(), strcmp(), strerror()
+#include <sys/ioctl.h>         // for ioctl()
+#include <sys/syscall.h>       // for SYS_perf_event_open
+#include <time.h>              // for clock_gettime()
+#include <unistd.h>            // for syscall(), read(), close()
+
+//--------------------------------------------------------------------------------
+// int perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags);
+// Brief: Opens a counter for one hardware or software event; read() on the returned fd gives its value
+//
+// Parameters: attr     - type/config select the event, e.g. PERF_TYPE_HARDWARE/PERF_COUNT_HW_CPU_CYCLES;
+//                        disabled = 1 to start it with ioctl(PERF_EVENT_IOC_ENABLE); exclude_kernel = 1 to count user space only
+//                        inherit = 1 to also count threads the calling thread creates after the open
+//             pid, cpu - 0, -1: the calling thread, on whatever CPU it runs (other threads are not counted)
+//             group_fd - -1 for a counter of its own
+//
+// Returns: file descriptor on success; -1 on failure, setting errno to indicate the error
+//
+// Errors:
+// - EACCES/EPERM         - Not allowed by /proc/sys/kernel/perf_event_paranoid (2 allows user space only, 3+ nothing)
+// - ENOENT/EOPNOTSUPP    - The CPU or hypervisor does not expose this event (common for hardware events in VMs)
+// - ENOSYS               - Kernel built without perf events
+//
+// Notes:
+// - glibc has no wrapper, so it is called through syscall(SYS_perf_event_open, ...)
+// - With more events than hardware counters the kernel multiplexes them; read_format TOTAL_TIME_ENABLED and
+//   TOTAL_TIME_RUNNING give the fraction of time a counter was live, to scale its value up
+//
+// Search perf_event_open(2) for more information
+//--------------------------------------------------------------------------------
+// Named regions with hardware counters
+// Brief: Counts cycles, instructions, cache misses, branch misses, context switches and CPU time for a named piece
+//        of code, adds them up per name over every thread and call, and prints one table at exit
+//
+// Usage:
+//   PerfRegion region;
+//   perf_region_begin(&region, "Sort");
+//   ... the code to measure ...
+//   perf_region_end(&region);
+//
+//   PERF_REGIONS=1 ./q1   (the table goes to stderr when the program exits)
+//
+// Notes:
+// - Off unless PERF_REGIONS is set (and not "0"); begin/end then cost one branch, so regions can stay in the code
+// - Counters are per thread: begin and end must run on the same thread, and a region in N threads counts N calls
+// - Threads created inside a region inherit its counters (attr.inherit), so a region around pthread_create() ...
+//   pthread_join() counts the workers too; a thread still running at end() is not counted
+// - A counter that cannot be opened is shown as "-" with the reason below the table; the rest still work,
+//   so in a VM without a PMU there are at least the software counters and wall time
+// - Opening the counters costs some microseconds per begin(), so measure loops, not single iterations
+//--------------------------------------------------------------------------------
+
+#define PERF_MAX_REGIONS 32
+
+enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_CONTEXT_SWITCHES,
+  PERF_TASK_CLOCK,  // CPU time in ns
+  PERF_COUNTER_COUNT
+};
+
+typedef struct {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+} PerfCounter;
+
+static const PerfCounter PERF_COUNTERS[PERF_COUNTER_COUNT] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"ctx-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+typedef struct {
+  const char* name;
+  uint64_t calls;
+  double seconds;                        // wall time, summed over calls
+  uint64_t values[PERF_COUNTER_COUNT];   // scaled for multiplexing
+  uint64_t counted[PERF_COUNTER_COUNT];  // calls in which the counter was read
+} PerfRegionTotals;
+
+typedef struct {
+  const char* name;  // NULL when perf regions are off; must outlive the program (a string literal)
+  int fds[PERF_COUNTER_COUNT];
+  double start;
+} PerfRegion;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_once_t once;
+  int enabled;                     // set once by perf_regions_init()
+  int user_only;                   // exclude_kernel was needed to open counters
+  int errors[PERF_COUNTER_COUNT];  // first errno per counter that failed to open
+  size_t count;
+  PerfRegionTotals regions[PERF_MAX_REGIONS];
+} perf_regions = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_ONCE_INIT, 0, 0, {0}, 0, {{0}}};
+
+static inline double perf_now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static inline void perf_regions_report(void) {
+  (void)fflush(stdout);  // atexit() handlers run before stdio is flushed; keep the table after the output
+  pthread_mutex_lock(&perf_regions.lock);
+  fprintf(stderr, "\n%-16s %8s %12s %14s %14s %6s %12s %12s %10s %10s\n", "region", "calls", "wall ms", "cycles",
+          "instructions", "IPC", "cache-miss", "branch-miss", "ctx-sw", "cpu ms");
+  for (size_t i = 0; i < perf_regions.count; i++) {
+    const PerfRegionTotals* r = &perf_regions.regions[i];
+    char cells[PERF_COUNTER_COUNT][24];
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+      if (r->counted[c] == 0) {
+        snprintf(cells[c], sizeof(cells[c]), "-");
+      } else if (c == PERF_TASK_CLOCK) {
+        snprintf(cells[c], sizeof(cells[c]), "%.3f", (double)r->values[c] / 1e6);
+      } else {
+        snprintf(cells[c], sizeof(cells[c]), "%llu", (unsigned long long)r->values[c]);
+      }
+    }
+    char ipc[16] = "-";
+    if (r->counted[PERF_CYCLES] != 0 && r->counted[PERF_INSTRUCTIONS] != 0 && r->values[PERF_CYCLES] != 0) {
+      snprintf(ipc, sizeof(ipc), "%.2f", (double)r->values[PERF_INSTRUCTIONS] / (double)r->values[PERF_CYCLES]);
+    }
+    fprintf(stderr, "%-16s %8llu %12.3f %14s %14s %6s %12s %12s %10s %10s\n", r->name, (unsigned long long)r->calls,
+            r->seconds * 1e3, cells[PERF_CYCLES], cells[PERF_INSTRUCTIONS], ipc, cells[PERF_CACHE_MISSES],
+            cells[PERF_BRANCH_MISSES], cells[PERF_CONTEXT_SWITCHES], cells[PERF_TASK_CLOCK]);
+  }
+
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    int err = perf_regions.errors[c];
+    if (err != 0) {
+      fprintf(stderr, "%s: unavailable (%s)%s\n", PERF_COUNTERS[c].name, strerror(err),
+              err == EACCES || err == EPERM ? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+    }
+  }
+  if (perf_regions.user_only) {
+    fprintf(stderr, "counters are user space only (perf_event_paranoid >= 2)\n");
+  }
+  pthread_mutex_unlock(&perf_regions.lock);
+}
+
+static inline void perf_regions_init() {
+  const char* env      = getenv("PERF_REGIONS");
+  perf_regions.enabled = env != NULL && *env != '\0' && strcmp(env, "0") != 0;
+  if (perf_regions.enabled) {
+    atexit(perf_regions_report);
+  }
+}
+
+static inline int perf_regions_enabled() {
+  pthread_once(&perf_regions.once, perf_regions_init);
+  return perf_regions.enabled;
+}
+
+static inline int perf_open_counter(const PerfCounter* counter, int exclude_kernel) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = counter->type;
+  attr.config         = counter->config;
+  attr.disabled       = 1;
+  attr.exclude_kernel = exclude_kernel;
+  attr.exclude_hv     = 1;
+  attr.inherit        = 1;  // threads started inside the region add to it once they exit
+  attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static inline void perf_region_begin(PerfRegion* region, const char* name) {
+  region->name = NULL;
+  if (!perf_regions_enabled()) {
+    return;
+  }
+  region->name = name;
+
+  pthread_mutex_lock(&perf_regions.lock);
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    int fd = perf_open_counter(&PERF_COUNTERS[c], perf_regions.user_only);
+    if (fd == -1 && (errno == EACCES || errno == EPERM) && !perf_regions.user_only) {
+      // perf_event_paranoid 2 still allows counting user space
+      fd = perf_open_counter(&PERF_COUNTERS[c], 1);
+      if (fd != -1) {
+        perf_regions.user_only = 1;
+      }
+    }
+    if (fd == -1 && perf_regions.errors[c] == 0) {
+      perf_regions.errors[c] = errno;
+    }
+    region->fds[c] = fd;
+  }
+  pthread_mutex_unlock(&perf_regions.lock);
+
+  region->start = perf_now_seconds();
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    if (region->fds[c] != -1) {
+      (void)ioctl(region->fds[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+static inline void perf_region_end(PerfRegion* region) {
+  if (region->name == NULL) {
+    return;
+  }
+
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    if (region->fds[c] != -1) {
+      (void)ioctl(region->fds[c], PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+  double seconds = perf_now_seconds() - region->start;
+
+  uint64_t values[PERF_COUNTER_COUNT];
+  int counted[PERF_COUNTER_COUNT];
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    uint64_t data[3];  // value, time enabled, time running
+    counted[c] = 0;
+    if (region->fds[c] == -1) {
+      continue;
+    }
+    if (read(region->fds[c], data, sizeof(data)) == (ssize_t)sizeof(data) && data[2] != 0) {
+      values[c]  = data[2] < data[1] ? (uint64_t)((double)data[0] * (double)data[1] / (double)data[2]) : data[0];
+      counted[c] = 1;
+    }
+    close(region->fds[c]);
+  }
+
+  pthread_mutex_lock(&perf_regions.lock);
+  PerfRegionTotals* totals = NULL;
+  for (size_t i = 0; i < perf_regions.count; i++) {
+    if (strcmp(perf_regions.regions[i].name, region->name) == 0) {
+      totals = &perf_regions.regions[i];
+      break;
+    }
+  }
+  if (totals == NULL && perf_regions.count < PERF_MAX_REGIONS) {
+    totals       = &perf_regions.regions[perf_regions.count++];
+    totals->name = region->name;
+  }
+  if (totals != NULL) {
+    totals->calls++;
+    totals->seconds += seconds;
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+      if (counted[c]) {
+        totals->values[c] += values[c];
+        totals->counted[c]++;
+      }
+    }
+  }
+  pthread_mutex_unlock(&perf_regions.lock);
+  region->name = NULL;
+}
+
+#endif  // LAB_PERF_REGION_H
@@ -0,0 +1,211 @@
+#ifndef LAB_SPAWN_H
+#define LAB_SPAWN_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // for clone(); include this header first or define it yourself
+#endif
+
+#include <errno.h>
+#include <sched.h>      // for clone(), CLONE_VM, CLONE_VFORK
+#include <signal.h>     // for SIGCHLD
+#include <spawn.h>      // for posix_spawn(), posix_spawn_file_actions_addclose()
+#include <stdlib.h>     // for malloc(), free()
+#include <string.h>     // for strcmp()
+#include <sys/types.h>  // for pid_t
+#include <unistd.h>     // for fork(), vfork(), execv(), close(), _exit(), getopt()
+
+//--------------------------------------------------------------------------------
+// pid_t vfork(void);
+// Brief: Creates a child that borrows the parent's memory and suspends the parent until the child calls
+//        execve() or _exit()
+//
+// Notes:
+// - Nothing is copied, not even page tables, so it costs the same for a 10 MB and a 10 GB parent
+// - The child may only call execve() or _exit() (and close() here): everything else it does happens
+//   in the parent's memory and on the parent's stack
+//
+// Search vfork(2) for more information
+//--------------------------------------------------------------------------------
+// int posix_spawn(pid_t* pid, const char* path, const posix_spawn_file_actions_t* file_actions,
+//                 const posix_spawnattr_t* attrp, char* const argv[], char* const envp[]);
+// Brief: Creates a child running the program at path, in one call; file_actions (close, dup2, open)
+//        are applied in the child before the program starts
+//
+// Returns: 0 on success and *pid set; an error number on failure (not -1 and errno)
+//
+// Notes:
+// - glibc implements it with clone(CLONE_VM | CLONE_VFORK) on a small stack of its own, so it is as cheap
+//   as vfork() and reports exec failures to the parent
+//
+// Search posix_spawn(3) for more information
+//--------------------------------------------------------------------------------
+// int clone(int (*fn)(void*), void* stack, int flags, void* arg, ...);
+// Brief: Creates a child that runs fn(arg) on the given stack; flags select what it shares with the parent
+//
+// Parameters: stack - top of the child's stack (stacks grow down on x86)
+//             flags - CLONE_VM: share the address space (no page table copy)
+//                     CLONE_VFORK: suspend the parent until the child execs or exits
+//                     SIGCHLD: the signal the parent gets when the child exits, so wait() works as for fork()
+//
+// Notes:
+// - Without CLONE_FILES the child gets a copy of the fd table, so closing fds in it does not affect the parent
+// - A CLONE_VM child shares the parent thread's TLS (errno, malloc's per-thread cache), so it must not run lab
+//   code; it closes fds and execs, as vfork() does, while CLONE_VFORK keeps the parent out of the way
+//
+// Search clone(2) for more information
+//--------------------------------------------------------------------------------
+// Child-creation strategies for the lab programs
+// Brief: spawn_child() creates a child with fork(), vfork()+execv(), posix_spawn() or clone(CLONE_VM)+execv()
+//
+// Usage:
+//   int main(int argc, char* argv[]) {
+//     if (spawn_is_child(argc, argv)) { ... child role, fd from argv[2] ...; return 0; }
+//     SpawnMode mode = SPAWN_FORK;
+//     spawn_parse_args(argc, argv, &mode);  // ./program -s posix_spawn
+//     pipe(fd);
+//     char fd_arg[16];
+//     snprintf(fd_arg, sizeof(fd_arg), "%d", fd[WRITE_END]);
+//     char* child_argv[] = {SPAWN_SELF, SPAWN_CHILD_ARG, fd_arg, NULL};
+//     pid_t pid = spawn_child(mode, child_argv, &fd[READ_END], 1);  // the child must not keep the read end
+//     if (pid == 0) { ... child role (fork only) ... } else { ... parent ... }
+//   }
+//
+// Returns: the child's pid in the parent; 0 in the child for SPAWN_FORK only, as fork() does;
+//          -1 on failure, setting errno to indicate the error
+//
+// Notes:
+// - fork() copies the page tables of the whole parent, so its cost grows with the parent's RSS; the other
+//   three share them until the exec, so they take about as long for any parent
+// - The exec modes start a new program, so the child cannot use the parent's variables; the labs re-run
+//   themselves (SPAWN_SELF) with SPAWN_CHILD_ARG and the fd numbers on the command line
+// - Descriptors to pass on must not be O_CLOEXEC (pipe() ends are not; shm_open() fds are, so reopen by name)
+// - close_fds are closed in the child in every mode, e.g. the pipe end the parent keeps, so EOF still works
+//--------------------------------------------------------------------------------
+
+#define SPAWN_SELF "/proc/self/exe"
+#define SPAWN_CHILD_ARG "--spawn-child"
+#define SPAWN_CLONE_STACK (64 * 1024)
+
+typedef enum {
+  SPAWN_FORK,
+  SPAWN_VFORK,
+  SPAWN_POSIX_SPAWN,
+  SPAWN_CLONE,
+} SpawnMode;
+
+typedef struct {
+  const char* name;
+  SpawnMode mode;
+} SpawnModeEntry;
+
+static const SpawnModeEntry SPAWN_MODES[] = {
+    {"fork", SPAWN_FORK},
+    {"vfork", SPAWN_VFORK},
+    {"posix_spawn", SPAWN_POSIX_SPAWN},
+    {"clone", SPAWN_CLONE},
+};
+
+#define SPAWN_MODE_COUNT (sizeof(SPAWN_MODES) / sizeof(SPAWN_MODES[0]))
+
+extern char** environ;
+
+static inline const SpawnModeEntry* spawn_find(const char* name) {
+  for (size_t i = 0; i < SPAWN_MODE_COUNT; i++) {
+    if (strcmp(SPAWN_MODES[i].name, name) == 0) {
+      return &SPAWN_MODES[i];
+    }
+  }
+  return NULL;
+}
+
+// Reads "-s mode" from the command line into *mode (left alone without -s); -1 on anything else
+static inline int spawn_parse_args(int argc, char* argv[], SpawnMode* mode) {
+  int c;
+  while ((c = getopt(argc, argv, "s:")) != -1) {
+    const SpawnModeEntry* entry = c == 's' ? spawn_find(optarg) : NULL;
+    if (entry == NULL) {
+      return -1;
+    }
+    *mode = entry->mode;
+  }
+  return optind == argc ? 0 : -1;
+}
+
+// Whether this process was started by spawn_child() in an exec mode to play the child
+static inline int spawn_is_child(int argc, char* argv[]) {
+  return argc >= 2 && strcmp(argv[1], SPAWN_CHILD_ARG) == 0;
+}
+
+typedef struct {
+  char* const* argv;
+  const int* close_fds;
+  size_t close_count;
+} SpawnExec;
+
+// Runs in the child of vfork() and clone(): only close(), execv() and _exit()
+static inline int spawn_exec_child(void* arg) {
+  const SpawnExec* exec = arg;
+  for (size_t i = 0; i < exec->close_count; i++) {
+    close(exec->close_fds[i]);
+  }
+  execv(exec->argv[0], exec->argv);
+  _exit(127);  // as the shell reports a command that could not be run
+}
+
+static inline pid_t spawn_child(SpawnMode mode, char* const argv[], const int* close_fds, size_t close_count) {
+  SpawnExec exec = {argv, close_fds, close_count};
+  pid_t pid;
+
+  switch (mode) {
+    case SPAWN_FORK:
+      pid = fork();
+      if (pid == 0) {
+        for (size_t i = 0; i < close_count; i++) {
+          close(close_fds[i]);
+        }
+      }
+      return pid;
+
+    case SPAWN_VFORK:
+      pid = vfork();
+      if (pid == 0) {
+        spawn_exec_child(&exec);
+      }
+      return pid;
+
+    case SPAWN_POSIX_SPAWN: {
+      posix_spawn_file_actions_t actions;
+      int err = posix_spawn_file_actions_init(&actions);
+      for (size_t i = 0; err == 0 && i < close_count; i++) {
+        err = posix_spawn_file_actions_addclose(&actions, close_fds[i]);
+      }
+      if (err == 0) {
+        err = posix_spawn(&pid, argv[0], &actions, NULL, argv, environ);
+      }
+      posix_spawn_file_actions_destroy(&actions);
+      if (err != 0) {
+        errno = err;
+        return -1;
+      }
+      return pid;
+    }
+
+    case SPAWN_CLONE: {
+      char* stack = malloc(SPAWN_CLONE_STACK);
+      if (stack == NULL) {
+        return -1;
+      }
+      // CLONE_VFORK: the stack is free again once clone() returns, since by then the child has exec'd or exited
+      pid     = clone(spawn_exec_child, stack + SPAWN_CLONE_STACK, CLONE_VM | CLONE_VFORK | SIGCHLD, &exec);
+      int err = errno;
+      free(stack);
+      errno = err;
+      return pid;
+    }
+  }
+
+  errno = EINVAL;
+  return -1;
+}
+
+#endif  // LAB_SPAWN_H
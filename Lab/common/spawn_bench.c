@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spawn.h"
+
+//--------------------------------------------------------------------------------
+// Child-creation latency against parent RSS: fork, vfork+exec, posix_spawn and clone+exec
+// - Grows the parent's resident memory in steps from 10 MB to 10 GB (touching every page) and at each step
+//   starts /bin/true count times with every mode of spawn.h
+// - spawn: until spawn_child() returns in the parent; total: until the child has run and been reaped
+// - fork runs the same exec in the child, so every mode ends up in the same program
+// - Steps that do not fit in MemAvailable are skipped rather than pushing the machine into the OOM killer
+//
+// Usage:
+//   ./spawn_bench [-n count] [-m max_mb]
+//--------------------------------------------------------------------------------
+
+static const size_t STEPS_MB[] = {10, 30, 100, 300, 1000, 3000, 10000};
+
+#define STEP_COUNT (sizeof(STEPS_MB) / sizeof(STEPS_MB[0]))
+#define MB (1000ull * 1000ull)
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+size_t available_mb() {
+  FILE* meminfo = fopen("/proc/meminfo", "r");
+  if (meminfo == NULL) {
+    return SIZE_MAX;
+  }
+  char line[256];
+  unsigned long long kb = 0;
+  while (fgets(line, sizeof(line), meminfo) != NULL) {
+    if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+      break;
+    }
+  }
+  fclose(meminfo);
+  return kb == 0 ? SIZE_MAX : (size_t)(kb * 1024 / MB);
+}
+
+// Average seconds per spawn (and per spawn + wait) for one mode
+void time_mode(SpawnMode mode, int count, double* spawn_seconds, double* total_seconds) {
+  char* child_argv[] = {"/bin/true", NULL};
+  *spawn_seconds     = 0;
+  *total_seconds     = 0;
+  for (int i = 0; i < count; i++) {
+    double start = now_seconds();
+    pid_t pid    = spawn_child(mode, child_argv, NULL, 0);
+    if (pid == 0) {  // fork: exec here, as the other modes do
+      execv(child_argv[0], child_argv);
+      _exit(127);
+    }
+    double spawned = now_seconds();
+    if (pid == -1) {
+      perror("spawn_child");
+      exit(EXIT_FAILURE);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+      perror("waitpid");
+      exit(EXIT_FAILURE);
+    }
+    double reaped = now_seconds();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "/bin/true did not run\n");
+      exit(EXIT_FAILURE);
+    }
+    *spawn_seconds += spawned - start;
+    *total_seconds += reaped - start;
+  }
+  *spawn_seconds /= count;
+  *total_seconds /= count;
+}
+
+int main(int argc, char* argv[]) {
+  int count     = 20;
+  size_t max_mb = 10000;
+
+  int c;
+  while ((c = getopt(argc, argv, "n:m:")) != -1) {
+    switch (c) {
+      case 'n':
+        count = atoi(optarg);
+        break;
+      case 'm':
+        max_mb = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: ./spawn_bench [-n count] [-m max_mb]\n");
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (count <= 0) {
+    fprintf(stderr, "count must be positive\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // One reservation for the largest step, touched a step at a time, so earlier pages stay resident
+  size_t reserve_mb = STEPS_MB[STEP_COUNT - 1] < max_mb ? STEPS_MB[STEP_COUNT - 1] : max_mb;
+  char* memory      = mmap(NULL, reserve_mb * MB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%8s", "RSS MB");
+  for (size_t m = 0; m < SPAWN_MODE_COUNT; m++) {
+    printf("  %21s", SPAWN_MODES[m].name);
+  }
+  printf("\n%8s", "");
+  for (size_t m = 0; m < SPAWN_MODE_COUNT; m++) {
+    printf("  %10s %10s", "spawn us", "total us");
+  }
+  printf("\n");
+
+  size_t touched_mb = 0;
+  for (size_t s = 0; s < STEP_COUNT && STEPS_MB[s] <= max_mb; s++) {
+    size_t step_mb = STEPS_MB[s];
+    if (step_mb - touched_mb > available_mb() * 3 / 4) {
+      printf("%8zu  skipped: only %zu MB available\n", step_mb, available_mb());
+      break;
+    }
+    memset(memory + touched_mb * MB, 1, (step_mb - touched_mb) * MB);
+    touched_mb = step_mb;
+
+    printf("%8zu", step_mb);
+    fflush(stdout);
+    for (size_t m = 0; m < SPAWN_MODE_COUNT; m++) {
+      double spawn_seconds, total_seconds;
+      time_mode(SPAWN_MODES[m].mode, count, &spawn_seconds, &total_seconds);
+      printf("  %10.1f %10.1f", spawn_seconds * 1e6, total_seconds * 1e6);
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+
+  munmap(memory, reserve_mb * MB);
+  return EXIT_SUCCESS;
+}
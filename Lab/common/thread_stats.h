@@ -0,0 +1,275 @@
+#ifndef LAB_THREAD_STATS_H
+#define LAB_THREAD_STATS_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // for RUSAGE_THREAD; include this header first or define it yourself
+#endif
+
+#include <pthread.h>       // for pthread_key_create(), pthread_once()
+#include <stdio.h>         // for fprintf(), fopen()
+#include <stdlib.h>        // for getenv(), atexit(), malloc()
+#include <string.h>        // for strcmp(), strncmp()
+#include <sys/resource.h>  // for getrusage()
+#include <sys/syscall.h>   // for SYS_gettid
+#include <time.h>          // for clock_gettime()
+#include <unistd.h>        // for syscall()
+
+//--------------------------------------------------------------------------------
+// int clock_gettime(CLOCK_THREAD_CPUTIME_ID, struct timespec* tp);
+// Brief: CPU time consumed by the calling thread alone (user + system), in nanoseconds
+//
+// Search clock_gettime(2) for more information
+//--------------------------------------------------------------------------------
+// int getrusage(RUSAGE_THREAD, struct rusage* usage);
+// Brief: Resource usage of the calling thread
+//
+// Notes:
+// - ru_utime/ru_stime: user and system CPU time
+// - ru_nvcsw: voluntary context switches (the thread blocked: a lock, a read(), a join)
+// - ru_nivcsw: involuntary context switches (the scheduler took the CPU away: more threads than CPUs)
+// - ru_minflt/ru_majflt: page faults served from memory / that needed I/O
+//
+// Search getrusage(2) for more information
+//--------------------------------------------------------------------------------
+// Per-thread CPU accounting
+// Brief: Samples each thread's CPU time, rusage, run-queue wait and CPU migrations when it exits and prints one report at
+//        process exit: a row per thread, then per name the total, the imbalance (busiest thread / mean) and where the
+//        time off the CPU went
+//
+// Usage:
+//   void* worker(void* arg) {
+//     thread_stats_begin("Sort");  // first thing in the thread function
+//     ...
+//   }
+//
+//   THREAD_STATS=1 ./q1   (the report goes to stderr when the program exits)
+//
+// Notes:
+// - Off unless THREAD_STATS is set (and not "0"); thread_stats_begin() is then one branch
+// - The sample is taken by a thread-specific-data destructor, so it also catches pthread_exit() and cancellation;
+//   a thread still running at exit() (e.g. main, if it called begin) is sampled by the report itself
+// - Time off the CPU (wall - cpu) is split in two, as a share of wall:
+//   - queued: runnable but waiting for a CPU (field 2 of /proc/thread-self/schedstat): too many threads for the CPUs
+//   - blocked: the rest, asleep on a lock, a read(), a join: the program itself made the thread wait
+//   Both show "-" on kernels without schedstat (CONFIG_SCHEDSTATS off)
+// - Migrations come from /proc/thread-self/sched (se.nr_migrations) and show "-" on kernels without it
+//--------------------------------------------------------------------------------
+
+#define THREAD_STATS_MAX 256
+
+typedef struct {
+  const char* name;  // must outlive the program (a string literal)
+  long tid;
+  double wall;  // seconds from begin to exit
+  double cpu;   // CLOCK_THREAD_CPUTIME_ID
+  double user;
+  double sys;
+  long voluntary;    // context switches
+  long involuntary;
+  long minor_faults;
+  long major_faults;
+  long migrations;  // -1 if unknown
+  double queued;    // seconds runnable but not running, -1 if unknown
+} ThreadStatsRecord;
+
+typedef struct {
+  const char* name;
+  double wall;
+  double cpu;
+  struct rusage usage;
+  long migrations;
+  double queued;
+} ThreadStatsStart;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_once_t once;
+  pthread_key_t key;
+  int enabled;  // -1 until the environment was checked
+  size_t count;
+  size_t dropped;  // threads beyond THREAD_STATS_MAX
+  ThreadStatsRecord records[THREAD_STATS_MAX];
+} thread_stats = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_ONCE_INIT, 0, -1, 0, 0, {{0}}};
+
+static inline double thread_stats_clock(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static inline double thread_stats_timeval(struct timeval tv) {
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static inline long thread_stats_migrations() {
+  FILE* sched = fopen("/proc/thread-self/sched", "r");
+  if (sched == NULL) {
+    return -1;
+  }
+  char line[256];
+  long migrations = -1;
+  while (fgets(line, sizeof(line), sched) != NULL) {
+    if (strncmp(line, "se.nr_migrations", 16) == 0) {
+      char* colon = strchr(line, ':');
+      if (colon != NULL) {
+        migrations = atol(colon + 1);
+      }
+      break;
+    }
+  }
+  fclose(sched);
+  return migrations;
+}
+
+// Seconds the calling thread spent on a run queue waiting for a CPU; -1 if the kernel does not keep schedstat
+static inline double thread_stats_queued() {
+  FILE* schedstat = fopen("/proc/thread-self/schedstat", "r");
+  if (schedstat == NULL) {
+    return -1;
+  }
+  unsigned long long running_ns, waiting_ns;
+  int fields = fscanf(schedstat, "%llu %llu", &running_ns, &waiting_ns);
+  fclose(schedstat);
+  return fields == 2 ? (double)waiting_ns / 1e9 : -1;
+}
+
+// Splits a thread's time off the CPU into queued and blocked percentages of wall; "-" for both if queued is unknown
+static inline void thread_stats_off_cpu(double wall, double cpu, double queued, char* queued_text, char* blocked_text,
+                                        size_t size) {
+  if (queued < 0 || wall <= 0) {
+    snprintf(queued_text, size, "-");
+    snprintf(blocked_text, size, "-");
+    return;
+  }
+  double blocked = wall - cpu - queued;
+  snprintf(queued_text, size, "%.1f%%", queued / wall * 100);
+  snprintf(blocked_text, size, "%.1f%%", blocked > 0 ? blocked / wall * 100 : 0);
+}
+
+// Runs on the exiting thread: turns its start sample into a record
+static inline void thread_stats_finish(void* arg) {
+  ThreadStatsStart* start = arg;
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  double cpu      = thread_stats_clock(CLOCK_THREAD_CPUTIME_ID);
+  double wall     = thread_stats_clock(CLOCK_MONOTONIC);
+  long migrations = thread_stats_migrations();
+  double queued   = thread_stats_queued();
+
+  ThreadStatsRecord record = {
+      .name         = start->name,
+      .tid          = (long)syscall(SYS_gettid),
+      .wall         = wall - start->wall,
+      .cpu          = cpu - start->cpu,
+      .user         = thread_stats_timeval(usage.ru_utime) - thread_stats_timeval(start->usage.ru_utime),
+      .sys          = thread_stats_timeval(usage.ru_stime) - thread_stats_timeval(start->usage.ru_stime),
+      .voluntary    = usage.ru_nvcsw - start->usage.ru_nvcsw,
+      .involuntary  = usage.ru_nivcsw - start->usage.ru_nivcsw,
+      .minor_faults = usage.ru_minflt - start->usage.ru_minflt,
+      .major_faults = usage.ru_majflt - start->usage.ru_majflt,
+      .migrations   = migrations == -1 || start->migrations == -1 ? -1 : migrations - start->migrations,
+      .queued       = queued < 0 || start->queued < 0 ? -1 : queued - start->queued,
+  };
+  free(start);
+
+  pthread_mutex_lock(&thread_stats.lock);
+  if (thread_stats.count < THREAD_STATS_MAX) {
+    thread_stats.records[thread_stats.count++] = record;
+  } else {
+    thread_stats.dropped++;
+  }
+  pthread_mutex_unlock(&thread_stats.lock);
+}
+
+static inline void thread_stats_report(void) {
+  // exit() runs no thread-specific-data destructors, so sample the exiting thread here if it is being tracked
+  ThreadStatsStart* self = pthread_getspecific(thread_stats.key);
+  if (self != NULL) {
+    pthread_setspecific(thread_stats.key, NULL);
+    thread_stats_finish(self);
+  }
+
+  (void)fflush(stdout);  // keep the report after the program's own output
+  pthread_mutex_lock(&thread_stats.lock);
+  fprintf(stderr, "\n%-16s %8s %10s %10s %10s %10s %8s %8s %8s %8s %8s %8s\n", "thread", "tid", "wall ms", "cpu ms",
+          "user ms", "sys ms", "queued", "blocked", "vol-cs", "invol-cs", "migr", "minflt");
+  for (size_t i = 0; i < thread_stats.count; i++) {
+    const ThreadStatsRecord* r = &thread_stats.records[i];
+    char migrations[24]        = "-";
+    char queued[24], blocked[24];
+    if (r->migrations != -1) {
+      snprintf(migrations, sizeof(migrations), "%ld", r->migrations);
+    }
+    thread_stats_off_cpu(r->wall, r->cpu, r->queued, queued, blocked, sizeof(queued));
+    fprintf(stderr, "%-16s %8ld %10.3f %10.3f %10.3f %10.3f %8s %8s %8ld %8ld %8s %8ld\n", r->name, r->tid, r->wall * 1e3,
+            r->cpu * 1e3, r->user * 1e3, r->sys * 1e3, queued, blocked, r->voluntary, r->involuntary, migrations,
+            r->minor_faults);
+  }
+
+  // Per name: how evenly the work was split and how much of the threads' time was spent not running
+  fprintf(stderr, "\n%-16s %8s %12s %12s %12s %10s %8s %8s\n", "name", "threads", "cpu ms", "mean ms", "max ms",
+          "imbalance", "queued", "blocked");
+  for (size_t i = 0; i < thread_stats.count; i++) {
+    const char* name = thread_stats.records[i].name;
+    int seen         = 0;
+    for (size_t j = 0; j < i && !seen; j++) {
+      seen = strcmp(thread_stats.records[j].name, name) == 0;
+    }
+    if (seen) {
+      continue;
+    }
+
+    size_t threads = 0;
+    double cpu = 0, wall = 0, max = 0, queued = 0;
+    for (size_t j = i; j < thread_stats.count; j++) {
+      const ThreadStatsRecord* r = &thread_stats.records[j];
+      if (strcmp(r->name, name) == 0) {
+        threads++;
+        cpu += r->cpu;
+        wall += r->wall;
+        max    = r->cpu > max ? r->cpu : max;
+        queued = queued < 0 || r->queued < 0 ? -1 : queued + r->queued;
+      }
+    }
+    double mean = cpu / (double)threads;
+    char queued_text[24], blocked_text[24];
+    thread_stats_off_cpu(wall, cpu, queued, queued_text, blocked_text, sizeof(queued_text));
+    fprintf(stderr, "%-16s %8zu %12.3f %12.3f %12.3f %9.2fx %8s %8s\n", name, threads, cpu * 1e3, mean * 1e3, max * 1e3,
+            mean > 0 ? max / mean : 1.0, queued_text, blocked_text);
+  }
+  if (thread_stats.dropped > 0) {
+    fprintf(stderr, "(%zu more threads not recorded, THREAD_STATS_MAX is %d)\n", thread_stats.dropped, THREAD_STATS_MAX);
+  }
+  pthread_mutex_unlock(&thread_stats.lock);
+}
+
+static inline void thread_stats_init() {
+  const char* env      = getenv("THREAD_STATS");
+  thread_stats.enabled = env != NULL && *env != '\0' && strcmp(env, "0") != 0;
+  if (thread_stats.enabled) {
+    pthread_key_create(&thread_stats.key, thread_stats_finish);
+    atexit(thread_stats_report);
+  }
+}
+
+// Starts accounting for the calling thread under name; the sample is taken when the thread exits
+static inline void thread_stats_begin(const char* name) {
+  pthread_once(&thread_stats.once, thread_stats_init);
+  if (!thread_stats.enabled) {
+    return;
+  }
+
+  ThreadStatsStart* start = pthread_getspecific(thread_stats.key);  // begun again: start over
+  if (start == NULL && (start = malloc(sizeof(ThreadStatsStart))) == NULL) {
+    return;
+  }
+  start->name       = name;
+  start->migrations = thread_stats_migrations();
+  start->queued     = thread_stats_queued();
+  getrusage(RUSAGE_THREAD, &start->usage);
+  start->wall = thread_stats_clock(CLOCK_MONOTONIC);
+  start->cpu  = thread_stats_clock(CLOCK_THREAD_CPUTIME_ID);
+  pthread_setspecific(thread_stats.key, start);
+}
+
+#endif  // LAB_THREAD_STATS_H